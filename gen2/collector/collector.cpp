@@ -0,0 +1,193 @@
+// collector.cpp - Collector of many P1 streams (serial ports, ptys, TCP sockets) on a Linux host
+
+
+#include <Arduino.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "collector.h"
+
+
+// === STREAMS ==================================================================================
+
+
+// Opens `spec` (see collector_open()), returns the (non-blocking) file descriptor or -1
+static int collector_connect(const char * spec) {
+  if( strncmp(spec,"tcp:",4)==0 ) {
+    char host[64];
+    const char * colon = strrchr(spec+4,':');
+    if( colon==NULL || colon-(spec+4)>=(int)sizeof host ) return -1;
+    memcpy(host, spec+4, colon-(spec+4));
+    host[colon-(spec+4)] = '\0';
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo * res;
+    if( getaddrinfo(host, colon+1, &hints, &res)!=0 ) return -1;
+    int fd = socket(res->ai_family, SOCK_STREAM, 0);
+    if( fd>=0 && connect(fd, res->ai_addr, res->ai_addrlen)<0 ) { close(fd); fd = -1; }
+    freeaddrinfo(res);
+    if( fd>=0 ) fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+  }
+  int fd = open(spec, O_RDONLY|O_NOCTTY|O_NONBLOCK);
+  if( fd<0 ) return -1;
+  // A serial port or pty: raw bytes (no CR/LF translation, no echo), 115200 8N1 (a pty ignores the speed)
+  struct termios tio;
+  if( tcgetattr(fd,&tio)==0 ) {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B115200);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+
+// Registers the open stream with the epoll instance
+static void collector_arm(Collector * collector, Collector_Stream * stream, int op) {
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.ptr = stream;
+  epoll_ctl(collector->epfd, op, stream->fd, &ev);
+}
+
+
+static int collector_new_stream(Collector * collector, const char * spec, int fd) {
+  if( collector->numstreams==COLLECTOR_MAXSTREAMS ) { close(fd); return -1; }
+  Collector_Stream * stream = new Collector_Stream;
+  stream->index = collector->numstreams;
+  snprintf(stream->spec, sizeof stream->spec, "%s", spec);
+  stream->fd = fd;
+  stream->parser = tele_parser_new(collector->fields);
+  stream->bang = false;
+  stream->bytes = 0;
+  stream->telegrams = 0;
+  stream->errors = 0;
+  stream->closes = 0;
+  collector->streams[collector->numstreams++] = stream;
+  collector_arm(collector, stream, EPOLL_CTL_ADD);
+  return stream->index;
+}
+
+
+// Closes `stream` (it can be reopened by collector_reopen())
+static void collector_close(Collector * collector, Collector_Stream * stream) {
+  epoll_ctl(collector->epfd, EPOLL_CTL_DEL, stream->fd, NULL);
+  close(stream->fd);
+  stream->closes++;
+  stream->fd = -1;
+}
+
+
+// === WORKERS ==================================================================================
+
+
+// Feeds `len` bytes of `buf` to the parser of `stream`. The buffer is fed up to the end of each telegram (the line
+// after a '!'), so that the telegram function sees every telegram: a snapshot only lasts until the next but one.
+static void collector_feed(Collector * collector, Collector_Stream * stream, const char * buf, int len) {
+  const char * end = buf+len;
+  while( buf<end ) {
+    const char * bang = stream->bang ? buf : (const char *)memchr(buf, '!', end-buf);
+    const char * lf = bang!=NULL ? (const char *)memchr(bang, '\n', end-bang) : NULL;
+    const char * next = lf!=NULL ? lf+1 : end;
+    stream->bang = bang!=NULL && lf==NULL;
+    int errors = 0;
+    int n = tele_parser_add_buf(stream->parser, buf, next-buf, &errors);
+    if( errors>0 ) stream->errors += errors;
+    if( n>0 ) {
+      stream->telegrams += n;
+      collector->fn(collector->ctx, stream, tele_parser_snapshot(stream->parser));
+    }
+    buf = next;
+  }
+  stream->bytes += len;
+}
+
+
+static void collector_work(Collector * collector) {
+  char buf[COLLECTOR_READSIZE];
+  while( !collector->stopping ) {
+    struct epoll_event ev;
+    if( epoll_wait(collector->epfd, &ev, 1, 100)!=1 ) continue;
+    Collector_Stream * stream = (Collector_Stream *)ev.data.ptr;
+    // Read what is there, but at most a few buffers, so that the other streams get their turn
+    bool open = true;
+    for( int i=0; i<4; i++ ) {
+      int len = read(stream->fd, buf, sizeof buf);
+      if( len>0 ) { collector_feed(collector, stream, buf, len); continue; }
+      if( len<0 && (errno==EAGAIN || errno==EINTR) ) break;
+      open = false; // end of file, or EIO when the other side of a pty closed
+      break;
+    }
+    if( open ) collector_arm(collector, stream, EPOLL_CTL_MOD); else collector_close(collector, stream);
+  }
+}
+
+
+// === API ======================================================================================
+
+
+void collector_init(Collector * collector, uint32_t fields, Collector_Fn fn, void * ctx) {
+  collector->epfd = epoll_create1(0);
+  collector->fields = fields;
+  collector->fn = fn;
+  collector->ctx = ctx;
+  collector->numstreams = 0;
+  collector->numworkers = 0;
+  collector->stopping = false;
+}
+
+
+int collector_open(Collector * collector, const char * spec) {
+  int fd = collector_connect(spec);
+  if( fd<0 ) return -1;
+  return collector_new_stream(collector, spec, fd);
+}
+
+
+int collector_add(Collector * collector, int fd) {
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return collector_new_stream(collector, "", fd);
+}
+
+
+void collector_start(Collector * collector, int workers) {
+  if( workers>COLLECTOR_MAXWORKERS ) workers = COLLECTOR_MAXWORKERS;
+  for( int i=0; i<workers; i++ ) collector->workers[i] = std::thread(collector_work, collector);
+  collector->numworkers = workers;
+}
+
+
+int collector_reopen(Collector * collector) {
+  int count = 0;
+  for( int i=0; i<collector->numstreams; i++ ) {
+    Collector_Stream * stream = collector->streams[i];
+    if( stream->fd>=0 || stream->spec[0]=='\0' ) continue;
+    int fd = collector_connect(stream->spec);
+    if( fd<0 ) continue;
+    stream->fd = fd;
+    stream->bang = false;
+    collector_arm(collector, stream, EPOLL_CTL_ADD);
+    count++;
+  }
+  return count;
+}
+
+
+void collector_stop(Collector * collector) {
+  collector->stopping = true;
+  for( int i=0; i<collector->numworkers; i++ ) collector->workers[i].join();
+  collector->numworkers = 0;
+  for( int i=0; i<collector->numstreams; i++ ) {
+    Collector_Stream * stream = collector->streams[i];
+    if( stream->fd>=0 ) collector_close(collector, stream);
+    tele_parser_delete(stream->parser);
+    delete stream;
+  }
+  collector->numstreams = 0;
+  close(collector->epfd);
+}
@@ -0,0 +1,83 @@
+// collector.h - Interface to a collector of many P1 streams (serial ports, ptys, TCP sockets) on a Linux host
+#ifndef _COLLECTOR_H_
+#define _COLLECTOR_H_
+
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "tele.h"
+
+
+// The collector multiplexes all streams with one epoll instance. A pool of workers waits on it; a stream that has
+// data is handed to one worker at a time (EPOLLONESHOT), which reads it, feeds its parser (one Tele_Parser per
+// stream, parsers share no state), and calls the telegram function for each telegram that became available.
+// So the streams are parsed in parallel, and the throughput scales with the number of workers (up to the cores).
+// The telegram function (formatting, sinks) runs in the worker, so it must be thread safe across streams;
+// for one stream it is never called concurrently.
+
+
+#define COLLECTOR_KEYS  "LHlhIPpFfAaT"  // default fields: the ones every meter has (also single phase, without gas)
+#define COLLECTOR_MAXSTREAMS  1024
+#define COLLECTOR_MAXWORKERS    64
+#define COLLECTOR_READSIZE    4096   // bytes read from a stream at once
+
+
+struct Collector_Stream {
+  int                   index;     // in Collector.streams
+  char                  spec[64];  // how it was opened (see collector_open()), empty if added as fd
+  std::atomic<int>      fd;        // -1 when closed
+  Tele_Parser *         parser;
+  bool                  bang;      // a '!' (the CRC line) was fed, but not yet the end of its line
+  // Statistics (only written by the worker that holds the stream)
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint32_t> telegrams;
+  std::atomic<uint32_t> errors;
+  std::atomic<uint32_t> closes;    // number of times the stream closed (end of file, hang-up, error)
+};
+
+
+// Called by a worker for each telegram that became available on `stream`; `snap` is valid during the call.
+typedef void (*Collector_Fn)(void * ctx, const Collector_Stream * stream, const Tele_Snapshot * snap);
+
+
+struct Collector {
+  int               epfd;
+  uint32_t          fields;       // fields the parsers extract, see tele_fields_mask()
+  Collector_Fn      fn;
+  void *            ctx;
+  Collector_Stream *streams[COLLECTOR_MAXSTREAMS];
+  int               numstreams;
+  std::thread       workers[COLLECTOR_MAXWORKERS];
+  int               numworkers;
+  std::atomic<bool> stopping;
+};
+
+
+// Initialize `collector`; its parsers extract `fields`, and `fn` gets the telegrams (with `ctx`).
+void collector_init(Collector * collector, uint32_t fields, Collector_Fn fn, void * ctx);
+
+
+// Opens `spec`, a serial device or pty (e.g. "/dev/ttyUSB0", set to raw 115200 8N1) or a TCP stream ("tcp:host:port"),
+// and adds it. Returns the stream index, or -1 if it can not be opened.
+int  collector_open(Collector * collector, const char * spec);
+
+
+// Adds the stream on file descriptor `fd` (it is made non-blocking, and closed by the collector). Returns its index.
+int  collector_add(Collector * collector, int fd);
+
+
+// Starts `workers` worker threads.
+void collector_start(Collector * collector, int workers);
+
+
+// Reopens the streams that closed and were opened with a spec (e.g. a TCP peer that went away); returns how many.
+// Call this now and then from the main thread.
+int  collector_reopen(Collector * collector);
+
+
+// Stops the workers, and closes all streams.
+void collector_stop(Collector * collector);
+
+
+#endif
@@ -0,0 +1,101 @@
+// collectord.cpp - Collector daemon: reads many P1 streams, and writes their telegrams as JSON lines to stdout
+//
+// usage: collectord [-w workers] [-f keys] [-s seconds] [-v] stream...
+//   stream  a serial device or pty, e.g. /dev/ttyUSB0, or a TCP stream tcp:host:port (e.g. from ser2net)
+//   -w      number of workers (default the number of cores)
+//   -f      keys of the fields to extract, e.g. PpLHlhG (default COLLECTOR_KEYS); a telegram without one is rejected
+//   -s      seconds between statistics on stderr (default 60, 0 for none)
+//   -v      also print the parser messages (e.g. the cause of an error)
+
+
+#include <Arduino.h>
+#include <signal.h>
+#include <unistd.h>
+#include <mutex>
+#include "collector.h"
+
+
+static std::mutex       out_lock;
+static volatile bool    stopping;
+
+
+// Writes the telegram as one JSON line, e.g. {"stream":"/dev/ttyUSB0","seq":12,"Cons-kW":0.586,"Cons-Gas-m3":16051.816}
+static void out_telegram(void * ctx, const Collector_Stream * stream, const Tele_Snapshot * snap) {
+  uint32_t fields = *(const uint32_t *)ctx;
+  char buf[4096];
+  int len = snprintf(buf, sizeof buf, "{\"stream\":\"%s\",\"seq\":%u", stream->spec, (unsigned)tele_snapshot_seq(snap));
+  for( int i=0; i<TELE_NUMFIELDS && len<(int)sizeof buf; i++ ) {
+    if( !((fields>>i)&1) ) continue;
+    int32_t v = tele_snapshot_num(snap, i);
+    switch( tele_field_type(i) ) {
+    case TELE_TYPE_MILLI: len+= snprintf(buf+len, sizeof buf-len, ",\"%s\":%s%d.%03d", tele_field_name(i), v<0?"-":"", (int)(abs(v)/1000), (int)(abs(v)%1000)); break;
+    case TELE_TYPE_STRING: len+= snprintf(buf+len, sizeof buf-len, ",\"%s\":\"%s\"", tele_field_name(i), tele_snapshot_value(snap,i)); break;
+    default: len+= snprintf(buf+len, sizeof buf-len, ",\"%s\":%d", tele_field_name(i), (int)v); break;
+    }
+  }
+  if( len>=(int)sizeof buf-2 ) return; // does not happen with the fields in tele_fields[]
+  len+= snprintf(buf+len, sizeof buf-len, "}\n");
+  std::lock_guard<std::mutex> guard(out_lock);
+  fwrite(buf, 1, len, stdout);
+  fflush(stdout);
+}
+
+
+static void stats_print(const Collector * collector) {
+  uint64_t bytes = 0;
+  uint32_t telegrams = 0, errors = 0, closed = 0;
+  for( int i=0; i<collector->numstreams; i++ ) {
+    const Collector_Stream * stream = collector->streams[i];
+    bytes += stream->bytes;
+    telegrams += stream->telegrams;
+    errors += stream->errors;
+    if( stream->fd<0 ) closed++;
+  }
+  fprintf(stderr, "collectord: %d streams (%u closed), %llu bytes, %u telegrams, %u errors\n", 
+    collector->numstreams, closed, (unsigned long long)bytes, telegrams, errors);
+}
+
+
+static void on_signal(int) {
+  stopping = true;
+}
+
+
+int main(int argc, char * argv[]) {
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t fields = tele_fields_mask(COLLECTOR_KEYS);
+  int period = 60;
+  bool verbose = false;
+  int opt;
+  while( (opt=getopt(argc,argv,"w:f:s:v"))!=-1 ) {
+    switch( opt ) {
+    case 'w': workers = atoi(optarg); break;
+    case 'f': fields = tele_fields_mask(optarg); break;
+    case 's': period = atoi(optarg); break;
+    case 'v': verbose = true; break;
+    default: fprintf(stderr, "usage: collectord [-w workers] [-f keys] [-s seconds] [-v] stream...\n"); return 2;
+    }
+  }
+  if( optind==argc ) { fprintf(stderr, "collectord: no streams\n"); return 2; }
+  host_quiet = !verbose;
+
+  static Collector collector; // large
+  collector_init(&collector, fields, out_telegram, &fields);
+  for( int i=optind; i<argc; i++ ) {
+    if( collector_open(&collector,argv[i])<0 ) { fprintf(stderr, "collectord: cannot open %s\n", argv[i]); return 1; }
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  collector_start(&collector, workers<1 ? 1 : workers);
+  fprintf(stderr, "collectord: %d streams, %d workers\n", collector.numstreams, collector.numworkers);
+
+  // The workers do the work; here closed streams are reopened (e.g. a TCP peer that restarted) and statistics printed
+  for( int secs=1; !stopping; secs++ ) {
+    sleep(1);
+    collector_reopen(&collector);
+    if( period>0 && secs%period==0 ) stats_print(&collector);
+  }
+  stats_print(&collector);
+  collector_stop(&collector);
+  return 0;
+}
@@ -0,0 +1,132 @@
+// loadtest.cpp - Load test of the collector: hundreds of synthetic meters (see telegen.h), each on its own pty
+//
+// usage: loadtest [-m meters] [-t telegrams] [-w workers] [-p]
+//   -m  number of meters (default 200)
+//   -t  telegrams per meter (default 20)
+//   -w  number of collector workers (default the number of cores)
+//   -p  paced: every meter sends a telegram per second (like DSMR 5), instead of as fast as the ptys take them
+// Fails (exit code 1) unless every telegram arrives, without errors, with the power that was generated.
+
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include "collector.h"
+#include "telegen.h"
+
+
+#define LOAD_WRITERS 4 // threads writing to the ptys
+
+
+struct Meter {
+  int                   master;    // pty master (the meter side)
+  Telegen               gen;
+  int64_t               sent_sum;  // sum of the power sent (W)
+  std::atomic<int>      received;  // telegrams received by the collector
+  std::atomic<int64_t>  recv_sum;  // sum of the power received (milli kW, so W)
+};
+
+
+static std::vector<Meter> meters;
+static int P; // index of Cons-kW
+
+
+static void load_telegram(void *, const Collector_Stream * stream, const Tele_Snapshot * snap) {
+  Meter * meter = &meters[stream->index];
+  meter->recv_sum += tele_snapshot_milli(snap, P);
+  meter->received++;
+}
+
+
+// Writes `telegrams` telegrams to every meter with (index % LOAD_WRITERS)==`slice`
+static void load_write(int slice, int telegrams, bool paced) {
+  static thread_local char tbuf[4096];
+  auto start = std::chrono::steady_clock::now();
+  for( int t=0; t<telegrams; t++ ) {
+    for( size_t m=slice; m<meters.size(); m+=LOAD_WRITERS ) {
+      Meter * meter = &meters[m];
+      int len = telegen_next(&meter->gen, tbuf, sizeof tbuf);
+      meter->sent_sum += telegen_power(&meter->gen, false);
+      for( const char * p=tbuf; len>0; ) {
+        int n = write(meter->master, p, len);
+        if( n<0 ) return;
+        p += n;
+        len -= n;
+      }
+    }
+    if( paced ) std::this_thread::sleep_until(start + std::chrono::seconds(t+1));
+  }
+}
+
+
+int main(int argc, char * argv[]) {
+  int nummeters = 200;
+  int telegrams = 20;
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  bool paced = false;
+  int opt;
+  while( (opt=getopt(argc,argv,"m:t:w:p"))!=-1 ) {
+    switch( opt ) {
+    case 'm': nummeters = atoi(optarg); break;
+    case 't': telegrams = atoi(optarg); break;
+    case 'w': workers = atoi(optarg); break;
+    case 'p': paced = true; break;
+    default: fprintf(stderr, "usage: loadtest [-m meters] [-t telegrams] [-w workers] [-p]\n"); return 2;
+    }
+  }
+  if( nummeters>COLLECTOR_MAXSTREAMS ) nummeters = COLLECTOR_MAXSTREAMS;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_key(i)=='P' ) P = i;
+  host_quiet = true;
+
+  // Meters of all shapes, each on a pty; the collector opens the other side
+  static Collector collector;
+  collector_init(&collector, tele_fields_mask(COLLECTOR_KEYS), load_telegram, NULL);
+  meters = std::vector<Meter>(nummeters);
+  for( int m=0; m<nummeters; m++ ) {
+    Meter * meter = &meters[m];
+    meter->master = posix_openpt(O_RDWR|O_NOCTTY);
+    if( meter->master<0 || grantpt(meter->master)<0 || unlockpt(meter->master)<0 ) { printf("load: cannot open pty %d\n", m); return 1; }
+    if( collector_open(&collector, ptsname(meter->master))!=m ) { printf("load: cannot open %s\n", ptsname(meter->master)); return 1; }
+    telegen_init(&meter->gen, m % (TELEGEN_FAILLOG*2), 1000+m);
+    meter->sent_sum = 0;
+    meter->received = 0;
+    meter->recv_sum = 0;
+  }
+  collector_start(&collector, workers<1 ? 1 : workers);
+
+  // Write all telegrams, and wait till they all arrived (or nothing arrives for a while)
+  auto start = std::chrono::steady_clock::now();
+  std::thread writers[LOAD_WRITERS];
+  for( int w=0; w<LOAD_WRITERS; w++ ) writers[w] = std::thread(load_write, w, telegrams, paced);
+  for( int w=0; w<LOAD_WRITERS; w++ ) writers[w].join();
+  int total = nummeters*telegrams;
+  int received = 0, last = -1;
+  for( int idle=0; received<total && idle<200; idle = received==last ? idle+1 : 0 ) {
+    last = received;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    received = 0;
+    for( Meter & meter : meters ) received += meter.received;
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+  // Check every meter
+  int bad = 0;
+  uint64_t bytes = 0;
+  uint32_t errors = 0;
+  for( int m=0; m<nummeters; m++ ) {
+    const Collector_Stream * stream = collector.streams[m];
+    bytes += stream->bytes;
+    errors += stream->errors;
+    if( meters[m].received!=telegrams || stream->errors!=0 || meters[m].recv_sum!=meters[m].sent_sum ) {
+      if( bad++<10 ) printf("load: meter %d: %d/%d telegrams, %u errors\n", m, (int)meters[m].received, telegrams, (unsigned)stream->errors);
+    }
+  }
+  collector_stop(&collector);
+  for( Meter & meter : meters ) close(meter.master);
+  printf("load: %d meters, %d workers, %d/%d telegrams, %u errors, %.2f s, %.0f telegrams/s, %.1f MB/s\n",
+    nummeters, workers, received, total, (unsigned)errors, secs, received/secs, bytes/secs/1e6);
+  printf("load: %s\n", bad==0 ? "pass" : "FAIL");
+  return bad==0 ? 0 : 1;
+}
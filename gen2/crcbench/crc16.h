@@ -0,0 +1,64 @@
+// crc16.h - Interface to the CRC16 used by Dutch smart meter telegrams (polynome x16+x15+x2+1, reflected 0xA001)
+#ifndef _CRC16_H_
+#define _CRC16_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// There are several implementations of the CRC, they trade RAM (table size) for speed
+#define CRC16_VARIANT_BITWISE 0 // no table, eight shifts and branches per byte
+#define CRC16_VARIANT_TABLE   1 // one table of 256 entries (512 bytes), one lookup per byte
+#define CRC16_VARIANT_SLICE4  2 // four tables of 256 entries (2 kbyte), four bytes per step
+#define CRC16_VARIANT_SLICE8  3 // eight tables of 256 entries (4 kbyte), eight bytes per step
+
+
+// The implementation used by crc16_update() is selected at compile time (crc16_add() uses the table, unless BITWISE is selected)
+#ifndef CRC16_VARIANT
+#define CRC16_VARIANT CRC16_VARIANT_TABLE
+#endif
+
+
+// The initial value of the CRC (the telegram CRC starts with 0x0000)
+#define CRC16_INIT 0x0000
+
+
+// The byte table (also the first table of the slice-by-n variants)
+extern const uint16_t crc16_table[256];
+
+
+// Returns `crc` updated with one byte, bit by bit; this one can also be evaluated by the compiler (constexpr).
+static constexpr uint16_t crc16_step(uint16_t crc, uint8_t byte) {
+  crc ^= byte;
+  for(int i=8; i!=0; i--) {
+    int bit = crc & 0x0001;
+    crc >>= 1;
+    if( bit ) crc ^= 0xA001; // If the LSB is set xor with polynome x16+x15+x2+1
+  }
+  return crc;
+}
+
+
+// Returns `crc` updated with one byte; for folding in the characters one at a time as they arrive.
+static inline uint16_t crc16_add(uint16_t crc, uint8_t byte) {
+  #if CRC16_VARIANT==CRC16_VARIANT_BITWISE
+    return crc16_step(crc, byte);
+  #else
+    return (crc >> 8) ^ crc16_table[ (crc ^ byte) & 0xFF ];
+  #endif
+}
+
+
+// Returns `crc` updated with the `len` bytes in `buf`, using the variant selected by CRC16_VARIANT.
+uint16_t crc16_update(uint16_t crc, const void * buf, size_t len);
+
+
+// The individual variants, all of them are always available (e.g. for benchmarking); the linker drops the unused tables.
+uint16_t crc16_update_bitwise(uint16_t crc, const void * buf, size_t len);
+uint16_t crc16_update_table  (uint16_t crc, const void * buf, size_t len);
+uint16_t crc16_update_slice4 (uint16_t crc, const void * buf, size_t len);
+uint16_t crc16_update_slice8 (uint16_t crc, const void * buf, size_t len);
+
+
+#endif
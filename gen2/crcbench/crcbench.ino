@@ -0,0 +1,106 @@
+// crcbench.ino - Dutch smart meter reader - benchmarks the CRC16 variants on the example telegrams
+
+// step 1. connect ESP8266 NodeMCU via USB to laptop
+// step 2. flash this sketch to the ESP using that serial-over-USB link
+// step 3. see the benchmark results on serial port on PC (no smart meter needed)
+
+// Notes
+// - crc16.h, crc16.cpp and tele.h are copies of the ones in emp1g2
+// - tele.h is only used for the TELE_EXAMPLE_x telegrams
+
+
+#include "crc16.h"
+#include "tele.h"
+
+
+// === APP ============================================================================================
+
+
+#define BENCH_RUNS 100 // each telegram is checksummed this many times per variant
+
+
+// Results of the per-byte loop are xor'ed into here, so that the compiler can not optimize the loop away
+volatile uint16_t bench_sink;
+
+
+typedef uint16_t (*Bench_Fn)(uint16_t crc, const void * buf, size_t len);
+
+
+// The variants that are compared
+struct Bench_Variant {
+  const char * name;
+  Bench_Fn     fn;
+};
+
+
+static const Bench_Variant bench_variants[] = {
+  { "bitwise", crc16_update_bitwise },
+  { "table"  , crc16_update_table   },
+  { "slice4" , crc16_update_slice4  },
+  { "slice8" , crc16_update_slice8  },
+};
+#define BENCH_NUMVARIANTS ( sizeof(bench_variants)/sizeof(bench_variants[0]) )
+
+
+static const char * const bench_telegrams[] = { TELE_EXAMPLE_1, TELE_EXAMPLE_2, TELE_EXAMPLE_3 };
+#define BENCH_NUMTELEGRAMS ( sizeof(bench_telegrams)/sizeof(bench_telegrams[0]) )
+
+
+// Returns the CRC as written in the telegram (the 4 hex digits after the '!'), and sets `len` to the number of checksummed bytes (up to and including the '!')
+static uint16_t bench_expected(const char * telegram, size_t * len) {
+  const char * excl = strchr(telegram,'!');
+  *len = excl - telegram + 1;
+  return strtoul(excl+1, NULL, 16);
+}
+
+
+// Runs all variants on all example telegrams, prints time per telegram, ns per byte and whether the CRC matches
+static void bench_run() {
+  Serial.printf("bench: %d runs per telegram\n",BENCH_RUNS);
+  for( size_t v=0; v<BENCH_NUMVARIANTS; v++ ) {
+    uint32_t us = 0;
+    size_t bytes = 0;
+    int fails = 0;
+    for( size_t t=0; t<BENCH_NUMTELEGRAMS; t++ ) {
+      size_t len;
+      uint16_t expected = bench_expected(bench_telegrams[t], &len);
+      uint16_t crc = 0;
+      uint32_t start = micros();
+      for( int r=0; r<BENCH_RUNS; r++ ) crc = bench_variants[v].fn(CRC16_INIT, bench_telegrams[t], len);
+      us += micros() - start;
+      bytes += len * BENCH_RUNS;
+      if( crc!=expected ) fails++;
+      yield(); // keep the watchdog happy
+    }
+    Serial.printf("  %-8s %6u us/telegram %5u ns/byte %s\n", bench_variants[v].name, us/(BENCH_RUNS*BENCH_NUMTELEGRAMS), (uint32_t)(us*1000ULL/bytes), fails==0?"crc ok":"CRC MISMATCH" );
+  }
+  // Also time the per-byte incremental update, as done by the parser when characters arrive one at a time
+  uint32_t us = 0;
+  size_t bytes = 0;
+  for( size_t t=0; t<BENCH_NUMTELEGRAMS; t++ ) {
+    size_t len;
+    bench_expected(bench_telegrams[t], &len);
+    const uint8_t * p = (const uint8_t *)bench_telegrams[t];
+    uint32_t start = micros();
+    for( int r=0; r<BENCH_RUNS; r++ ) { uint16_t crc=CRC16_INIT; for( size_t i=0; i<len; i++ ) crc=crc16_add(crc,p[i]); bench_sink^=crc; }
+    us += micros() - start;
+    bytes += len * BENCH_RUNS;
+    yield();
+  }
+  Serial.printf("  %-8s %6u us/telegram %5u ns/byte\n", "add", us/(BENCH_RUNS*BENCH_NUMTELEGRAMS), (uint32_t)(us*1000ULL/bytes) );
+}
+
+
+void setup() {
+  Serial.begin(115200);
+  do delay(250); while( !Serial );
+  Serial.printf("\n\n\nWelcome to crcbench\n");
+  Serial.printf("  compiled variant: %d\n\n",CRC16_VARIANT);
+}
+
+
+void loop() {
+  bench_run();
+  Serial.printf("\n");
+  delay(5000);
+}
@@ -0,0 +1,127 @@
+// agg.cpp - Rolling aggregation of telegrams per interval (min, max, mean, increase, count)
+
+
+#include <Arduino.h>
+#include "agg.h"
+
+
+#define AGG_NUMCOLS ( sizeof(AGG_KEYS)-1 )
+
+
+struct Agg_Col {
+  int32_t min;
+  int32_t max;
+  int64_t sum;
+  int32_t base;  // last value of the previous interval (for the increase)
+  int32_t last;
+};
+
+
+struct Agg_Interval {
+  int32_t start; // time (UTC) of the start of the interval
+  int     count; // number of telegrams (0 if the interval is empty)
+  Agg_Col cols[AGG_NUMCOLS];
+};
+
+
+static uint32_t     agg_period;
+static int          agg_ix[AGG_NUMCOLS];  // index in tele_fields[] for each column
+static int          agg_time;             // index in tele_fields[] of the time
+static Agg_Interval agg_cur;              // interval being aggregated
+static Agg_Interval agg_done;             // last closed interval
+
+
+// Returns the column of field `key`, or -1 if not in AGG_KEYS
+static int agg_col(char key) {
+  if( key=='\0' ) return -1;
+  for( size_t c=0; c<AGG_NUMCOLS; c++ ) if( AGG_KEYS[c]==key ) return c;
+  return -1;
+}
+
+
+uint32_t agg_fields() {
+  uint32_t fields = 0;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_type(i)==TELE_TYPE_TIME ) fields |= 1UL<<i;
+  return fields;
+}
+
+
+void agg_init(uint32_t period) {
+  agg_period = period<1 ? 1 : period;
+  agg_time = -1;
+  for( size_t c=0; c<AGG_NUMCOLS; c++ ) agg_ix[c] = -1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    if( tele_field_type(i)==TELE_TYPE_TIME ) agg_time = i;
+    int col = agg_col(tele_field_key(i));
+    if( col>=0 ) agg_ix[col] = i;
+  }
+  agg_cur.count = 0;
+  agg_done.count = 0;
+  Serial.printf("agg : init (%d fields every %us)\n", (int)AGG_NUMCOLS, (unsigned)agg_period);
+}
+
+
+void agg_add(const Tele_Snapshot * snap) {
+  if( agg_time<0 || tele_snapshot_seq(snap)==0 ) return;
+  int32_t time = tele_snapshot_num(snap, agg_time);
+  int32_t start = time - (int32_t)((uint32_t)time % agg_period);
+  // Close the current interval when the telegram is in another one
+  if( agg_cur.count>0 && start!=agg_cur.start ) {
+    agg_done = agg_cur;
+    agg_cur.count = 0;
+  }
+  // Start a new interval (the increase is relative to the last value of the previous one)
+  if( agg_cur.count==0 ) {
+    agg_cur.start = start;
+    for( size_t c=0; c<AGG_NUMCOLS; c++ ) {
+      int32_t val = agg_ix[c]<0 ? 0 : tele_snapshot_num(snap, agg_ix[c]);
+      Agg_Col * col = &agg_cur.cols[c];
+      col->min = val;
+      col->max = val;
+      col->sum = 0;
+      col->base = agg_done.count>0 ? agg_done.cols[c].last : val;
+    }
+  }
+  // Add the telegram
+  for( size_t c=0; c<AGG_NUMCOLS; c++ ) {
+    int32_t val = agg_ix[c]<0 ? 0 : tele_snapshot_num(snap, agg_ix[c]);
+    Agg_Col * col = &agg_cur.cols[c];
+    if( val<col->min ) col->min = val;
+    if( val>col->max ) col->max = val;
+    col->sum += val;
+    col->last = val;
+  }
+  agg_cur.count++;
+}
+
+
+bool agg_isfn(char fn) {
+  return fn!='\0' && strchr("<>~+#", fn)!=NULL;
+}
+
+
+bool agg_haskey(char key) {
+  return agg_col(key)>=0;
+}
+
+
+bool agg_value(char fn, char key, int32_t * value) {
+  if( agg_done.count==0 ) return false;
+  if( fn==AGG_FN_COUNT ) { *value = agg_done.count; return true; }
+  int c = agg_col(key);
+  if( c<0 ) return false;
+  const Agg_Col * col = &agg_done.cols[c];
+  switch( fn ) {
+  case AGG_FN_MIN : *value = col->min; break;
+  case AGG_FN_MAX : *value = col->max; break;
+  case AGG_FN_MEAN: *value = (int32_t)( (col->sum + (col->sum<0 ? -agg_done.count/2 : agg_done.count/2)) / agg_done.count ); break;
+  case AGG_FN_INC : *value = (int32_t)((uint32_t)col->last - (uint32_t)col->base); break;
+  default         : return false;
+  }
+  return true;
+}
+
+
+int32_t agg_start() {
+  return agg_done.count>0 ? agg_done.start : -1;
+}
@@ -0,0 +1,56 @@
+// agg.h - Interface to rolling aggregation of telegrams per interval (min, max, mean, increase, count)
+#ifndef _AGG_H_
+#define _AGG_H_
+
+
+#include <stdint.h>
+#include "tele.h"
+
+
+// Every telegram is added to the current interval: per field in AGG_KEYS the min, max, sum and last value are updated,
+// which takes constant time and memory. Intervals are aligned to UTC (e.g. every full minute for 60s).
+// When a telegram falls in a new interval, the current one is closed; the values of the last closed interval
+// are available (e.g. in templates as %<P, %>P, %~P, %+L and %#, see tmpl.h) until the next one closes.
+#define AGG_KEYS  "PpAaBbCcLHlhG"  // keys (see tele_fields[]) of the fields to aggregate
+
+
+enum Agg_Fn {
+  AGG_FN_MIN   = '<', // smallest value
+  AGG_FN_MAX   = '>', // largest value
+  AGG_FN_MEAN  = '~', // average value
+  AGG_FN_INC   = '+', // increase, i.e. last value minus the last value of the previous interval (e.g. kWh consumed)
+  AGG_FN_COUNT = '#', // number of telegrams (no field)
+};
+
+
+// Returns the mask of the fields the aggregation needs (the time), see tele_fields_mask().
+// The fields in AGG_KEYS are only extracted when selected otherwise (e.g. by tmpl_fields()); else they aggregate as 0.
+uint32_t agg_fields();
+
+
+// Initialize this module, with intervals of `period` seconds (UTC)
+void agg_init(uint32_t period);
+
+
+// Adds the telegram in `snap` to the current interval (and closes that first if `snap` is in a later interval)
+void agg_add(const Tele_Snapshot * snap);
+
+
+// Returns true if `fn` is an aggregate function (one of Agg_Fn)
+bool agg_isfn(char fn);
+
+
+// Returns true if field `key` is aggregated (in AGG_KEYS)
+bool agg_haskey(char key);
+
+
+// Gets aggregate `fn` of field `key` (ignored for AGG_FN_COUNT) over the last closed interval, in the units of the field.
+// Returns false if there is no closed interval yet, or `key` is not in AGG_KEYS.
+bool agg_value(char fn, char key, int32_t * value);
+
+
+// Returns the start time (seconds since 2000, see TELE_TYPE_TIME) of the last closed interval, -1 if none
+int32_t agg_start();
+
+
+#endif
@@ -0,0 +1,213 @@
+// arch.cpp - Append-only archive of telegrams in flash (LittleFS)
+
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "arch.h"
+
+
+static bool          arch_enabled;
+static uint32_t      arch_mask;       // fields in ARCH_KEYS
+static uint32_t      arch_first;      // sequence number of the oldest segment
+static uint32_t      arch_last;       // sequence number of the current segment (arch_first..arch_last exist)
+static uint32_t      arch_seglen;     // bytes in the current segment, including those in the page
+static uint8_t       arch_page[ARCH_PAGE_SIZE];
+static int           arch_pagelen;    // bytes in arch_page
+static uint32_t      arch_pagetime;   // millis() of the first frame in arch_page
+static int32_t       arch_time;       // time of the last archived frame
+static Telebin_State arch_enc;        // encoder state (reset at the start of each segment)
+static Arch_Stats    arch_st;
+
+
+// === SEGMENTS =================================================================================
+
+
+static void arch_path(char * path, uint32_t seg) {
+  sprintf(path, ARCH_DIR "/%08x", (unsigned)seg);
+}
+
+
+// Appends the page to the current segment
+static void arch_write_page() {
+  if( arch_pagelen==0 ) return;
+  char path[24];
+  arch_path(path, arch_last);
+  File f = LittleFS.open(path, "a");
+  if( !f || f.write(arch_page, arch_pagelen)!=(size_t)arch_pagelen ) {
+    Serial.printf("arch: write %s failed\n", path);
+    arch_st.errors++;
+  } else {
+    arch_st.writes++;
+    arch_st.written += arch_pagelen;
+  }
+  if( f ) f.close();
+  arch_pagelen = 0;
+}
+
+
+// Starts a new segment (its first frame will be a key frame), deletes the oldest one when there are too many
+static void arch_new_segment() {
+  arch_write_page();
+  arch_last++;
+  arch_seglen = 0;
+  telebin_reset(&arch_enc);
+  arch_st.segments++;
+  while( arch_last-arch_first+1 > ARCH_MAXSEGMENTS ) {
+    char path[24];
+    arch_path(path, arch_first);
+    if( !LittleFS.remove(path) ) arch_st.errors++;
+    arch_first++;
+    arch_st.deleted++;
+  }
+}
+
+
+// === API ======================================================================================
+
+
+uint32_t arch_fields() {
+  uint32_t fields = tele_fields_mask(ARCH_KEYS);
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_type(i)==TELE_TYPE_TIME ) fields |= 1UL<<i;
+  return fields;
+}
+
+
+bool arch_init() {
+  arch_enabled = false;
+  arch_mask = tele_fields_mask(ARCH_KEYS);
+  if( !LittleFS.begin() ) { Serial.printf("arch: no file system (archive disabled)\n"); return false; }
+  if( !LittleFS.exists(ARCH_DIR) ) LittleFS.mkdir(ARCH_DIR);
+  // Find the oldest and newest segment
+  bool any = false;
+  arch_first = 0;
+  arch_last = 0;
+  Dir dir = LittleFS.openDir(ARCH_DIR);
+  while( dir.next() ) {
+    uint32_t seg = strtoul(dir.fileName().c_str(), NULL, 16);
+    if( !any || seg<arch_first ) arch_first = seg;
+    if( !any || seg>arch_last ) arch_last = seg;
+    any = true;
+  }
+  if( !any ) arch_first = 1; // the first segment will be 1
+  // Continue in a new segment (the encoder state of the last one is lost)
+  arch_pagelen = 0;
+  arch_time = 0;
+  arch_new_segment();
+  arch_enabled = true;
+  Serial.printf("arch: init (%d segments, %u bytes)\n", arch_segments(), (unsigned)arch_size());
+  return true;
+}
+
+
+void arch_add(const Tele_Snapshot * snap) {
+  if( !arch_enabled || tele_snapshot_seq(snap)==0 ) return;
+  int32_t time = 0;
+  int32_t values[TELE_NUMFIELDS];
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    if( tele_field_type(i)==TELE_TYPE_TIME ) time = tele_snapshot_num(snap,i);
+    values[i] = (arch_mask>>i)&1 ? tele_snapshot_num(snap,i) : 0;
+  }
+  // Time for a new frame? (a clock going back also gives one)
+  if( arch_enc.valid && time-arch_time < ARCH_PERIOD && time>=arch_time ) {
+    if( arch_pagelen>0 && millis()-arch_pagetime>=ARCH_FLUSH_MS ) arch_write_page();
+    return;
+  }
+  // Encode aside, so the page is filled up by actual (not worst case) frame sizes
+  uint8_t frame[TELEBIN_FRAME_SIZE];
+  size_t len = telebin_encode(&arch_enc, tele_schema(), time, values, TELE_NUMFIELDS, frame, sizeof frame);
+  if( len>0 && arch_seglen+len > ARCH_SEGMENT_SIZE ) {
+    // Does not fit in the segment: start the next one, with a key frame
+    arch_new_segment();
+    len = telebin_encode(&arch_enc, tele_schema(), time, values, TELE_NUMFIELDS, frame, sizeof frame);
+  }
+  if( len==0 ) { arch_st.errors++; return; }
+  if( arch_pagelen+len > ARCH_PAGE_SIZE ) arch_write_page();
+  if( arch_pagelen==0 ) arch_pagetime = millis();
+  memcpy(arch_page+arch_pagelen, frame, len);
+  arch_pagelen += len;
+  arch_seglen += len;
+  arch_time = time;
+  arch_st.frames++;
+  arch_st.bytes += len;
+  if( millis()-arch_pagetime>=ARCH_FLUSH_MS ) arch_write_page();
+}
+
+
+void arch_flush() {
+  if( arch_enabled ) arch_write_page();
+}
+
+
+const Arch_Stats * arch_stats() {
+  return &arch_st;
+}
+
+
+int arch_segments() {
+  return arch_enabled ? arch_last-arch_first+1 : 0;
+}
+
+
+uint32_t arch_size() {
+  uint32_t size = 0;
+  if( !arch_enabled ) return 0;
+  Dir dir = LittleFS.openDir(ARCH_DIR);
+  while( dir.next() ) size += dir.fileSize();
+  return size;
+}
+
+
+// === CURSOR ===================================================================================
+
+
+// Moves `cur` to the start of segment `seg`
+static void arch_cursor_seek(Arch_Cursor * cur, uint32_t seg) {
+  cur->seg = seg;
+  cur->pos = 0;
+  cur->len = 0;
+  cur->next = 0;
+  telebin_reset(&cur->st);
+}
+
+
+// Reads the segment from the next frame on into `buf`; returns false when there is nothing more in the segment
+static bool arch_cursor_fill(Arch_Cursor * cur) {
+  cur->pos += cur->next;
+  cur->len = 0;
+  cur->next = 0;
+  char path[24];
+  arch_path(path, cur->seg);
+  File f = LittleFS.open(path, "r");
+  if( !f ) return false;
+  if( f.seek(cur->pos) ) cur->len = f.read(cur->buf, ARCH_PAGE_SIZE);
+  f.close();
+  return cur->len>0;
+}
+
+
+void arch_cursor_begin(Arch_Cursor * cur) {
+  arch_cursor_seek(cur, arch_first);
+}
+
+
+bool arch_read(Arch_Cursor * cur, int32_t * time, int32_t * values) {
+  if( !arch_enabled ) return false;
+  if( cur->seg<arch_first ) arch_cursor_seek(cur, arch_first); // segment deleted meanwhile
+  while( cur->seg<=arch_last ) {
+    uint16_t schema;
+    size_t len = telebin_decode(&cur->st, cur->buf+cur->next, cur->len-cur->next, &schema, time, values, TELE_NUMFIELDS);
+    if( len==0 && cur->len-cur->next<TELEBIN_FRAME_SIZE && arch_cursor_fill(cur) ) {
+      // The frame may have been cut off by the end of buf, try again after reading on
+      len = telebin_decode(&cur->st, cur->buf, cur->len, &schema, time, values, TELE_NUMFIELDS);
+    }
+    if( len>0 ) {
+      cur->next += len;
+      if( schema==tele_schema() ) return true;
+      continue; // written by a firmware with another field table
+    }
+    // End of segment (or a corrupt frame, e.g. cut off by a power loss): on to the next one
+    if( cur->seg==arch_last ) return false; // the current segment may still grow
+    arch_cursor_seek(cur, cur->seg+1);
+  }
+  return false;
+}
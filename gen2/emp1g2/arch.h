@@ -0,0 +1,82 @@
+// arch.h - Interface to an append-only archive of telegrams in flash (LittleFS)
+#ifndef _ARCH_H_
+#define _ARCH_H_
+
+
+#include <stdint.h>
+#include "tele.h"
+#include "telebin.h"
+
+
+// The archive stores, every ARCH_PERIOD seconds, the fields with the keys in ARCH_KEYS as a telebin frame (see telebin.h).
+// Frames are collected in a RAM page, which is appended to the current segment file when full (or ARCH_FLUSH_MS old),
+// so flash is written in pages, not per telegram. Each segment starts with a key frame, so segments decode on their own.
+// When the archive has ARCH_MAXSEGMENTS segments, the oldest is deleted; files are only appended and deleted, never
+// rewritten, which lets LittleFS spread the wear over the flash.
+// A power loss loses (at most) the frames in the RAM page; a partly written frame ends its segment (CRC mismatch).
+// With ARCH_PERIOD 60, a frame is typically 15-25 bytes, so 32 segments of 16 kbyte hold some two weeks.
+#define ARCH_KEYS         "LHlhPpFfG" // keys (see tele_fields[]) of the fields to store (the time is always stored)
+#define ARCH_PERIOD          60       // seconds (UTC) between stored frames
+#define ARCH_PAGE_SIZE      256       // bytes collected in RAM before they are written to flash
+#define ARCH_FLUSH_MS    900000       // ms after which a non-empty page is written anyway
+#define ARCH_SEGMENT_SIZE 16384       // bytes per segment file
+#define ARCH_MAXSEGMENTS     32       // number of segment files kept
+#define ARCH_DIR         "/arch"      // directory of the segment files (named by their sequence number)
+
+
+// Statistics since boot
+struct Arch_Stats {
+  uint32_t frames;    // frames archived
+  uint32_t bytes;     // bytes of those frames
+  uint32_t writes;    // pages written to flash
+  uint32_t written;   // bytes written to flash (payload, excluding file system overhead)
+  uint32_t segments;  // segments started
+  uint32_t deleted;   // segments deleted (retention)
+  uint32_t errors;    // failed flash operations
+};
+
+
+// A cursor reads the archive sequentially, oldest frame first.
+// When the segment it reads is deleted meanwhile, it continues with the oldest remaining one.
+struct Arch_Cursor {
+  uint32_t      seg;                   // sequence number of the segment being read
+  uint32_t      pos;                   // file offset of buf[0]
+  uint8_t       buf[ARCH_PAGE_SIZE];   // part of the segment read
+  int           len;                   // bytes in buf
+  int           next;                  // offset in buf of the next frame
+  Telebin_State st;                    // decoder state
+};
+
+
+// Returns the mask of the fields the archive needs (see tele_init()).
+uint32_t arch_fields();
+
+
+// Mounts the file system and finds the existing segments; returns false (and the archive stays disabled) on failure.
+bool     arch_init();
+
+
+// Archives the telegram in `snap` (if ARCH_PERIOD has passed since the last frame), and writes the page when full or old.
+void     arch_add(const Tele_Snapshot * snap);
+
+
+// Writes the collected frames (if any) to flash now, e.g. before reading the archive.
+void     arch_flush();
+
+
+// Statistics since boot, and the number of segments and bytes in flash.
+const Arch_Stats * arch_stats();
+int      arch_segments();
+uint32_t arch_size();
+
+
+// Positions `cur` at the oldest frame.
+void     arch_cursor_begin(Arch_Cursor * cur);
+
+
+// Reads the next frame at `cur` into `*time` (seconds since 2000-01-01) and the TELE_NUMFIELDS `values`
+// (fields not in ARCH_KEYS are 0). Returns false when there are no more frames (only frames written to flash are seen).
+bool     arch_read(Arch_Cursor * cur, int32_t * time, int32_t * values);
+
+
+#endif
@@ -0,0 +1,79 @@
+// band.cpp - Change detection with dead-bands (publish only on a meaningful change, or a heartbeat)
+
+
+#include <Arduino.h>
+#include "band.h"
+#include "agg.h"
+
+
+bool band_init(Band * band, const Tmpl * tmpl, const char * spec, uint32_t heartbeat) {
+  band->num = 0;
+  band->valid = false;
+  band->time = 0;
+  band->heartbeat = heartbeat;
+  band->suppressed = 0;
+  // The numeric values (each once), e.g. %P and %~P are two values, %P and %.P one
+  for( int i=0; i<tmpl->num && band->num<BAND_MAXFIELDS; i++ ) {
+    const Tmpl_Op * op = &tmpl->ops[i];
+    if( op->lit!=NULL ) continue;
+    if( !op->fn && (tele_field_type(op->ix)==TELE_TYPE_STRING || tele_field_type(op->ix)==TELE_TYPE_TIME) ) continue;
+    bool dup = false;
+    for( int b=0; b<band->num; b++ ) if( band->ix[b]==op->ix && band->fn[b]==op->fn ) dup = true;
+    if( dup ) continue;
+    band->ix[band->num] = op->ix;
+    band->fn[band->num] = op->fn;
+    band->width[band->num] = 0;
+    band->num++;
+  }
+  // Parse the dead-bands, e.g. "P20,p20"
+  bool ok = true;
+  const char * r = spec;
+  while( *r!='\0' ) {
+    char key = *r++;
+    char * end;
+    long width = strtol(r, &end, 10);
+    if( end==r || width<0 ) { ok = false; break; }
+    r = end;
+    bool found = false;
+    for( int b=0; b<band->num; b++ ) if( band->ix[b]>=0 && tele_field_key(band->ix[b])==key ) { band->width[b] = width; found = true; }
+    if( !found ) Serial.printf("band: %c not used (dead-band ignored)\n", key);
+    while( *r==',' || *r==' ' ) r++;
+  }
+  if( !ok ) Serial.printf("band: syntax error in '%s'\n", spec);
+  return ok;
+}
+
+
+// Returns value `b` of `band` for the telegram in `snap` (an aggregate is 0 while there is no closed interval)
+static int32_t band_value(const Band * band, int b, const Tele_Snapshot * snap) {
+  if( !band->fn[b] ) return tele_snapshot_num(snap, band->ix[b]);
+  int32_t val = 0;
+  agg_value(band->fn[b], band->ix[b]<0 ? '\0' : tele_field_key(band->ix[b]), &val);
+  return val;
+}
+
+
+bool band_due(Band * band, const Tele_Snapshot * snap) {
+  if( !band->valid ) return true;
+  if( band->heartbeat>0 && millis()-band->time>=band->heartbeat ) return true;
+  for( int b=0; b<band->num; b++ ) {
+    // Modulo 2^32, so that the difference can not overflow
+    uint32_t delta = (uint32_t)band_value(band,b,snap) - (uint32_t)band->last[b];
+    uint32_t dist = (int32_t)delta<0 ? -delta : delta;
+    if( dist>(uint32_t)band->width[b] ) return true;
+  }
+  band->suppressed++;
+  return false;
+}
+
+
+void band_submit(Band * band, const Tele_Snapshot * snap) {
+  for( int b=0; b<band->num; b++ ) band->pending[b] = band_value(band, b, snap);
+}
+
+
+void band_publish(Band * band) {
+  memcpy(band->last, band->pending, band->num*sizeof(int32_t));
+  band->valid = true;
+  band->time = millis();
+}
@@ -0,0 +1,54 @@
+// band.h - Interface to change detection with dead-bands (publish only on a meaningful change, or a heartbeat)
+#ifndef _BAND_H_
+#define _BAND_H_
+
+
+#include <stdint.h>
+#include "tele.h"
+#include "tmpl.h"
+
+
+// A band compares the numeric values a template renders between a new telegram and the last published one:
+// field values, and aggregates (e.g. %~P, see agg.h) as they are, so a GET with the mean power is due when the mean changed.
+// A value has changed when it moved more than its dead-band (0, i.e. any change, unless configured).
+// band_due() is true when a value changed, when nothing was published for `heartbeat` ms, or when nothing was published yet.
+// The values are recorded with band_submit() when the request is made, and become the published ones with band_publish()
+// when the server accepted it; so after a failed request the next one is due as soon as the values still differ.
+// The dead-bands are given as a string, key followed by the width in the units of the field's integer
+// (milli units for kW, kWh and m3), separated by commas, e.g. "P20,p20" for 20 W on the power (also for %~P, %<P, ..).
+
+
+#define BAND_MAXFIELDS 16
+
+
+struct Band {
+  int      num;                     // number of fields
+  int8_t   ix[BAND_MAXFIELDS];      // index in tele_fields[] (-1 for the count)
+  char     fn[BAND_MAXFIELDS];      // aggregate function (see Agg_Fn), 0 for the value of the telegram
+  int32_t  width[BAND_MAXFIELDS];   // dead-band
+  int32_t  last[BAND_MAXFIELDS];    // published value
+  int32_t  pending[BAND_MAXFIELDS]; // submitted value (published when the request succeeds)
+  bool     valid;                   // something was published
+  uint32_t time;                    // millis() of the last publish
+  uint32_t heartbeat;               // ms after which a publish is due anyway (0 for never)
+  uint32_t suppressed;              // number of times band_due() returned false
+};
+
+
+// Initializes `band` for the numeric values rendered by `tmpl`, with the dead-bands in `spec`; returns false if `spec` has errors.
+bool band_init(Band * band, const Tmpl * tmpl, const char * spec, uint32_t heartbeat);
+
+
+// Returns true when the telegram in `snap` should be published (changed beyond a dead-band, heartbeat, or first).
+bool band_due(Band * band, const Tele_Snapshot * snap);
+
+
+// Records the values of the telegram in `snap` as submitted (see band_publish()).
+void band_submit(Band * band, const Tele_Snapshot * snap);
+
+
+// Makes the submitted values the published ones; call this when the request succeeded.
+void band_publish(Band * band);
+
+
+#endif
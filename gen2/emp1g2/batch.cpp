@@ -0,0 +1,99 @@
+// batch.cpp - Batching of telegrams into one upload (ThingSpeak bulk-update JSON)
+
+
+#include <Arduino.h>
+#include "batch.h"
+
+
+void batch_init(Batch * batch) {
+  batch->len = 0;
+  batch->count = 0;
+  batch->first = 0;
+  batch->last = 0;
+  batch->dropped = 0;
+}
+
+
+// Writes the head of the entry for a telegram at `time` to `head` (of 24 bytes), returns its length
+static int batch_head(const Batch * batch, char * head, uint32_t time) {
+  // Seconds since previous entry (also over a clear; the first ever entry gets 0)
+  uint32_t delta = batch->last==0 ? 0 : (time-batch->last+500)/1000;
+  return snprintf(head, 24, "%s{\"delta_t\":%u,", batch->count>0?",":"", (unsigned)delta);
+}
+
+
+// Returns true when the entry for the last telegram, at `time` and rendered with `line`, fits in `batch`
+static bool batch_fits(const Batch * batch, const Tmpl * line, uint32_t time) {
+  char head[24];
+  // The exact length of the line is known up front
+  return batch->len + batch_head(batch,head,time) + tmpl_length(line) + 1 < BATCH_BUF_SIZE;
+}
+
+
+bool batch_add(Batch * batch, const Tmpl * line, uint32_t time) {
+  if( !batch_fits(batch,line,time) ) return false;
+  char head[24];
+  int headlen = batch_head(batch, head, time);
+  char * w = batch->buf+batch->len;
+  memcpy(w, head, headlen); 
+  w += headlen;
+  w += tmpl_render(line, w, BATCH_BUF_SIZE-(w-batch->buf));
+  *w++ = '}';
+  *w = '\0';
+  batch->len = w-batch->buf;
+  if( batch->count==0 ) batch->first = time;
+  batch->last = time;
+  batch->count++;
+  return true;
+}
+
+
+int batch_room(const Batch * batch) {
+  return BATCH_BUF_SIZE-1-batch->len;
+}
+
+
+uint32_t batch_age(const Batch * batch) {
+  return batch->count>0 ? millis()-batch->first : 0;
+}
+
+
+void batch_clear(Batch * batch) {
+  batch->len = 0;
+  batch->count = 0;
+  batch->buf[0] = '\0';
+}
+
+
+bool batch_collect(Batch * batch, const Tmpl * line, uint32_t time, int count, uint32_t age, Batch_Flush flush, void * ctx) {
+  // Make room first, so that the telegram is not lost
+  if( batch->count>0 && !batch_fits(batch,line,time) && flush(batch,ctx) ) batch_clear(batch);
+  bool added = batch_add(batch, line, time);
+  if( !added ) batch->dropped++;
+  if( batch->count==0 ) return added;
+  bool full = batch->count>=count || batch_room(batch)<batch->len/batch->count;
+  if( (full || batch_age(batch)>=age) && flush(batch,ctx) ) batch_clear(batch);
+  return added;
+}
+
+
+int batch_request(const Batch * batch, char * req, int size, const char * url, const char * host, const char * key) {
+  // Header, JSON wrapper and the entries
+  char head[80];
+  int headlen = snprintf(head, sizeof head, "{\"write_api_key\":\"%s\",\"updates\":[", key);
+  int bodylen = headlen + batch->len + 2;
+  int len = snprintf(req, size,
+    "POST %s HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: %d\r\n"
+    "\r\n"
+    "%s", url, host, bodylen, head);
+  if( len+bodylen-headlen>=size ) return 0;
+  memcpy(req+len, batch->buf, batch->len);
+  len+= batch->len;
+  memcpy(req+len, "]}", 2);
+  len+= 2;
+  return len;
+}
@@ -0,0 +1,66 @@
+// batch.h - Interface to batching of telegrams into one upload (ThingSpeak bulk-update JSON)
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+
+#include <stdint.h>
+#include "tmpl.h"
+
+
+// A batch collects telegrams, each rendered with a line template (see tmpl.h), e.g. "field1":%L,"field5":%P
+// Each becomes an entry {"delta_t":s,<line>}, where s is the number of seconds since the previous entry.
+// The entries are joined with commas, ready to be wrapped in {"write_api_key":"...","updates":[...]} by batch_request().
+// batch_collect() adds a telegram and decides when to flush (on count, age or a full buffer); the caller sends the data.
+
+
+#define BATCH_BUF_SIZE 2048 // size of the entry buffer
+
+
+struct Batch {
+  char     buf[BATCH_BUF_SIZE]; // the entries
+  int      len;     // bytes in buf
+  int      count;   // number of entries in buf
+  uint32_t first;   // millis() of the first entry
+  uint32_t last;    // millis() of the last entry (for delta_t)
+  uint32_t dropped; // telegrams that did not fit (even in an empty batch), or were dropped by a flush
+};
+
+
+// Called by batch_collect() to send the entries of `batch`; returns false when it could not (e.g. the server is busy).
+// On true the batch is cleared, otherwise the entries are kept and the flush is retried with the next telegram.
+typedef bool (*Batch_Flush)(Batch * batch, void * ctx);
+
+
+// Initialize (clear) `batch`
+void batch_init(Batch * batch);
+
+
+// Appends the last telegram (received at millis() `time`) rendered with `line`; returns false when there is no room.
+bool batch_add(Batch * batch, const Tmpl * line, uint32_t time);
+
+
+// Returns the number of bytes in the batch still free
+int  batch_room(const Batch * batch);
+
+
+// Returns the age (in ms) of the oldest entry in the batch (0 if the batch is empty)
+uint32_t batch_age(const Batch * batch);
+
+
+// Removes all entries, keeps the time of the last one (for the next delta_t)
+void batch_clear(Batch * batch);
+
+
+// Adds the last telegram (received at millis() `time`) rendered with `line`, flushing with `flush` (and `ctx`) when needed:
+// first when the telegram does not fit, and after it when the batch has `count` entries, no room for an average entry,
+// or is `age` ms old. An empty batch is never flushed; a telegram that does not fit (after the flush) is counted in `dropped`.
+// Returns true when the telegram was added.
+bool batch_collect(Batch * batch, const Tmpl * line, uint32_t time, int count, uint32_t age, Batch_Flush flush, void * ctx);
+
+
+// Writes the POST of the entries to `url` on `host` as one ThingSpeak bulk-update with `key` into `req` (of `size`).
+// Returns the length of the request, or 0 when it does not fit.
+int  batch_request(const Batch * batch, char * req, int size, const char * url, const char * host, const char * key);
+
+
+#endif
@@ -0,0 +1,61 @@
+// coop.cpp - Cooperative scheduler with deadlines (for loop())
+
+
+#include <Arduino.h>
+#include "coop.h"
+
+
+static Coop_Task coop_tasks[COOP_MAXTASKS];
+static int       coop_num;
+
+
+bool coop_add(const char * name, Coop_Fn fn, uint32_t period) {
+  if( coop_num==COOP_MAXTASKS ) { Serial.printf("coop: no room for task %s\n", name); return false; }
+  Coop_Task * task = &coop_tasks[coop_num++];
+  memset(task, 0, sizeof *task);
+  task->name = name;
+  task->fn = fn;
+  task->period = period;
+  task->due = millis();
+  Serial.printf("coop: task %s (%ums)\n", name, (unsigned)period);
+  return true;
+}
+
+
+bool coop_run() {
+  // Find the due task with the oldest deadline (on equal deadlines, the one added first)
+  uint32_t now = millis();
+  Coop_Task * task = NULL;
+  for( int i=0; i<coop_num; i++ ) {
+    Coop_Task * t = &coop_tasks[i];
+    if( (int32_t)(now-t->due)<0 ) continue;
+    if( task==NULL || (int32_t)(t->due-task->due)<0 ) task = t;
+  }
+  if( task==NULL ) return false;
+  // Run it, and measure
+  uint32_t late = now - task->due;
+  if( late>task->late_max ) task->late_max = late;
+  task->due = now + task->period;
+  uint32_t start = micros();
+  task->fn();
+  uint32_t us = micros() - start;
+  task->runs++;
+  task->us_sum += us;
+  if( us>task->us_max ) task->us_max = us;
+  return true;
+}
+
+
+void coop_wake(Coop_Fn fn) {
+  for( int i=0; i<coop_num; i++ ) if( coop_tasks[i].fn==fn ) coop_tasks[i].due = millis();
+}
+
+
+int coop_count() {
+  return coop_num;
+}
+
+
+const Coop_Task * coop_task(int ix) {
+  return &coop_tasks[ix];
+}
@@ -0,0 +1,51 @@
+// coop.h - Interface to a cooperative scheduler with deadlines (for loop())
+#ifndef _COOP_H_
+#define _COOP_H_
+
+
+#include <stdint.h>
+
+
+// Tasks are plain functions that do a small step of work and return; they never call delay().
+// Each task has a period: it is due `period` ms after it last started (period 0 means every pass).
+// coop_run(), called from loop(), runs the due task with the oldest deadline, so a task is never late
+// by more than the longest run time of the other tasks. Run times and lateness are measured per task.
+
+
+#define COOP_MAXTASKS 8
+
+
+typedef void (*Coop_Fn)();
+
+
+struct Coop_Task {
+  const char * name;
+  Coop_Fn     fn;
+  uint32_t     period;  // ms between starts
+  uint32_t     due;     // millis() when the task is due
+  // Statistics
+  uint32_t     runs;    // number of runs
+  uint32_t     us_max;  // longest run time (us)
+  uint64_t     us_sum;  // total run time (us)
+  uint32_t     late_max;// largest lateness (ms after `due` that the task started)
+};
+
+
+// Adds task `fn` (named `name`, for logging and metrics) with `period` ms; returns false when there is no room.
+bool  coop_add(const char * name, Coop_Fn fn, uint32_t period);
+
+
+// Runs (at most) one due task, the one with the oldest deadline; returns false when no task was due.
+bool  coop_run();
+
+
+// Makes task `fn` due now (e.g. the reporting task when a telegram arrived).
+void  coop_wake(Coop_Fn fn);
+
+
+// Access to the tasks (for statistics), 0 <= ix < coop_count().
+int   coop_count();
+const Coop_Task * coop_task(int ix);
+
+
+#endif
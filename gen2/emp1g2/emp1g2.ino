@@ -8,6 +8,18 @@
 #include <Nvm.h>
 #include <Cfg.h>
 #include "tele.h"
+#include "hist.h"
+#include "arch.h"
+#include "agg.h"
+#include "band.h"
+#include "sink.h"
+#include "tmpl.h"
+#include "batch.h"
+#include "mqtt.h"
+#include "metrics.h"
+#include "coop.h"
+#include "ring.h"
+#include <ESP8266WebServer.h>
 
 
 // === Wiring ===================================================================================
@@ -50,10 +62,22 @@ void led_off() {
   digitalWrite(LED_BLUEPIN, HIGH);
 }
 
+// A flash is switched off by led_poll() (a task), so nobody waits for it
+#define LED_FLASH_MS   50
+bool     led_flashing;
+uint32_t led_flashtime;
+
 void led_flash() {
   led_on();
-  delay(50);
-  led_off();
+  led_flashing = true;
+  led_flashtime = millis();
+}
+
+void led_poll() {
+  if( led_flashing && millis()-led_flashtime>=LED_FLASH_MS ) {
+    led_off();
+    led_flashing = false;
+  }
 }
 
 void led_init() { 
@@ -76,13 +100,32 @@ NvmField CfgEmp1Fields[] = {
   {"postserver"      , "api.thingspeak.com"                                , 32, "The name of the server to which measurements are send via POST (empty for none)."},
   {"posturl"         , "/update"                                           , 32, "The URL for the POST server."},
   {"postbody1"       , "field1=%L&field2=%H&field3=%l&field4=%h&field5=%P&", 64, "Body part 1 HELP: %L=Cons-Night1-kWh, %H=Cons-Day2-kWh, %l=Prod-Night1-kWh, %h=Prod-Day2-kWh, %I=Night1-Day2, %P=Cons-kW, %p=Prod-kW, %F=Fails-short-#, %f=Fails-long-#."},
-  {"postbody2"       , "field6=%p&field7=%F&field8=%E&key=MyWriteKeyXXXXXX", 64, "Body part 2 HELP: %A=Cons-L1-kW, %a=Prod-L1-kW, %B=Cons-L2-kW, %b=Prod-L2-kW, %C=Cons-L3-kW, %c=Prod-L3-kW, %G=Cons-Gas-m3, %%=%, add . to skip dot (%.P)."},
+  {"postbody2"       , "field6=%p&field7=%F&field8=%E&key=MyWriteKeyXXXXXX", 64, "Body part 2 HELP: %A=Cons-L1-kW, %a=Prod-L1-kW, %B=Cons-L2-kW, %b=Prod-L2-kW, %C=Cons-L3-kW, %c=Prod-L3-kW, %G=Cons-Gas-m3, %T=Time, %%=%, add . to skip dot (%.P)."},
   {"postperiod"      , "60000"                                             ,  8, "The number of milliseconds between post's. "},
+  {"aggperiod"       , "60"                                                ,  8, "The number of seconds (UTC) over which telegrams are aggregated [HELP: %<P min, %>P max, %~P mean, %+L increase, %# count; for P, p, A, a, B, b, C, c, L, H, l, h, G]. "},
 
   {"Server 2 (get)"  , ""                                                  ,  0, "The eMP1 may publish data using the 'GET' protocol. Supply the server and URL, or leave blank. " },
   {"getserver"       , "nwebmsg.fritz.box"  /* "192.168.179.74" */         , 32, "The name of the server to which measurements are send via GET (empty for none)."},
   {"geturl"          , "/?msg=%.P&mode=right"                               , 32, "The URL for the GET server [HELP: use % as in postbody]."},
   {"getperiod"       , "1000"                                              ,  8, "The number of milliseconds between get's. "},
+  {"getband"         , "P20"                                               , 32, "The dead-bands: a get is only send when a field in geturl changed more, e.g. P20,p20 for 20 W [HELP: key and width in milli units (W, Wh, dm3), other fields: any change]. "},
+  {"getheartbeat"    , "60000"                                             ,  8, "The number of milliseconds after which a get is send, even if nothing changed (0 for never). "},
+
+  {"Server 3 (batch)", ""                                                  ,  0, "The eMP1 may collect every telegram and publish them in batches, using the ThingSpeak bulk-update JSON format. Supply the server, URL, key and line, or leave blank. " },
+  {"batchserver"     , ""                                                  , 32, "The name of the server to which batches are send via POST (empty for none), e.g. api.thingspeak.com."},
+  {"batchurl"        , "/channels/0000000/bulk_update.json"                , 48, "The URL for the batch server (fill in the channel id)."},
+  {"batchkey"        , "MyWriteKeyXXXXXX"                                  , 32, "The write api key for the batch server."},
+  {"batchline"       , "\"field1\":%L,\"field2\":%H,\"field5\":%P,\"field6\":%p"  , 64, "The fields of one telegram in the batch [HELP: use % as in postbody]."},
+  {"batchsize"       , "20"                                                ,  4, "The number of telegrams that triggers a batch post (a full buffer also does). "},
+  {"batchage"        , "60000"                                             ,  8, "The number of milliseconds after which a batch is posted, even if not full. "},
+
+  {"Server 4 (mqtt)" , ""                                                  ,  0, "The eMP1 may publish every telegram to an MQTT broker: each field on its own topic, and all as JSON on topic telegram. Supply the broker, or leave blank. " },
+  {"mqttserver"      , ""                                                  , 32, "The name of the MQTT broker (empty for none), e.g. mqtt.fritz.box."},
+  {"mqttport"        , "1883"                                              ,  6, "The port of the MQTT broker."},
+  {"mqttuser"        , ""                                                  , 32, "The user name for the MQTT broker (empty for none)."},
+  {"mqttpassword"    , ""                                                  , 32, "The password for the MQTT broker (empty for none)."},
+  {"mqtttopic"       , "emp1"                                              , 32, "The topic prefix, fields go to e.g. emp1/Cons-kW and the JSON to emp1/telegram."},
+  {"mqttfields"      , "PpLHlhG"                                           , 24, "The keys of the fields that are published [HELP: keys as in postbody, e.g. PpLHlhG]. "},
 
   {0                 , 0                                                   ,  0, 0},  
 };
@@ -91,34 +134,83 @@ Cfg cfg( APP_NAME, CfgEmp1Fields, CFG_SERIALLVL_USR, LED_BLUEPIN);
 
 // === UART ============================================================================================
 // Magic trick: the ESP8266 support RX invertion
+// The UART has a 128 byte RX FIFO. Our own RX interrupt (it replaces the one of the core; the TX of Serial is polled,
+// so printing keeps working) moves the bytes from the FIFO into a lock-free ring (see ring.h), which the parse task
+// empties in bulk. The ring holds a complete telegram (about 1 kbyte, 2 with a long message), so it survives
+// a stall of the parse task. Its high-water mark and the overruns (bytes lost because the ring was full) are tracked.
+#define UART_RXBUF_SIZE 2048 // size of the RX ring, a power of two
+#define UART_FIFO_FULL   100 // the interrupt comes when the FIFO holds this many bytes,
+#define UART_FIFO_TOUT     2 // or when nothing came in for this many byte times (and the FIFO is not empty)
+
+
+char              uart_rxbuf[UART_RXBUF_SIZE];
+Ring              uart_ring;
+volatile uint32_t uart_rxerrors;      // number of times a framing or parity error was seen
+volatile uint32_t uart_fifooverflows; // number of times the FIFO overflowed (the interrupt was blocked too long)
+
+
+void IRAM_ATTR uart_isr(void * arg, void * frame) {
+  (void)arg; (void)frame;
+  uint32_t status = USIS(UART0);
+  char buf[128];
+  int len = 0;
+  while( ((USS(UART0)>>USRXC)&0xFF) && len<(int)sizeof buf ) buf[len++] = USF(UART0);
+  ring_put(&uart_ring, buf, len);
+  if( status & ((1<<UIFR)|(1<<UIPE)) ) uart_rxerrors++;
+  if( status & (1<<UIOF) ) uart_fifooverflows++;
+  USIC(UART0) = status;
+}
 
 
 void uart_init() {
+  ring_init(&uart_ring, uart_rxbuf, sizeof uart_rxbuf);
   // Invert RX (Dutch smart meter needs that)
   USC0(UART0) = USC0(UART0) | BIT(UCRXI);
   Serial.flush();
   delay(500); Serial.read(); // There is often one zero remaining, Serial.flush() does not help
+  // Take over the RX interrupt
+  ETS_UART_INTR_DISABLE();
+  ETS_UART_INTR_ATTACH(uart_isr, NULL);
+  USC1(UART0) = (USC1(UART0) & ~((0x7F<<UCFFT)|(0x7F<<UCTOT))) | (UART_FIFO_FULL<<UCFFT) | (UART_FIFO_TOUT<<UCTOT) | (1<<UCTOE);
+  USIC(UART0) = 0xFFFF;
+  USIE(UART0) = (1<<UIFF) | (1<<UITO) | (1<<UIOF) | (1<<UIFR) | (1<<UIPE);
+  ETS_UART_INTR_ENABLE();
   
-  Serial.printf("uart: init\n");
+  Serial.printf("uart: init (rx ring %u bytes)\n", (unsigned)sizeof uart_rxbuf);
+}
+
+
+// Reads what is available in the RX ring (at most size bytes) in one go, returns the number of bytes read (0 if none)
+int uart_read(char * buf, int size) {
+  static uint32_t overruns;
+  if( uart_ring.overruns!=overruns ) { overruns = uart_ring.overruns; Serial.printf("uart: overrun (bytes lost)\n"); }
+  return ring_get(&uart_ring, buf, size);
 }
 
 
 // === Wifi =================================================================================================
 
 
+// The connect is not waited for: wifi_poll() (a task) blinks the LED until connected, meanwhile telegrams are parsed
+bool wifi_connected;
+bool wifi_blink;
+
 void wifi_init() {
   WiFi.hostname( APP_NAME );  
   WiFi.mode(WIFI_STA);
-  Serial.printf("wifi: %s ..",cfg.getval("ssid"));
+  Serial.printf("wifi: %s ...\n",cfg.getval("ssid"));
   WiFi.begin(cfg.getval("ssid"), cfg.getval("password") );
-  while( WiFi.status()!=WL_CONNECTED ) {
-    led_on();
-    delay(250);
-    led_off();
-    delay(250);
-    Serial.printf(".");
+}
+
+void wifi_poll() {
+  bool connected = WiFi.status()==WL_CONNECTED;
+  if( connected && !wifi_connected ) Serial.printf("wifi: %s\n",WiFi.localIP().toString().c_str());
+  if( !connected && wifi_connected ) Serial.printf("wifi: lost\n");
+  wifi_connected = connected;
+  if( !connected ) {
+    wifi_blink = !wifi_blink;
+    if( wifi_blink ) led_on(); else led_off();
   }
-  Serial.printf(" %s\n",WiFi.localIP().toString().c_str());
 }
 
 
@@ -126,124 +218,495 @@ void wifi_init() {
 // === http =====================================================================================
 
 
-int http_strncpy(char *buf, int size, const char * nums, bool skipdot) {
-  const char *r=nums; // read pointer
-  char *w=buf;  // write pointer
-  // r points to a numeric string; strip leading 0s
-  while( *r=='0' && ( isdigit(*(r+1)) || (skipdot && *(r+1)=='.') ) ) r++; // must terminate e.g. on "0\0"
-  while( *r!='\0' && size>1 ) {
-    if( *r!='.' || !skipdot) { *w = *r; w++; size--; }
-    r++;
-  }
-  *w='\0'; w++; size--;
-  return w-buf-1;
-}
-
-
-// This is like sprintf; it prints `fmt` to `buf`, replacing "%x" thingies with values from the last telegram
-// The letters to be used after % are the ones registered as key in tele_fields[]
-int http_subst(char *buf, int size, const char * fmt ) {
-  const char *r=fmt; // read pointer
-  char *w=buf; // write pointer
-  while( *r!='\0' && size>1 ) {
-    if( *r=='%' ) {
-      // Skip escape character (%)
-      r++;
-      // Is there a * modifier
-      bool skipdot = *r=='.';
-      if( skipdot ) r++;
-      // Get the key
-      char key = *r++;
-      // Lookup value associatied with the key (if any)
-      const char * value = NULL;
-      for( int i=0; i<TELE_NUMFIELDS; i++ ) {
-        if( tele_field_key(i) == key ) { value=tele_field_value(i); break; }
-      }
-      //Serial.printf("star=%d key=%c val='%s'\n",star,key, value);
-      // Was the key found
-      if( value==NULL ) {
-        // key was not found, insert it
-        if( size>1 ) { *w='%'; w++; size--; }
-        if( size>1 && skipdot ) { *w='.'; w++; size--; }
-        if( size>1 && !skipdot && key!='%' ) { *w=key; w++; size--; }
-      } else {
-        // Found, insert value
-        int len=http_strncpy(w,size,value,skipdot); 
-        if( len>size-1) len=size-1;
-        w+=len; size-=len;
-      }
-    } else {
-      // Plain character; copy
-      *w=*r; w++; size--; r++; 
-    }
-  }
-  // Add terminating zero
-  *w='\0'; w++; size--;
-  // Return bytes written
-  return w-buf-1;
+// The templates for the requests are compiled once (see tmpl.h), and the cfg strings looked up once
+Tmpl         http_postbody1;
+Tmpl         http_postbody2;
+Tmpl         http_geturl;
+const char * http_postserver;
+const char * http_posturl;
+const char * http_getserver;
+Band         http_getband; // get only on a change beyond the dead-bands (or a heartbeat)
+
+
+// The post, get and batch requests each go to their own server, over a kept-alive connection (see sink.h)
+Sink http_postsink;
+Sink http_getsink;
+Sink http_batchsink;
+char http_postreq[512];
+char http_getreq[256];
+char http_batchreq[BATCH_BUF_SIZE+256]; // the entries plus the HTTP header and JSON wrapper
+
+
+// Telegrams collected for the batch server (see batch.h)
+Tmpl         http_batchline;
+Batch        http_batch;
+const char * http_batchserver;
+const char * http_batchurl;
+const char * http_batchkey;
+int          http_batchsize;
+uint32_t     http_batchage;
+
+
+// The dead-band compares against the values of the last GET the server accepted (see Sink_Done)
+void http_getdone(Sink * sink, bool ok, void * ctx) {
+  (void)sink; (void)ctx;
+  if( ok ) band_publish(&http_getband);
 }
 
 
-#define HTTP_BUF_SIZE 256
-char http_buf[HTTP_BUF_SIZE];
+void http_init() {
+  http_postserver = cfg.getval("postserver");
+  http_posturl    = cfg.getval("posturl");
+  http_getserver  = cfg.getval("getserver");
+  http_batchserver= cfg.getval("batchserver");
+  http_batchurl   = cfg.getval("batchurl");
+  http_batchkey   = cfg.getval("batchkey");
+  http_batchsize  = String(cfg.getval("batchsize")).toInt();
+  if( http_batchsize<1 ) http_batchsize = 1;
+  http_batchage   = String(cfg.getval("batchage")).toInt();
+  if( http_batchage<15000 ) http_batchage = 15000; // ThingSpeak allows one bulk-update per 15s
+  bool ok = tmpl_compile(&http_postbody1, cfg.getval("postbody1"));
+  ok = tmpl_compile(&http_postbody2, cfg.getval("postbody2")) && ok;
+  ok = tmpl_compile(&http_geturl, cfg.getval("geturl")) && ok;
+  ok = tmpl_compile(&http_batchline, cfg.getval("batchline")) && ok;
+  if( !ok ) Serial.printf("http: template too long (truncated)\n");
+  band_init(&http_getband, &http_geturl, cfg.getval("getband"), String(cfg.getval("getheartbeat")).toInt());
+  sink_init(&http_postsink , "post" , http_postserver , http_postreq , sizeof http_postreq );
+  sink_init(&http_getsink  , "get " , http_getserver  , http_getreq  , sizeof http_getreq  );
+  sink_init(&http_batchsink, "batch", http_batchserver, http_batchreq, sizeof http_batchreq);
+  http_getsink.done = http_getdone;
+  batch_init(&http_batch);
+  Serial.printf("http: init (%d+%d+%d+%d ops)\n", http_postbody1.num, http_postbody2.num, http_geturl.num, http_batchline.num);
+}
+
+
+// Returns the mask of the fields used by the templates
+uint32_t http_fields() {
+  uint32_t fields = tmpl_fields(&http_postbody1) | tmpl_fields(&http_postbody2) | tmpl_fields(&http_geturl);
+  if( *http_batchserver!='\0' ) fields |= tmpl_fields(&http_batchline);
+  return fields;
+}
 
 
 // curl -d "field1=101&field2=202&key=1234567890" -X POST http://api.thingspeak.com/update
 
 
-// Send a POST request
+// Submit a POST request (it is sent by sink_poll() in the background)
 void http_post() {
-  char * srv = cfg.getval("postserver");
-  if( *srv=='\0' ) { Serial.printf("emp1: post: no server\n"); return; }
+  if( *http_postserver=='\0' ) { Serial.printf("emp1: post: no server\n"); return; }
+  int size;
+  char * req = sink_request(&http_postsink, &size);
+  if( req==NULL ) { Serial.printf("emp1: post: busy (skipped)\n"); return; }
   
-  WiFiClient client;
-  if( client.connect(srv,80) ) {
-    // Create body with the fields
-    int len1= http_subst( http_buf, HTTP_BUF_SIZE, cfg.getval("postbody1") );
-    int len2= http_subst( http_buf+len1, HTTP_BUF_SIZE-len1, cfg.getval("postbody2") );
-    int len=len1+len2;
-    if( len+1==HTTP_BUF_SIZE ) Serial.printf("emp1: post: url truncated\r\n");
-    // Construct API request body
-    client.print("POST "); client.print(cfg.getval("posturl")); client.print(" HTTP/1.1\r\n");
-    client.print("Host: "); client.print(srv); client.print("\r\n");
-    client.print("Connection: close\r\n");
-    client.print("Content-Type: application/x-www-form-urlencoded\r\n");
-    client.print("Content-Length: "); client.print(len); client.print("\r\n");
-    client.print("\r\n");
-    client.print(http_buf); client.print("\r\n");
-    client.print("\r\n");
-    Serial.printf("emp1: post: %s\n", srv);
-    led_flash(); // signal successful POST
-  } else {
-    Serial.printf("emp1: post: cannot connect to %s\n", srv);
-  }
-  delay(1);
-  client.stop();
+  // Construct API request (header and body in one buffer, so it goes out in one write)
+  int bodylen = tmpl_length(&http_postbody1) + tmpl_length(&http_postbody2);
+  int len = snprintf(req, size,
+    "POST %s HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: %d\r\n"
+    "\r\n", http_posturl, http_postserver, bodylen);
+  if( len+bodylen>=size ) { Serial.printf("emp1: post: request too long (skipped)\n"); return; }
+  len+= tmpl_render(&http_postbody1, req+len, size-len);
+  len+= tmpl_render(&http_postbody2, req+len, size-len);
+  sink_submit(&http_postsink, len, tele_snapshot_time(tele_snapshot()));
+  Serial.printf("emp1: post: %s\n", http_postserver);
+  led_flash(); // signal POST submitted
 }
 
 
-// Send a GET request, returns true iff successful
+// Submit a GET request (it is sent by sink_poll() in the background)
 void http_get() {
-  char * srv = cfg.getval("getserver");
-  if( *srv=='\0' ) { Serial.printf("emp1: get : no server\n"); return; }
+  if( *http_getserver=='\0' ) { Serial.printf("emp1: get : no server\n"); return; }
+  int size;
+  char * req = sink_request(&http_getsink, &size);
+  if( req==NULL ) { Serial.printf("emp1: get : busy (skipped)\n"); return; }
   
-  WiFiClient client;
-  if( client.connect(srv,80) ) {
-    // Create body with the fields
-    int len= http_subst(http_buf,HTTP_BUF_SIZE,cfg.getval("geturl"));
-    if( len+1==HTTP_BUF_SIZE ) Serial.printf("emp1: get : url truncated\r\n");
-    // Construct API request body
-    client.print("GET "); client.print(http_buf); client.print(" HTTP/1.1\r\n");
-    client.print("Host: "); client.print(cfg.getval("getserver")); client.print("\r\n");
-    client.print("Connection: close\r\n");
-    client.print("\r\n");
-    Serial.printf("emp1: get : %s\n", srv);
-    led_flash(); // signal successful GET
+  // Construct API request
+  int len = snprintf(req, size, "GET ");
+  len+= tmpl_render(&http_geturl, req+len, size-len);
+  len+= snprintf(req+len, size-len,
+    " HTTP/1.1\r\n"
+    "Host: %s\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n", http_getserver);
+  if( len>=size ) { Serial.printf("emp1: get : request too long (skipped)\n"); return; }
+  sink_submit(&http_getsink, len, tele_snapshot_time(tele_snapshot()));
+  band_submit(&http_getband, tele_snapshot());
+  Serial.printf("emp1: get : %s\n", http_getserver);
+  led_flash(); // signal GET submitted
+}
+
+
+// Post the collected telegrams as one ThingSpeak bulk-update (it is sent by sink_poll() in the background), see Batch_Flush
+bool http_flush(Batch * batch, void * ctx) {
+  (void)ctx;
+  int size;
+  char * req = sink_request(&http_batchsink, &size);
+  if( req==NULL ) { Serial.printf("emp1: batch: busy (kept %d)\n", batch->count); return false; }
+  int len = batch_request(batch, req, size, http_batchurl, http_batchserver, http_batchkey);
+  if( len==0 ) { Serial.printf("emp1: batch: request too long (dropped %d)\n", batch->count); batch->dropped+= batch->count; return true; }
+  sink_submit(&http_batchsink, len, batch->first);
+  Serial.printf("emp1: batch: %d telegrams (%d bytes, %u dropped) to %s\n", batch->count, len, batch->dropped, http_batchserver);
+  return true;
+}
+
+
+// Adds the last telegram to the batch, and flushes the batch when it is full or old enough
+void http_collect() {
+  if( *http_batchserver=='\0' ) return;
+  if( !batch_collect(&http_batch, &http_batchline, tele_snapshot_time(tele_snapshot()), http_batchsize, http_batchage, http_flush, NULL) ) {
+    Serial.printf("emp1: batch: telegram does not fit (%u dropped)\n", http_batch.dropped);
+  }
+}
+
+
+// === mqtt =====================================================================================
+
+
+// Every telegram is published to the broker (see mqtt.h): each selected field that changed on "<prefix>/<field name>",
+// and all of them as one JSON object on "<prefix>/telegram". The topics are derived from tele_fields[].
+// The field topics are retained, so a client that subscribes later gets the last values right away. For that to be
+// the actual value, all fields are published again after a (re)connect, and a field whose publish was dropped
+// (no room) is published again with the next telegram.
+Mqtt         broker_mqtt;
+uint32_t     broker_mask;       // the fields published
+uint32_t     broker_pending;    // the fields to publish with the next telegram, even when unchanged
+uint32_t     broker_session;    // broker_mqtt.connects when the fields were last published
+const char * broker_prefix;     // topic prefix
+char         broker_clientid[24];
+
+
+void broker_init() {
+  broker_mask = tele_fields_mask(cfg.getval("mqttfields"));
+  broker_prefix = cfg.getval("mqtttopic");
+  snprintf(broker_clientid, sizeof broker_clientid, APP_NAME "-%06x", (unsigned)ESP.getChipId());
+  mqtt_init(&broker_mqtt, cfg.getval("mqttserver"), String(cfg.getval("mqttport")).toInt(), broker_clientid, cfg.getval("mqttuser"), cfg.getval("mqttpassword"));
+  Serial.printf("mqtt: init (%s as %s)\n", *broker_mqtt.host ? broker_mqtt.host : "no broker", broker_clientid);
+}
+
+
+// Returns the mask of the fields published
+uint32_t broker_fields() {
+  return *broker_mqtt.host!='\0' ? broker_mask : 0;
+}
+
+
+// The JSON object has, per field, a name (at most 15 chars), a value (at most 15 chars) and 6 quotes and separators
+#define BROKER_JSON_SIZE (TELE_NUMFIELDS*(16+16+6)+2)
+
+
+// Queues the publishes of the last telegram (they are written by mqtt_poll() in the background)
+void broker_publish() {
+  if( *broker_mqtt.host=='\0' ) return;
+  char topic[80];
+  char val[20];
+  // The fields that changed (all in a new session), each on its own (retained) topic
+  if( broker_session!=broker_mqtt.connects ) { broker_session = broker_mqtt.connects; broker_pending = broker_mask; }
+  uint32_t publish = (tele_snapshot_changed(tele_snapshot()) | broker_pending) & broker_mask;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    if( !((publish>>i)&1) ) continue;
+    int len = tmpl_field(val, sizeof val, i);
+    snprintf(topic, sizeof topic, "%s/%s", broker_prefix, tele_field_name(i));
+    if( mqtt_publish(&broker_mqtt, topic, val, len, true) ) broker_pending &= ~(1UL<<i); else broker_pending |= 1UL<<i;
+  }
+  // All fields as one JSON object (should it not fit, only that publish is skipped)
+  char json[BROKER_JSON_SIZE];
+  int jsonlen = snprintf(json, sizeof json, "{");
+  for( int i=0; i<TELE_NUMFIELDS && jsonlen<(int)sizeof json; i++ ) {
+    if( !((broker_mask>>i)&1) ) continue;
+    tmpl_field(val, sizeof val, i);
+    bool quote = tele_field_type(i)==TELE_TYPE_STRING || tele_field_type(i)==TELE_TYPE_TIME;
+    jsonlen+= snprintf(json+jsonlen, sizeof json-jsonlen, "%s\"%s\":%s%s%s", jsonlen>1?",":"", tele_field_name(i), quote?"\"":"", val, quote?"\"":"");
+  }
+  if( jsonlen<(int)sizeof json ) jsonlen+= snprintf(json+jsonlen, sizeof json-jsonlen, "}");
+  if( jsonlen>=(int)sizeof json ) { Serial.printf("emp1: mqtt: json too long (skipped)\n"); return; }
+  snprintf(topic, sizeof topic, "%s/telegram", broker_prefix);
+  mqtt_publish(&broker_mqtt, topic, json, jsonlen);
+}
+
+
+// === Monitor ==================================================================================
+
+
+// The counters are kept by the modules (tele_stats(), Sink); the durations are observed in histograms here.
+// They are served in the Prometheus text format on http://<ip>/metrics (only in normal mode, cfg mode has its own server).
+// The archive (see arch.h) is served as CSV on http://<ip>/archive, the history (see hist.h) on http://<ip>/history.
+const uint32_t mon_parse_bounds[]   = { 250, 500, 1000, 2000, 5000, 10000, 20000, 50000 }; // us
+const uint32_t mon_latency_bounds[] = { 10, 20, 50, 100, 200, 500, 1000, 5000, 30000 };    // ms
+const uint32_t mon_gap_bounds[]     = { 1, 2, 5, 10, 20, 50, 100, 500, 1000 };             // ms
+Metrics_Hist mon_parse;   // us spent in the parser per telegram
+Metrics_Hist mon_latency; // ms from telegram complete to request written (all sinks)
+Metrics_Hist mon_gap;     // ms between two loop() runs
+uint32_t     mon_parse_us;
+uint32_t     mon_last_loop;
+
+ESP8266WebServer mon_server(80);
+char mon_buf[1024]; // responses are sent in chunks of (at most) this size
+
+
+void mon_sink(Metrics_Out * out, const char * name, const char * help, int field) {
+  const Sink * sinks[] = { &http_postsink, &http_getsink, &http_batchsink };
+  const char * labels[] = { "sink=\"post\"", "sink=\"get\"", "sink=\"batch\"" };
+  metrics_write_head(out, name, "counter", help);
+  for( int i=0; i<3; i++ ) {
+    uint32_t value = field==0 ? sinks[i]->requests : field==1 ? sinks[i]->connects : sinks[i]->failures;
+    metrics_write_value(out, name, labels[i], value);
+  }
+}
+
+
+void mon_tasks(Metrics_Out * out) {
+  static const char * const names[] = { "emp1_task_runs_total", "emp1_task_run_seconds_total", "emp1_task_run_max_seconds", "emp1_task_late_max_seconds" };
+  static const char * const types[] = { "counter", "counter", "gauge", "gauge" };
+  static const char * const helps[] = { "Runs of the task", "Time spent in the task", "Longest run of the task", "Longest time the task was overdue" };
+  for( int m=0; m<4; m++ ) {
+    metrics_write_head(out, names[m], types[m], helps[m]);
+    for( int i=0; i<coop_count(); i++ ) {
+      const Coop_Task * task = coop_task(i);
+      char labels[32];
+      snprintf(labels, sizeof labels, "task=\"%s\"", task->name);
+      if( m==0 ) metrics_write_value(out, names[m], labels, task->runs);
+      if( m==1 ) metrics_write_value(out, names[m], labels, task->us_sum, 1000000);
+      if( m==2 ) metrics_write_value(out, names[m], labels, task->us_max, 1000000);
+      if( m==3 ) metrics_write_value(out, names[m], labels, task->late_max, 1000);
+    }
+  }
+}
+
+
+void mon_arch(Metrics_Out * out) {
+  const Arch_Stats * st = arch_stats();
+  metrics_write_head (out, "emp1_arch_frames_total", "counter", "Frames archived");
+  metrics_write_value(out, "emp1_arch_frames_total", NULL, st->frames);
+  metrics_write_head (out, "emp1_arch_flash_writes_total", "counter", "Pages written to flash");
+  metrics_write_value(out, "emp1_arch_flash_writes_total", NULL, st->writes);
+  metrics_write_head (out, "emp1_arch_flash_bytes_total", "counter", "Bytes written to flash");
+  metrics_write_value(out, "emp1_arch_flash_bytes_total", NULL, st->written);
+  metrics_write_head (out, "emp1_arch_deleted_total", "counter", "Segments deleted (retention)");
+  metrics_write_value(out, "emp1_arch_deleted_total", NULL, st->deleted);
+  metrics_write_head (out, "emp1_arch_errors_total", "counter", "Failed flash operations");
+  metrics_write_value(out, "emp1_arch_errors_total", NULL, st->errors);
+  metrics_write_head (out, "emp1_arch_segments", "gauge", "Segments in flash");
+  metrics_write_value(out, "emp1_arch_segments", NULL, arch_segments());
+  metrics_write_head (out, "emp1_arch_bytes", "gauge", "Bytes in flash");
+  metrics_write_value(out, "emp1_arch_bytes", NULL, arch_size());
+}
+
+
+void mon_mqtt(Metrics_Out * out) {
+  metrics_write_head (out, "emp1_mqtt_publishes_total", "counter", "MQTT publishes queued");
+  metrics_write_value(out, "emp1_mqtt_publishes_total", NULL, broker_mqtt.publishes);
+  metrics_write_head (out, "emp1_mqtt_dropped_total", "counter", "MQTT publishes dropped (not connected, or buffer full)");
+  metrics_write_value(out, "emp1_mqtt_dropped_total", NULL, broker_mqtt.dropped);
+  metrics_write_head (out, "emp1_mqtt_connects_total", "counter", "MQTT sessions established");
+  metrics_write_value(out, "emp1_mqtt_connects_total", NULL, broker_mqtt.connects);
+  metrics_write_head (out, "emp1_mqtt_failures_total", "counter", "MQTT connects failed or connections lost");
+  metrics_write_value(out, "emp1_mqtt_failures_total", NULL, broker_mqtt.failures);
+  metrics_write_head (out, "emp1_mqtt_up", "gauge", "MQTT session established");
+  metrics_write_value(out, "emp1_mqtt_up", NULL, mqtt_up(&broker_mqtt));
+}
+
+
+// Sends the complete lines in mon_buf as a chunk of the /metrics response
+void mon_flush(const char * buf, int len, void * ctx) {
+  (void)ctx;
+  mon_server.sendContent(buf, len);
+}
+
+
+void mon_metrics() {
+  Metrics_Out out;
+  mon_server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  mon_server.send(200, "text/plain; version=0.0.4", "");
+  metrics_begin(&out, mon_buf, sizeof mon_buf, mon_flush, NULL);
+  const Tele_Stats * st = tele_stats();
+  metrics_write_head (&out, "emp1_p1_bytes_total", "counter", "Bytes received from the P1 port");
+  metrics_write_value(&out, "emp1_p1_bytes_total", NULL, st->bytes);
+  metrics_write_head (&out, "emp1_p1_discarded_bytes_total", "counter", "Bytes received outside a telegram");
+  metrics_write_value(&out, "emp1_p1_discarded_bytes_total", NULL, st->discarded);
+  metrics_write_head (&out, "emp1_uart_rx_buffer_bytes", "gauge", "Size of the UART RX ring");
+  metrics_write_value(&out, "emp1_uart_rx_buffer_bytes", NULL, uart_ring.size);
+  metrics_write_head (&out, "emp1_uart_rx_highwater_bytes", "gauge", "Largest fill of the UART RX ring");
+  metrics_write_value(&out, "emp1_uart_rx_highwater_bytes", NULL, uart_ring.highwater);
+  metrics_write_head (&out, "emp1_uart_overruns_total", "counter", "UART RX overruns (bytes lost)");
+  metrics_write_value(&out, "emp1_uart_overruns_total", NULL, uart_ring.overruns);
+  metrics_write_head (&out, "emp1_uart_fifo_overflows_total", "counter", "UART RX FIFO overflows (interrupt blocked too long)");
+  metrics_write_value(&out, "emp1_uart_fifo_overflows_total", NULL, uart_fifooverflows);
+  metrics_write_head (&out, "emp1_uart_rx_errors_total", "counter", "UART RX framing or parity errors");
+  metrics_write_value(&out, "emp1_uart_rx_errors_total", NULL, uart_rxerrors);
+  metrics_write_head (&out, "emp1_p1_unchanged_lines_total", "counter", "Lines of selected fields skipped by the parser (same as in the previous telegram)");
+  metrics_write_value(&out, "emp1_p1_unchanged_lines_total", NULL, st->unchanged);
+  metrics_write_head (&out, "emp1_telegrams_total", "counter", "Telegrams parsed");
+  metrics_write_value(&out, "emp1_telegrams_total", NULL, st->telegrams);
+  metrics_write_head (&out, "emp1_telegram_errors_total", "counter", "Telegrams rejected, by cause");
+  metrics_write_value(&out, "emp1_telegram_errors_total", "cause=\"crc\"", st->crc);
+  metrics_write_value(&out, "emp1_telegram_errors_total", "cause=\"missing\"", st->missing);
+  metrics_write_value(&out, "emp1_telegram_errors_total", "cause=\"syntax\"", st->syntax);
+  metrics_write_value(&out, "emp1_telegram_errors_total", "cause=\"timeout\"", st->timeouts);
+  metrics_write_value(&out, "emp1_telegram_errors_total", "cause=\"noise\"", st->noise);
+  mon_arch(&out);
+  metrics_write_hist (&out, "emp1_parse_seconds", "Time spent in the parser per telegram", &mon_parse, 1000000);
+  mon_sink(&out, "emp1_sink_requests_total", "Requests completed", 0);
+  mon_sink(&out, "emp1_sink_connects_total", "Connects (with keep-alive this stays low)", 1);
+  mon_sink(&out, "emp1_sink_failures_total", "Requests failed", 2);
+  mon_mqtt(&out);
+  metrics_write_head (&out, "emp1_get_unchanged_total", "counter", "Gets skipped because nothing changed beyond the dead-bands");
+  metrics_write_value(&out, "emp1_get_unchanged_total", NULL, http_getband.suppressed);
+  metrics_write_hist (&out, "emp1_sink_latency_seconds", "Time from telegram complete to request written", &mon_latency, 1000);
+  metrics_write_hist (&out, "emp1_loop_gap_seconds", "Time between two loop() runs", &mon_gap, 1000);
+  metrics_write_head (&out, "emp1_loop_gap_max_seconds", "gauge", "Largest time between two loop() runs");
+  metrics_write_value(&out, "emp1_loop_gap_max_seconds", NULL, mon_gap.max, 1000);
+  mon_tasks(&out);
+  metrics_write_head (&out, "emp1_uptime_seconds", "gauge", "Time since boot");
+  metrics_write_value(&out, "emp1_uptime_seconds", NULL, millis(), 1000);
+  metrics_end(&out);
+  mon_server.sendContent("");
+  if( out.full ) Serial.printf("mon : metrics truncated\n");
+}
+
+
+// Appends `v`, the value of field `ix`, with a leading comma to mon_buf at `len`; returns the new length
+int mon_value(int len, int ix, int32_t v) {
+  uint32_t u = v<0 ? -(uint32_t)v : v; // abs() of INT32_MIN is undefined
+  if( tele_field_type(ix)==TELE_TYPE_MILLI ) return len + snprintf(mon_buf+len, sizeof mon_buf-len, ",%s%u.%03u", v<0?"-":"", (unsigned)(u/1000), (unsigned)(u%1000));
+  return len + snprintf(mon_buf+len, sizeof mon_buf-len, ",%d", (int)v);
+}
+
+
+// Streams the archive as CSV: the time (seconds since 2000-01-01 UTC) and the archived fields, oldest first.
+// The archive is too large to send in one handler run: the handler sends the header and positions a cursor, then
+// mon_poll() sends one chunk per run (at most mon_buf, and no more than the TCP stack accepts, so it never waits).
+// The download ends at the last frame in flash when it started; there is one download at a time.
+#define MON_ARCHLINE    160 // bytes, longest CSV line of the archive
+#define MON_ARCHIDLE  10000 // ms without room to send after which a download is dropped
+WiFiClient  mon_archclient; // the download in progress (when connected)
+Arch_Cursor mon_archcur;
+uint32_t    mon_archtime;   // millis() of the last chunk sent
+
+
+void mon_archive() {
+  if( mon_archclient.connected() ) { mon_server.send(503, "text/plain", "archive download in progress\n"); return; }
+  uint32_t fields = arch_fields();
+  arch_flush();
+  arch_cursor_begin(&mon_archcur);
+  // The server would end a chunked response when the handler returns, so the response is written here, until close
+  int len = snprintf(mon_buf, sizeof mon_buf, "HTTP/1.1 200 OK\r\nContent-Type: text/csv\r\nConnection: close\r\n\r\ntime");
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( (fields>>i)&1 && tele_field_type(i)!=TELE_TYPE_TIME ) len+= snprintf(mon_buf+len, sizeof mon_buf-len, ",%s", tele_field_name(i));
+  len+= snprintf(mon_buf+len, sizeof mon_buf-len, "\n");
+  mon_archclient = mon_server.client();
+  mon_archclient.write((const uint8_t *)mon_buf, len);
+  mon_archtime = millis();
+}
+
+
+// Sends the next chunk of the archive download (if any)
+void mon_archive_poll() {
+  if( !mon_archclient.connected() ) return;
+  int room = mon_archclient.availableForWrite();
+  if( room<MON_ARCHLINE ) {
+    if( millis()-mon_archtime > MON_ARCHIDLE ) { Serial.printf("mon : archive download stalled\n"); mon_archclient.stop(); }
+    return;
+  }
+  if( room>(int)sizeof mon_buf ) room = sizeof mon_buf;
+  uint32_t fields = arch_fields();
+  int32_t time;
+  int32_t values[TELE_NUMFIELDS];
+  int len = 0;
+  bool more = true;
+  while( len+MON_ARCHLINE<=room && (more=arch_read(&mon_archcur, &time, values)) ) {
+    len+= snprintf(mon_buf+len, sizeof mon_buf-len, "%d", (int)time);
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+      if( (fields>>i)&1 && tele_field_type(i)!=TELE_TYPE_TIME ) len = mon_value(len, i, values[i]);
+    }
+    len+= snprintf(mon_buf+len, sizeof mon_buf-len, "\n");
+  }
+  if( len>0 ) mon_archclient.write((const uint8_t *)mon_buf, len);
+  mon_archtime = millis();
+  if( !more ) mon_archclient.stop();
+}
+
+
+// Serves the history (see hist.h) as CSV. Without arguments: per field the number of samples, their time span, min, max and
+// average. With key=P: the samples of field P, oldest first, those with from <= time <= to (default all), or the last n.
+// Times are seconds since 2000-01-01 UTC (see TELE_TYPE_TIME). Samples are fetched in pages of MON_HISTPAGE, so any range fits.
+#define MON_HISTPAGE 32
+void mon_history() {
+  int32_t times[MON_HISTPAGE];
+  int32_t values[MON_HISTPAGE];
+  String arg = mon_server.arg("key");
+  char key = arg.length()==1 ? arg.c_str()[0] : '?';
+  int ix = -1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_key(i)==key && strchr(HIST_KEYS,key) ) ix = i;
+  int len = 0;
+  if( arg.length()==0 ) {
+    len+= snprintf(mon_buf+len, sizeof mon_buf-len, "field,samples,first,last,min,max,avg\n");
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+      Hist_Stats st;
+      if( !strchr(HIST_KEYS,tele_field_key(i)) || !hist_stats(tele_field_key(i), INT32_MIN, INT32_MAX, &st) ) continue;
+      len+= snprintf(mon_buf+len, sizeof mon_buf-len, "%s,%d,%d,%d", tele_field_name(i), st.count, (int)st.first, (int)st.last);
+      len = mon_value(len, i, st.min);
+      len = mon_value(len, i, st.max);
+      len = mon_value(len, i, st.avg);
+      len+= snprintf(mon_buf+len, sizeof mon_buf-len, "\n");
+    }
+    mon_server.send(200, "text/csv", mon_buf);
+    return;
+  }
+  if( ix<0 ) { mon_server.send(404, "text/plain", "key not in history\n"); return; }
+  mon_server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  mon_server.send(200, "text/csv", "");
+  len+= snprintf(mon_buf+len, sizeof mon_buf-len, "time,%s\n", tele_field_name(ix));
+  if( mon_server.hasArg("n") ) {
+    int n = mon_server.arg("n").toInt();
+    if( n>MON_HISTPAGE ) n = MON_HISTPAGE;
+    n = hist_last(key, n<0 ? 0 : n, times, values);
+    for( int i=0; i<n; i++ ) {
+      len+= snprintf(mon_buf+len, sizeof mon_buf-len, "%d", (int)times[i]);
+      len = mon_value(len, ix, values[i]);
+      len+= snprintf(mon_buf+len, sizeof mon_buf-len, "\n");
+    }
   } else {
-    Serial.printf("emp1: get : cannot connect to %s\n", srv);
+    int32_t from = mon_server.hasArg("from") ? mon_server.arg("from").toInt() : INT32_MIN;
+    int32_t to = mon_server.hasArg("to") ? mon_server.arg("to").toInt() : INT32_MAX;
+    int n;
+    while( hist_count()>0 && from<=to && (n=hist_range(key, from, to, times, values, MON_HISTPAGE))>0 ) {
+      for( int i=0; i<n; i++ ) {
+        len+= snprintf(mon_buf+len, sizeof mon_buf-len, "%d", (int)times[i]);
+        len = mon_value(len, ix, values[i]);
+        len+= snprintf(mon_buf+len, sizeof mon_buf-len, "\n");
+      }
+      mon_server.sendContent(mon_buf, len);
+      len = 0;
+      if( n<MON_HISTPAGE ) break;
+      from = times[n-1]+1; // samples are in time order
+    }
   }
-  delay(1);
-  client.stop();
+  if( len>0 ) mon_server.sendContent(mon_buf, len);
+  mon_server.sendContent("");
+}
+
+
+void mon_init() {
+  metrics_hist_init(&mon_parse  , mon_parse_bounds  , sizeof mon_parse_bounds   / sizeof mon_parse_bounds[0]  );
+  metrics_hist_init(&mon_latency, mon_latency_bounds, sizeof mon_latency_bounds / sizeof mon_latency_bounds[0]);
+  metrics_hist_init(&mon_gap    , mon_gap_bounds    , sizeof mon_gap_bounds     / sizeof mon_gap_bounds[0]    );
+  http_postsink.latency = &mon_latency;
+  http_getsink.latency = &mon_latency;
+  http_batchsink.latency = &mon_latency;
+  mon_server.on("/metrics", mon_metrics);
+  mon_server.on("/archive", mon_archive);
+  mon_server.on("/history", mon_history);
+  mon_server.begin();
+  mon_last_loop = millis();
+  Serial.printf("mon : init (/metrics, /archive and /history on port 80)\n");
+}
+
+
+void mon_poll() {
+  mon_server.handleClient();
+  mon_archive_poll();
 }
 
 
@@ -251,8 +714,11 @@ void http_get() {
 
 
 // Use real serial port or spoof prerecorded data
+// SERIAL_READBUF(buf,size) reads what is available (at most size bytes), it returns the number of bytes read (0 if none)
 #if 1
-  #define SERIAL_READ() Serial.read()
+  int SERIAL_READBUF(char * buf, int size) {
+    return uart_read(buf,size);
+  }
 #else 
   // An @ in the string causes a wait of 1000ms
   //const char *s = "noise" TELE_EXAMPLE_1 "@@@@@@@@@@@@much\r\nmore noise@@@@@@@@@@@@" TELE_EXAMPLE_2 "@" TELE_EXAMPLE_3 TELE_EXAMPLE_2 "@@" TELE_EXAMPLE_3;
@@ -261,20 +727,110 @@ void http_get() {
                   "@@@@@" TELE_EXAMPLE_1 "@@@@@" TELE_EXAMPLE_2 "@@@@@" TELE_EXAMPLE_3 
                   "@@@@@" TELE_EXAMPLE_1 "@@@@@" TELE_EXAMPLE_2 "@@@@@" TELE_EXAMPLE_3 
                   "@@@@@" TELE_EXAMPLE_1 "@@@@@" TELE_EXAMPLE_2 "@@@@@" TELE_EXAMPLE_3;
-  int SERIAL_READ() {
-    if( *s=='\0' ) { delay(1000); /* end of s, no inc */ return -1; }
-    else if( *s=='@' ) { delay(1000); s++; return -1; }
-    else { delay(1); return *s++; }
+  int SERIAL_READBUF(char * buf, int size) {
+    if( *s=='\0' ) { delay(1000); /* end of s, no inc */ return 0; }
+    else if( *s=='@' ) { delay(1000); s++; return 0; }
+    else { delay(1); *buf = *s++; return 1; }
   }
 #endif
 
 
+#define SEC(ms) (((ms)+500)/1000)
+
+
+// Bytes are taken from the UART in bulk, at most this many per run of the parse task
+#define APP_RXBUF_SIZE 512
+char app_rxbuf[APP_RXBUF_SIZE];
+
+
 uint32_t app_last_post;
 uint32_t app_last_get;
 
 uint32_t cfg_postperiod;
 uint32_t cfg_getperiod;
 
+
+// The work in loop() is split in tasks (see coop.h). The parse task runs every APP_PARSE_MS, late by at most the
+// longest run of another task. Only the sinks task can wait: when a client (re)connects, resolving the name and the
+// TCP connect block (see sink.h and mqtt.h), at most SINK_DNS_MS+SINK_CONNECT_MS (3 s, the same for mqtt). The task polls one client
+// per run, so that is the worst case latency of the parse task. With keep-alive it is rare (a server that is down),
+// but with DSMR 5 (a telegram per second) 3 s is more than the UART ring holds, so a telegram may be lost then.
+#define APP_PARSE_MS   10 // period of the parse task
+#define APP_SINKS_MS    0 // period of the sinks task (every pass)
+#define APP_REPORT_MS 100 // period of the report task (it is also woken by the parse task)
+#define APP_LED_MS     10 // period of the LED task
+#define APP_WIFI_MS   250 // period of the wifi task (also the blink rate while connecting)
+#define APP_MON_MS     50 // period of the monitor (/metrics) task
+
+
+// Reporting a telegram is done one field per run; -1 when done
+int app_report_ix = -1;
+
+
+// Report task: prints the fields of the last telegram (one per run, Serial is slow), then submits the post and get
+void app_report() {
+  if( app_report_ix<0 ) return;
+  while( app_report_ix<TELE_NUMFIELDS && !tele_field_selected(app_report_ix) ) app_report_ix++;
+  if( app_report_ix<TELE_NUMFIELDS ) {
+    Serial.printf("  %-15s %s\n",tele_field_name(app_report_ix), tele_field_value(app_report_ix));
+    app_report_ix++;
+    coop_wake(app_report);
+    return;
+  }
+  app_report_ix = -1;
+  uint32_t now = millis();
+  if( !wifi_connected ) { Serial.printf("emp1: no wifi (skipped)\n"); return; }
+  if( now-app_last_post > cfg_postperiod ) {
+    http_post();
+    app_last_post = now;
+  } else {
+    Serial.printf("emp1: post: wait %us\n", SEC(cfg_postperiod-(now-app_last_post)) );
+  }
+  if( now-app_last_get > cfg_getperiod ) {
+    if( band_due(&http_getband, tele_snapshot()) ) http_get(); else Serial.printf("emp1: get : unchanged\n");
+    app_last_get = now;
+  } else {
+    Serial.printf("emp1: get : wait %us\n", SEC(cfg_getperiod-(now-app_last_get)) );
+  }
+}
+
+
+// Parse task: feeds the parser all bytes the UART has; if that completes more than one telegram, only the last is dispatched
+void app_parse() {
+  int len = SERIAL_READBUF(app_rxbuf, APP_RXBUF_SIZE);
+  uint32_t start = micros();
+  int telegrams = tele_parser_add_buf(app_rxbuf, len);
+  if( len>0 ) mon_parse_us += micros()-start;
+  if( telegrams>0 ) {
+    metrics_hist_add(&mon_parse, mon_parse_us);
+    mon_parse_us = 0;
+    led_flash(); // signal telegram correct
+    hist_add(tele_snapshot());
+    arch_add(tele_snapshot());
+    agg_add(tele_snapshot());
+    http_collect();
+    broker_publish();
+    app_report_ix = 0;
+    coop_wake(app_report);
+  }
+}
+
+
+// Sinks task: progresses the requests that are underway, and the MQTT connection
+// Polls one client per run (round robin): a connect blocks, this way at most one connect delays the parse task
+void app_sinks() {
+  static int next = 0;
+  if( !wifi_connected ) return;
+  switch( next ) {
+    case 0 : sink_poll(&http_postsink); break;
+    case 1 : sink_poll(&http_getsink); break;
+    case 2 : sink_poll(&http_batchsink); break;
+    default: mqtt_poll(&broker_mqtt); break;
+  }
+  next = (next+1) % 4;
+}
+
+
 void setup() {
   // Bring up serial
   Serial.begin(115200, SERIAL_8N1, SERIAL_FULL);
@@ -307,47 +863,52 @@ void setup() {
   cfg_getperiod  = String(cfg.getval("getperiod")).toInt();
   if( cfg_getperiod<1000 ) cfg_getperiod = 1000;
   Serial.printf("cfg : get  %dms\n", cfg_getperiod);
+  Serial.printf("cfg : get  dead-bands '%s', heartbeat %sms\n", cfg.getval("getband"), cfg.getval("getheartbeat"));
+  // Show config params for batch
+  Serial.printf("cfg : batch http://%s%s\n",cfg.getval("batchserver"), cfg.getval("batchurl"));
+  Serial.printf("cfg : batch %s\n",cfg.getval("batchline"));
+  Serial.printf("cfg : batch %s telegrams or %sms\n",cfg.getval("batchsize"), cfg.getval("batchage"));
+  // Show config params for mqtt
+  Serial.printf("cfg : mqtt %s:%s/%s\n",cfg.getval("mqttserver"), cfg.getval("mqttport"), cfg.getval("mqtttopic"));
+  Serial.printf("cfg : mqtt fields %s\n",cfg.getval("mqttfields"));
   Serial.printf("\n");
 
   // Init all modules
   led_init();
   uart_init();
   wifi_init();
-  tele_init();
+  http_init();
+  broker_init();
+  mon_init();
+  // Only the fields used in the templates and by mqtt (and the history and archive) are extracted
+  tele_init( http_fields() | broker_fields() | hist_fields() | arch_fields() | agg_fields() );
+  hist_init();
+  arch_init();
+  agg_init( String(cfg.getval("aggperiod")).toInt() );
 
   // Start parsing
+  coop_add("parse" , app_parse , APP_PARSE_MS );
+  coop_add("sinks" , app_sinks , APP_SINKS_MS );
+  coop_add("report", app_report, APP_REPORT_MS);
+  coop_add("led"   , led_poll  , APP_LED_MS   );
+  coop_add("wifi"  , wifi_poll , APP_WIFI_MS  );
+  coop_add("mon"   , mon_poll  , APP_MON_MS   );
   Serial.printf("\n");
   app_last_post = millis() - cfg_postperiod;
   app_last_get = millis() - cfg_getperiod;
 }
 
 
-#define SEC(ms) (((ms)+500)/1000)
-
-
 void loop() {
   uint32_t now = millis();
   
   // if in config mode, do config loop (when config completes, it restarts the device)
   if( cfg.cfgmode() ) { cfg.loop(); return; }
 
-  // If in normal app mode, get and dispatch telegrams
-  Tele_Result res = tele_parser_add(SERIAL_READ());
-  if( res==TELE_RESULT_AVAILABLE ) {
-    led_flash(); // signal telegram correct
-    // Serial.printf("emp1: available\n");
-    for( int i=0; i<TELE_NUMFIELDS; i++ ) Serial.printf("  %-15s %s\n",tele_field_name(i), tele_field_value(i));
-    if( now-app_last_post > cfg_postperiod ) {
-      http_post();
-      app_last_post = now;
-    } else {
-      Serial.printf("emp1: post: wait %us\n", SEC(cfg_postperiod-(now-app_last_post)) );
-    }
-    if( now-app_last_get > cfg_getperiod ) {
-      http_get();
-      app_last_get = now;
-    } else {
-      Serial.printf("emp1: get : wait %us\n", SEC(cfg_getperiod-(now-app_last_get)) );
-    }
-  }
+  // Track the time between loop() runs
+  metrics_hist_add(&mon_gap, now-mon_last_loop);
+  mon_last_loop = now;
+
+  // Run the task that is due (if any)
+  coop_run();
 }
@@ -0,0 +1,232 @@
+// hist.cpp - In-RAM history of recent telegrams
+
+
+#include <Arduino.h>
+#include "hist.h"
+
+
+// === BLOCKS ===================================================================================
+// Each block holds a number of samples, one column per field (column 0 is the time).
+// A column starts with the absolute value of the first sample (in `base`),
+// followed by a zigzag varint delta per further sample (in `data`).
+// Counters (kWh, m3) hardly change, and power changes a few watts, so most deltas take one byte.
+
+
+#define HIST_NUMCOLS   ( 1+sizeof(HIST_KEYS)-1 )
+#define HIST_MAXDELTA  5 // bytes of the largest varint
+
+
+struct Hist_Block {
+  int      count;                           // number of samples in this block
+  int32_t  base[HIST_NUMCOLS];              // value of first sample
+  int32_t  last[HIST_NUMCOLS];              // value of last sample (for appending deltas)
+  uint8_t  len[HIST_NUMCOLS];               // number of bytes used in data
+  uint8_t  data[HIST_NUMCOLS][HIST_COLSIZE];// deltas
+};
+
+
+static Hist_Block hist_blocks[HIST_NUMBLOCKS];
+static int        hist_head;     // index of the oldest block
+static int        hist_used;     // number of blocks in use
+static int        hist_ix[HIST_NUMCOLS]; // index in tele_fields[] for each column (column 0 is the time)
+
+
+// Returns the column of field `key`, or -1 if not in HIST_KEYS
+static int hist_col(char key) {
+  for( size_t c=1; c<HIST_NUMCOLS; c++ ) {
+    if( HIST_KEYS[c-1]==key ) return c;
+  }
+  return -1;
+}
+
+
+// Appends `delta` as zigzag varint to column `col` of `block`
+static void hist_put(Hist_Block * block, int col, int32_t delta) {
+  uint32_t u = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  do {
+    uint8_t b = u & 0x7F;
+    u >>= 7;
+    if( u ) b |= 0x80;
+    block->data[col][block->len[col]++] = b;
+  } while( u );
+}
+
+
+// Reads a zigzag varint from `data` at `*pos`
+static int32_t hist_get(const uint8_t * data, int * pos) {
+  uint32_t u = 0;
+  int shift = 0;
+  uint8_t b;
+  do {
+    b = data[(*pos)++];
+    u |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while( b & 0x80 );
+  return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+
+// === ITERATOR =================================================================================
+// Walks all samples, oldest first, decoding the time column and one field column.
+
+
+struct Hist_Iter {
+  int     block;  // number of blocks done (from hist_head)
+  int     sample; // number of samples done in current block
+  int     pos[2]; // read position in time column and field column
+  int     col;    // column of the field
+  int32_t time;
+  int32_t value;
+};
+
+
+static void hist_iter_begin(Hist_Iter * it, int col) {
+  it->block = 0;
+  it->sample = 0;
+  it->col = col;
+}
+
+
+// Moves to the next sample, returns false when there are none
+static bool hist_iter_next(Hist_Iter * it) {
+  while( it->block<hist_used ) {
+    const Hist_Block * block = &hist_blocks[ (hist_head+it->block) % HIST_NUMBLOCKS ];
+    if( it->sample<block->count ) {
+      if( it->sample==0 ) {
+        it->time = block->base[0];
+        it->value = block->base[it->col];
+        it->pos[0] = 0;
+        it->pos[1] = 0;
+      } else {
+        it->time += hist_get(block->data[0], &it->pos[0]);
+        it->value += hist_get(block->data[it->col], &it->pos[1]);
+      }
+      it->sample++;
+      return true;
+    }
+    it->block++;
+    it->sample = 0;
+  }
+  return false;
+}
+
+
+// === API ======================================================================================
+
+
+uint32_t hist_fields() {
+  uint32_t fields = tele_fields_mask(HIST_KEYS);
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_type(i)==TELE_TYPE_TIME ) fields |= 1UL<<i;
+  return fields;
+}
+
+
+void hist_init() {
+  hist_head = 0;
+  hist_used = 0;
+  int time = -1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    if( tele_field_type(i)==TELE_TYPE_TIME ) time = i;
+    int col = hist_col(tele_field_key(i));
+    if( col>0 ) hist_ix[col] = i;
+  }
+  hist_ix[0] = time;
+  Serial.printf("hist: init (%d bytes, %d fields every %ds)\n", (int)sizeof hist_blocks, (int)HIST_NUMCOLS-1, HIST_PERIOD);
+}
+
+
+void hist_add(const Tele_Snapshot * snap) {
+  if( hist_ix[0]<0 || tele_snapshot_seq(snap)==0 ) return;
+  int32_t vals[HIST_NUMCOLS];
+  for( size_t c=0; c<HIST_NUMCOLS; c++ ) vals[c] = tele_snapshot_num(snap, hist_ix[c]);
+
+  Hist_Block * block = hist_used>0 ? &hist_blocks[ (hist_head+hist_used-1) % HIST_NUMBLOCKS ] : NULL;
+  if( block!=NULL ) {
+    // Time for a new sample?
+    if( vals[0]-block->last[0] < HIST_PERIOD && vals[0]>=block->last[0] ) return;
+    // Room in all columns of the last block?
+    bool room = true;
+    for( size_t c=0; c<HIST_NUMCOLS; c++ ) if( block->len[c]+HIST_MAXDELTA > HIST_COLSIZE ) room = false;
+    if( room ) {
+      for( size_t c=0; c<HIST_NUMCOLS; c++ ) {
+        hist_put(block, c, (int32_t)((uint32_t)vals[c]-(uint32_t)block->last[c]));
+        block->last[c] = vals[c];
+      }
+      block->count++;
+      return;
+    }
+  }
+  // Start a new block, drop the oldest when all are in use
+  if( hist_used==HIST_NUMBLOCKS ) { hist_head = (hist_head+1) % HIST_NUMBLOCKS; hist_used--; }
+  block = &hist_blocks[ (hist_head+hist_used) % HIST_NUMBLOCKS ];
+  hist_used++;
+  block->count = 1;
+  for( size_t c=0; c<HIST_NUMCOLS; c++ ) {
+    block->base[c] = vals[c];
+    block->last[c] = vals[c];
+    block->len[c] = 0;
+  }
+}
+
+
+int hist_count(int32_t * oldest, int32_t * newest) {
+  int count = 0;
+  for( int b=0; b<hist_used; b++ ) count += hist_blocks[ (hist_head+b) % HIST_NUMBLOCKS ].count;
+  if( oldest!=NULL ) *oldest = hist_used>0 ? hist_blocks[hist_head].base[0] : 0;
+  if( newest!=NULL ) *newest = hist_used>0 ? hist_blocks[ (hist_head+hist_used-1) % HIST_NUMBLOCKS ].last[0] : 0;
+  return count;
+}
+
+
+bool hist_stats(char key, int32_t from, int32_t to, Hist_Stats * stats) {
+  int col = hist_col(key);
+  if( col<0 ) return false;
+  memset(stats, 0, sizeof *stats);
+  int64_t sum = 0;
+  Hist_Iter it;
+  hist_iter_begin(&it, col);
+  while( hist_iter_next(&it) ) {
+    if( it.time<from || it.time>to ) continue;
+    if( stats->count==0 ) { stats->min = it.value; stats->max = it.value; stats->first = it.time; }
+    if( it.value<stats->min ) stats->min = it.value;
+    if( it.value>stats->max ) stats->max = it.value;
+    stats->last = it.time;
+    sum += it.value;
+    stats->count++;
+  }
+  if( stats->count>0 ) stats->avg = sum / stats->count;
+  return true;
+}
+
+
+int hist_range(char key, int32_t from, int32_t to, int32_t * times, int32_t * values, int max) {
+  int col = hist_col(key);
+  if( col<0 ) return -1;
+  int n = 0;
+  Hist_Iter it;
+  hist_iter_begin(&it, col);
+  while( n<max && hist_iter_next(&it) ) {
+    if( it.time<from || it.time>to ) continue;
+    times[n] = it.time;
+    values[n] = it.value;
+    n++;
+  }
+  return n;
+}
+
+
+int hist_last(char key, int n, int32_t * times, int32_t * values) {
+  int col = hist_col(key);
+  if( col<0 ) return -1;
+  int skip = hist_count() - n;
+  int i = 0;
+  Hist_Iter it;
+  hist_iter_begin(&it, col);
+  while( hist_iter_next(&it) ) {
+    if( skip-->0 ) continue;
+    times[i] = it.time;
+    values[i] = it.value;
+    i++;
+  }
+  return i;
+}
@@ -0,0 +1,61 @@
+// hist.h - Interface to an in-RAM history of recent telegrams
+#ifndef _HIST_H_
+#define _HIST_H_
+
+
+#include <stdint.h>
+#include "tele.h"
+
+
+// The history stores, every HIST_PERIOD seconds, the time and the values of the fields with the keys in HIST_KEYS.
+// Storage is columnar and delta encoded, in a ring of blocks: when full, the oldest block is dropped.
+// With HIST_PERIOD 10, HIST_NUMBLOCKS 12 and HIST_COLSIZE 56 about 6 kbyte RAM holds typically 1.5 to 2 hours.
+#define HIST_KEYS      "PpLHlhG"  // keys (see tele_fields[]) of the fields to store
+#define HIST_PERIOD         10    // seconds (UTC) between stored samples
+#define HIST_NUMBLOCKS      12    // number of blocks in the ring
+#define HIST_COLSIZE        56    // bytes per column per block
+
+
+// Statistics over a range of samples of one field
+struct Hist_Stats {
+  int     count;   // number of samples in range (if 0 the others are 0)
+  int32_t min;
+  int32_t max;
+  int32_t avg;
+  int32_t first;   // time of first sample in range
+  int32_t last;    // time of last sample in range
+};
+
+
+// Returns the mask of the fields the history needs (HIST_KEYS and the time), see tele_fields_mask()
+uint32_t hist_fields();
+
+
+// Initialize this module
+void hist_init();
+
+
+// Adds the telegram in `snap` to the history (if HIST_PERIOD has passed since the last stored sample)
+void hist_add(const Tele_Snapshot * snap);
+
+
+// Returns the number of samples in the history, and the time of the oldest and newest one
+int  hist_count(int32_t * oldest=NULL, int32_t * newest=NULL);
+
+
+// Gets the statistics of field `key` for the samples with `from` <= time <= `to` (times in seconds since 2000, see TELE_TYPE_TIME).
+// Returns false if `key` is not in HIST_KEYS.
+bool hist_stats(char key, int32_t from, int32_t to, Hist_Stats * stats);
+
+
+// Copies the samples of field `key` with `from` <= time <= `to` to `times` and `values` (oldest first, at most `max`).
+// Returns the number of samples copied, -1 if `key` is not in HIST_KEYS.
+int  hist_range(char key, int32_t from, int32_t to, int32_t * times, int32_t * values, int max);
+
+
+// Copies the last `n` samples of field `key` to `times` and `values` (oldest first).
+// Returns the number of samples copied, -1 if `key` is not in HIST_KEYS.
+int  hist_last(char key, int n, int32_t * times, int32_t * values);
+
+
+#endif
@@ -0,0 +1,114 @@
+// metrics.cpp - Counters and histograms, written in the Prometheus text format
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "metrics.h"
+
+
+// === HISTOGRAM ================================================================================
+
+
+void metrics_hist_init(Metrics_Hist * hist, const uint32_t * bounds, int num) {
+  memset(hist, 0, sizeof *hist);
+  if( num>METRICS_MAXBOUNDS ) num = METRICS_MAXBOUNDS;
+  hist->bounds = bounds;
+  hist->num = num;
+}
+
+
+void metrics_hist_add(Metrics_Hist * hist, uint32_t value) {
+  int i = 0;
+  while( i<hist->num && value>hist->bounds[i] ) i++;
+  hist->counts[i]++;
+  hist->count++;
+  hist->sum += value;
+  if( value>hist->max ) hist->max = value;
+}
+
+
+// === OUTPUT ===================================================================================
+
+
+void metrics_begin(Metrics_Out * out, char * buf, int size, Metrics_Flush flush, void * ctx) {
+  out->buf = buf;
+  out->size = size;
+  out->len = 0;
+  out->full = false;
+  out->flush = flush;
+  out->ctx = ctx;
+  out->flushed = 0;
+  if( size>0 ) *buf = '\0';
+}
+
+
+void metrics_end(Metrics_Out * out) {
+  if( out->flush==NULL || out->len==0 ) return;
+  out->flush(out->buf, out->len, out->ctx);
+  out->flushed += out->len;
+  out->len = 0;
+  out->buf[0] = '\0';
+}
+
+
+// Appends formatted text. When it does not fit, the complete lines are flushed (if possible) and it is tried again;
+// otherwise the partial line is dropped, so the output ends with complete lines
+static void metrics_printf(Metrics_Out * out, const char * fmt, ...) {
+  if( out->full ) return;
+  for( ;; ) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(out->buf+out->len, out->size-out->len, fmt, args);
+    va_end(args);
+    if( n>=0 && out->len+n<out->size ) { out->len += n; return; }
+    int lines = out->len;
+    while( lines>0 && out->buf[lines-1]!='\n' ) lines--;
+    if( out->flush==NULL || lines==0 ) break;
+    out->flush(out->buf, lines, out->ctx);
+    out->flushed += lines;
+    memmove(out->buf, out->buf+lines, out->len-lines);
+    out->len -= lines;
+    out->buf[out->len] = '\0';
+  }
+  out->full = true;
+  while( out->len>0 && out->buf[out->len-1]!='\n' ) out->len--;
+  out->buf[out->len] = '\0';
+}
+
+
+// Appends `value`/`scale` as decimal number, e.g. 1234 with scale 1000 gives "1.234"
+static void metrics_number(Metrics_Out * out, uint64_t value, uint32_t scale) {
+  if( scale<=1 ) { metrics_printf(out, "%lu", (unsigned long)value); return; }
+  int digits = 0;
+  for( uint32_t s=scale; s>1; s/=10 ) digits++;
+  metrics_printf(out, "%lu.%0*lu", (unsigned long)(value/scale), digits, (unsigned long)(value%scale));
+}
+
+
+void metrics_write_head(Metrics_Out * out, const char * name, const char * type, const char * help) {
+  metrics_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+void metrics_write_value(Metrics_Out * out, const char * name, const char * labels, uint64_t value, uint32_t scale) {
+  if( labels ) metrics_printf(out, "%s{%s} ", name, labels); else metrics_printf(out, "%s ", name);
+  metrics_number(out, value, scale);
+  metrics_printf(out, "\n");
+}
+
+
+void metrics_write_hist(Metrics_Out * out, const char * name, const char * help, const Metrics_Hist * hist, uint32_t scale) {
+  metrics_write_head(out, name, "histogram", help);
+  uint32_t cumulative = 0;
+  for( int i=0; i<hist->num; i++ ) {
+    cumulative += hist->counts[i];
+    metrics_printf(out, "%s_bucket{le=\"", name);
+    metrics_number(out, hist->bounds[i], scale);
+    metrics_printf(out, "\"} %lu\n", (unsigned long)cumulative);
+  }
+  metrics_printf(out, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)hist->count);
+  metrics_printf(out, "%s_sum ", name);
+  metrics_number(out, hist->sum, scale);
+  metrics_printf(out, "\n%s_count %lu\n", name, (unsigned long)hist->count);
+}
@@ -0,0 +1,73 @@
+// metrics.h - Interface to counters and histograms, written in the Prometheus text format
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+
+#include <stdint.h>
+
+
+// A histogram counts observations (e.g. durations in us or ms) in buckets with fixed upper bounds.
+// Adding an observation is cheap (no allocation, no floating point), so it can be done per telegram or per loop().
+// metrics_write_xxx() append metrics to a (caller supplied) buffer, in the Prometheus text exposition format.
+// Values are integers in some unit; `scale` (1, 1000 or 1000000) converts them to the base unit, e.g. seconds.
+// With a flush function the buffer can be small: when it is full, its complete lines are handed to flush (e.g. to
+// send them as a chunk of the HTTP response) and writing continues at its start.
+
+
+#define METRICS_MAXBOUNDS 10
+
+
+struct Metrics_Hist {
+  const uint32_t * bounds;  // upper bounds of the buckets (increasing), the last bucket (+Inf) is implicit
+  int              num;     // number of bounds (at most METRICS_MAXBOUNDS)
+  uint32_t         counts[METRICS_MAXBOUNDS+1]; // observations per bucket (not cumulative)
+  uint32_t         count;   // number of observations
+  uint64_t         sum;     // sum of the observations
+  uint32_t         max;     // largest observation
+};
+
+
+// Called with complete lines of output; `ctx` is passed on
+typedef void (*Metrics_Flush)(const char * buf, int len, void * ctx);
+
+
+struct Metrics_Out {
+  char *           buf;
+  int              size;
+  int              len;     // bytes in buf (excluding terminating zero)
+  bool             full;    // some metrics did not fit
+  Metrics_Flush    flush;   // NULL if everything must fit in buf
+  void *           ctx;
+  int              flushed; // bytes handed to flush
+};
+
+
+// Initializes histogram `hist` with the `num` upper bounds in `bounds` (the array is not copied).
+void metrics_hist_init(Metrics_Hist * hist, const uint32_t * bounds, int num);
+
+
+// Adds one observation to the histogram.
+void metrics_hist_add(Metrics_Hist * hist, uint32_t value);
+
+
+// Starts writing metrics into `buf` of `size` bytes; when it is full, complete lines go to `flush` (if not NULL).
+void metrics_begin(Metrics_Out * out, char * buf, int size, Metrics_Flush flush=NULL, void * ctx=NULL);
+
+
+// Hands what is left in the buffer to flush (if any).
+void metrics_end(Metrics_Out * out);
+
+
+// Writes the HELP and TYPE lines of metric `name`; `type` is "counter", "gauge" or "histogram".
+void metrics_write_head(Metrics_Out * out, const char * name, const char * type, const char * help);
+
+
+// Writes one sample of metric `name`; `labels` is e.g. "sink=\"post\"" or NULL.
+void metrics_write_value(Metrics_Out * out, const char * name, const char * labels, uint64_t value, uint32_t scale=1);
+
+
+// Writes histogram `hist` as metric `name` (head, buckets, sum and count).
+void metrics_write_hist(Metrics_Out * out, const char * name, const char * help, const Metrics_Hist * hist, uint32_t scale=1);
+
+
+#endif
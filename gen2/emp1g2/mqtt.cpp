@@ -0,0 +1,258 @@
+// mqtt.cpp - Non-blocking MQTT 3.1.1 publisher (persistent session, QoS 0)
+
+
+#include <Arduino.h>
+#include "mqtt.h"
+
+
+// MQTT control packet types (high nibble of the first byte)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_RETAIN      0x01 // flag of PUBLISH
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+
+
+// === PACKETS ==================================================================================
+// Packets are written straight into the output buffer; a packet that does not fit is not written at all.
+
+
+// Returns the number of bytes of the encoding of remaining length `len`
+static int mqtt_varlen(int len) {
+  return len<128 ? 1 : len<16384 ? 2 : len<2097152 ? 3 : 4;
+}
+
+
+// Starts a packet of `type` with `len` bytes after the fixed header; returns NULL if it does not fit
+static uint8_t * mqtt_packet(Mqtt * mqtt, uint8_t type, int len) {
+  // Make room by dropping what is already written
+  if( mqtt->sent>0 ) {
+    memmove(mqtt->out, mqtt->out+mqtt->sent, mqtt->outlen-mqtt->sent);
+    mqtt->outlen -= mqtt->sent;
+    mqtt->sent = 0;
+  }
+  if( mqtt->outlen + 1 + mqtt_varlen(len) + len > MQTT_OUT_SIZE ) return NULL;
+  uint8_t * w = mqtt->out+mqtt->outlen;
+  *w++ = type;
+  do { *w = len%128; len /= 128; if( len>0 ) *w |= 0x80; w++; } while( len>0 );
+  return w;
+}
+
+
+// Writes string `s` of `len` bytes, with its length prefix, to `w`; returns the position after it
+static uint8_t * mqtt_str(uint8_t * w, const char * s, int len) {
+  *w++ = len>>8;
+  *w++ = len&0xFF;
+  memcpy(w, s, len);
+  return w+len;
+}
+
+
+// Ends the packet started with mqtt_packet(), `w` is the position after it
+static void mqtt_end(Mqtt * mqtt, uint8_t * w) {
+  mqtt->outlen = w-mqtt->out;
+  mqtt->tx_time = millis();
+}
+
+
+static bool mqtt_connect_packet(Mqtt * mqtt) {
+  int idlen = strlen(mqtt->clientid);
+  int userlen = strlen(mqtt->user);
+  int passlen = strlen(mqtt->password);
+  uint8_t flags = 0x02; // clean session
+  int len = 10 + 2+idlen;
+  if( userlen>0 ) { flags |= 0x80; len += 2+userlen; }
+  if( userlen>0 && passlen>0 ) { flags |= 0x40; len += 2+passlen; }
+  uint8_t * w = mqtt_packet(mqtt, MQTT_CONNECT, len);
+  if( w==NULL ) return false;
+  w = mqtt_str(w, "MQTT", 4);
+  *w++ = 4; // protocol level 3.1.1
+  *w++ = flags;
+  *w++ = MQTT_KEEPALIVE>>8;
+  *w++ = MQTT_KEEPALIVE&0xFF;
+  w = mqtt_str(w, mqtt->clientid, idlen);
+  if( flags&0x80 ) w = mqtt_str(w, mqtt->user, userlen);
+  if( flags&0x40 ) w = mqtt_str(w, mqtt->password, passlen);
+  mqtt_end(mqtt, w);
+  return true;
+}
+
+
+// === CONNECTION ===============================================================================
+
+
+// Drops the connection; the next connect is after `retry` ms, which doubles up to MQTT_RETRY_MAX
+static void mqtt_down(Mqtt * mqtt, const char * why) {
+  Serial.printf("mqtt: %s: %s (retry in %us)\n", mqtt->host, why, (unsigned)(mqtt->retry/1000));
+  mqtt->client.stop();
+  mqtt->state = MQTT_STATE_DOWN;
+  mqtt->time = millis();
+  mqtt->failures++;
+  mqtt->outlen = 0;
+  mqtt->sent = 0;
+}
+
+
+// Connects to the broker and queues the CONNECT packet, returns false if that fails
+static bool mqtt_connect(Mqtt * mqtt) {
+  mqtt->client.stop(); // release the previous connection (if any)
+  // Resolve the host name, unless a recent result is cached
+  if( !mqtt->ip_valid || millis()-mqtt->ip_time > MQTT_DNS_TTL ) {
+    if( !WiFi.hostByName(mqtt->host, mqtt->ip, MQTT_DNS_MS) ) {
+      mqtt->ip_valid = false;
+      mqtt_down(mqtt, "cannot resolve");
+      return false;
+    }
+    mqtt->ip_time = millis();
+    mqtt->ip_valid = true;
+  }
+  mqtt->client.setTimeout(MQTT_CONNECT_MS);
+  if( !mqtt->client.connect(mqtt->ip, mqtt->port) ) {
+    mqtt->ip_valid = false; // maybe the address changed
+    mqtt_down(mqtt, "cannot connect");
+    return false;
+  }
+  mqtt->client.setNoDelay(true);
+  mqtt->outlen = 0;
+  mqtt->sent = 0;
+  mqtt->in_state = 0;
+  mqtt->ping = false;
+  mqtt_connect_packet(mqtt);
+  mqtt->state = MQTT_STATE_CONNACK;
+  mqtt->time = millis();
+  return true;
+}
+
+
+// Handles a complete packet from the broker (only the first bytes of its body are in `in_data`)
+static void mqtt_received(Mqtt * mqtt) {
+  switch( mqtt->in_type&0xF0 ) {
+  case MQTT_CONNACK:
+    if( mqtt->state!=MQTT_STATE_CONNACK ) break;
+    if( mqtt->in_got<2 || mqtt->in_data[1]!=0 ) {
+      char why[24];
+      sprintf(why, "refused (%d)", mqtt->in_got<2 ? -1 : mqtt->in_data[1]);
+      mqtt->retry = MQTT_RETRY_MAX; // a broker that refuses, is not going to change its mind soon
+      mqtt_down(mqtt, why);
+      break;
+    }
+    Serial.printf("mqtt: %s: connected\n", mqtt->host);
+    mqtt->state = MQTT_STATE_UP;
+    mqtt->time = millis();
+    mqtt->retry = MQTT_RETRY_MS;
+    mqtt->connects++;
+    break;
+  case MQTT_PINGRESP:
+    mqtt->ping = false;
+    break;
+  default:
+    break; // not subscribed, so nothing else is expected
+  }
+}
+
+
+// Reads what the broker sent, and feeds it to the packet parser
+static void mqtt_read(Mqtt * mqtt) {
+  uint8_t buf[64];
+  int avail;
+  while( mqtt->state!=MQTT_STATE_DOWN && (avail=mqtt->client.available())>0 ) {
+    int n = mqtt->client.read(buf, avail<(int)sizeof buf ? avail : sizeof buf);
+    if( n<=0 ) break;
+    for( int i=0; i<n && mqtt->state!=MQTT_STATE_DOWN; i++ ) {
+      uint8_t b = buf[i];
+      if( mqtt->in_state==0 ) {
+        mqtt->in_type = b;
+        mqtt->in_len = 0;
+        mqtt->in_shift = 0;
+        mqtt->in_got = 0;
+        mqtt->in_state = 1;
+      } else if( mqtt->in_state==1 ) {
+        mqtt->in_len |= (uint32_t)(b&0x7F) << mqtt->in_shift;
+        mqtt->in_shift += 7;
+        if( b&0x80 ) continue;
+        mqtt->in_state = 2;
+      } else {
+        if( mqtt->in_got<sizeof mqtt->in_data ) mqtt->in_data[mqtt->in_got] = b;
+        mqtt->in_got++;
+      }
+      if( mqtt->in_state==2 && mqtt->in_got==mqtt->in_len ) {
+        mqtt->in_state = 0;
+        mqtt_received(mqtt);
+      }
+    }
+  }
+}
+
+
+// === API ======================================================================================
+
+
+void mqtt_init(Mqtt * mqtt, const char * host, uint16_t port, const char * clientid, const char * user, const char * password) {
+  mqtt->host = host;
+  mqtt->port = port;
+  mqtt->clientid = clientid;
+  mqtt->user = user;
+  mqtt->password = password;
+  mqtt->ip_valid = false;
+  mqtt->state = MQTT_STATE_DOWN;
+  mqtt->time = millis();
+  mqtt->retry = 0; // connect right away
+  mqtt->outlen = 0;
+  mqtt->sent = 0;
+  mqtt->publishes = 0;
+  mqtt->dropped = 0;
+  mqtt->connects = 0;
+  mqtt->failures = 0;
+}
+
+
+bool mqtt_publish(Mqtt * mqtt, const char * topic, const char * payload, int len, bool retain) {
+  int topiclen = strlen(topic);
+  uint8_t * w = mqtt->state==MQTT_STATE_UP ? mqtt_packet(mqtt, MQTT_PUBLISH | (retain?MQTT_RETAIN:0), 2+topiclen+len) : NULL;
+  if( w==NULL ) { mqtt->dropped++; return false; }
+  w = mqtt_str(w, topic, topiclen);
+  memcpy(w, payload, len);
+  mqtt_end(mqtt, w+len);
+  mqtt->publishes++;
+  return true;
+}
+
+
+void mqtt_poll(Mqtt * mqtt) {
+  if( mqtt->host[0]=='\0' ) return;
+  if( mqtt->state==MQTT_STATE_DOWN ) {
+    if( millis()-mqtt->time < mqtt->retry ) return;
+    mqtt->retry = mqtt->retry==0 ? MQTT_RETRY_MS : mqtt->retry*2 > MQTT_RETRY_MAX ? MQTT_RETRY_MAX : mqtt->retry*2;
+    if( !mqtt_connect(mqtt) ) return;
+  }
+  // Write as much as the TCP stack accepts now
+  int n = mqtt->outlen - mqtt->sent;
+  int room = mqtt->client.availableForWrite();
+  if( n>room ) n = room;
+  if( n>0 ) mqtt->sent += mqtt->client.write(mqtt->out+mqtt->sent, n);
+  if( mqtt->sent==mqtt->outlen ) { mqtt->outlen = 0; mqtt->sent = 0; }
+  // Handle the broker's packets
+  mqtt_read(mqtt);
+  if( mqtt->state==MQTT_STATE_DOWN ) return;
+  if( !mqtt->client.connected() && !mqtt->client.available() ) { mqtt_down(mqtt, "connection lost"); return; }
+  if( mqtt->state==MQTT_STATE_CONNACK ) {
+    if( millis()-mqtt->time > MQTT_RESPONSE_MS ) mqtt_down(mqtt, "no CONNACK");
+    return;
+  }
+  // Keep-alive
+  if( mqtt->ping && millis()-mqtt->ping_time > MQTT_RESPONSE_MS ) { mqtt_down(mqtt, "no PINGRESP"); return; }
+  if( !mqtt->ping && millis()-mqtt->tx_time > MQTT_KEEPALIVE*1000UL/2 ) {
+    uint8_t * w = mqtt_packet(mqtt, MQTT_PINGREQ, 0);
+    if( w!=NULL ) {
+      mqtt_end(mqtt, w);
+      mqtt->ping = true;
+      mqtt->ping_time = millis();
+    }
+  }
+}
+
+
+bool mqtt_up(const Mqtt * mqtt) {
+  return mqtt->state==MQTT_STATE_UP;
+}
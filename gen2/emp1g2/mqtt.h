@@ -0,0 +1,88 @@
+// mqtt.h - Interface to a non-blocking MQTT 3.1.1 publisher (persistent session, QoS 0)
+#ifndef _MQTT_H_
+#define _MQTT_H_
+
+
+#include <ESP8266WiFi.h>
+
+
+// The publisher keeps one connection to the broker open. mqtt_publish() only appends a PUBLISH packet to the
+// output buffer; mqtt_poll(), called from loop(), writes it out as the TCP stack accepts, so publishes are pipelined
+// (QoS 0 has no acknowledgement to wait for). mqtt_poll() also reads the broker's packets (CONNACK, PINGRESP),
+// sends a PINGREQ when idle, and when the connection is lost it reconnects in the background with a growing delay.
+// Two steps of a (re)connect block, like for a sink (see sink.h): resolving the broker name (at most MQTT_DNS_MS, only
+// when the cached address expired or failed) and the TCP connect (at most MQTT_CONNECT_MS).
+
+
+#define MQTT_OUT_SIZE     1536   // bytes of packets waiting to be written
+#define MQTT_KEEPALIVE      60   // s, keep-alive interval told to the broker (a PINGREQ is sent after half of it)
+#define MQTT_DNS_MS       1000   // ms timeout for resolving the broker name (the core's default is 10 s)
+#define MQTT_CONNECT_MS   2000   // ms timeout for connect
+#define MQTT_RESPONSE_MS  5000   // ms timeout for CONNACK and PINGRESP
+#define MQTT_RETRY_MS     2000   // ms before the first reconnect, doubles per failure
+#define MQTT_RETRY_MAX   60000   // ms, maximum delay between reconnects
+#define MQTT_DNS_TTL    600000   // ms that a resolved address is cached
+
+
+enum Mqtt_State {
+  MQTT_STATE_DOWN,    // not connected (waiting to reconnect)
+  MQTT_STATE_CONNACK, // connected, CONNECT sent, waiting for CONNACK
+  MQTT_STATE_UP,      // session established, publishes are accepted
+};
+
+
+struct Mqtt {
+  const char * host;          // broker name (empty string disables mqtt)
+  uint16_t     port;
+  const char * clientid;
+  const char * user;          // empty for none
+  const char * password;      // empty for none
+  WiFiClient   client;
+  // DNS cache
+  IPAddress    ip;
+  uint32_t     ip_time;
+  bool         ip_valid;
+  // Connection
+  Mqtt_State   state;
+  uint32_t     time;          // millis() of the last state change
+  uint32_t     retry;         // ms to wait in MQTT_STATE_DOWN before the next connect
+  uint32_t     tx_time;       // millis() of the last packet queued
+  bool         ping;          // PINGREQ outstanding
+  uint32_t     ping_time;     // millis() of the PINGREQ
+  // Output
+  uint8_t      out[MQTT_OUT_SIZE];
+  int          outlen;        // bytes in out
+  int          sent;          // bytes of out written
+  // Input (packets are parsed as they stream in; only their first bytes are kept)
+  int          in_state;      // 0 type, 1 remaining length, 2 body
+  uint8_t      in_type;
+  uint32_t     in_len;        // remaining length
+  int          in_shift;
+  uint32_t     in_got;        // bytes of the body received
+  uint8_t      in_data[2];
+  // Statistics
+  uint32_t     publishes;     // number of publishes queued
+  uint32_t     dropped;       // number of publishes dropped (not connected, or no room)
+  uint32_t     connects;      // number of sessions established
+  uint32_t     failures;      // number of failed connects and lost connections
+};
+
+
+// Initialize `mqtt` for broker `host` on `port`; `user` and `password` may be empty.
+void mqtt_init(Mqtt * mqtt, const char * host, uint16_t port, const char * clientid, const char * user, const char * password);
+
+
+// Queues a (QoS 0) publish of `len` bytes `payload` on `topic`; returns false (and drops it) when not connected or no room.
+// With `retain` the broker keeps it as the last value of the topic, and hands it to clients that subscribe later.
+bool mqtt_publish(Mqtt * mqtt, const char * topic, const char * payload, int len, bool retain=false);
+
+
+// Progresses the connection and writes the queued packets; call this from loop().
+void mqtt_poll(Mqtt * mqtt);
+
+
+// Returns true when the session is established.
+bool mqtt_up(const Mqtt * mqtt);
+
+
+#endif
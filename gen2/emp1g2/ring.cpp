@@ -0,0 +1,48 @@
+// ring.cpp - Lock-free single-producer/single-consumer byte ring (e.g. from an interrupt to a task)
+
+
+#include <Arduino.h>
+#include "ring.h"
+
+
+void ring_init(Ring * ring, char * buf, uint32_t size) {
+  ring->buf = buf;
+  ring->size = size;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->overruns = 0;
+  ring->highwater = 0;
+}
+
+
+// Runs in the RX interrupt, so it is in IRAM, and copies itself (memcpy may be in flash); it gets at most a FIFO full
+int IRAM_ATTR ring_put(Ring * ring, const char * data, int len) {
+  uint32_t head = ring->head.load(std::memory_order_relaxed);
+  uint32_t tail = ring->tail.load(std::memory_order_acquire);
+  uint32_t room = ring->size - (head-tail);
+  uint32_t n = (uint32_t)len<room ? len : room;
+  for( uint32_t i=0; i<n; i++ ) ring->buf[(head+i) & (ring->size-1)] = data[i];
+  ring->head.store(head+n, std::memory_order_release);
+  if( n<(uint32_t)len ) ring->overruns.store(ring->overruns.load(std::memory_order_relaxed)+len-n, std::memory_order_relaxed);
+  return n;
+}
+
+
+int ring_get(Ring * ring, char * buf, int size) {
+  uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint32_t head = ring->head.load(std::memory_order_acquire);
+  uint32_t fill = head-tail;
+  if( fill>ring->highwater ) ring->highwater = fill;
+  uint32_t n = fill<(uint32_t)size ? fill : size;
+  uint32_t pos = tail & (ring->size-1);
+  uint32_t first = n<ring->size-pos ? n : ring->size-pos;
+  memcpy(buf, ring->buf+pos, first);
+  memcpy(buf+first, ring->buf, n-first);
+  ring->tail.store(tail+n, std::memory_order_release);
+  return n;
+}
+
+
+uint32_t ring_fill(const Ring * ring) {
+  return ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire);
+}
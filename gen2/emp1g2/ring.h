@@ -0,0 +1,43 @@
+// ring.h - Interface to a lock-free single-producer/single-consumer byte ring (e.g. from an interrupt to a task)
+#ifndef _RING_H_
+#define _RING_H_
+
+
+#include <stdint.h>
+#include <atomic>
+
+
+// The producer (e.g. the UART RX interrupt) only writes `head`, the consumer (the parse task) only writes `tail`.
+// Both are free running counters; the ring holds head-tail bytes. A side publishes its counter with a release store
+// after copying the bytes, and reads the other's with an acquire load, so no lock (or interrupt disable) is needed.
+// Bytes that do not fit are dropped (an interrupt can not wait) and counted as overruns.
+// The size must be a power of two.
+
+
+struct Ring {
+  char *                buf;
+  uint32_t              size;      // power of two
+  std::atomic<uint32_t> head;      // bytes put (written by the producer only)
+  std::atomic<uint32_t> tail;      // bytes got (written by the consumer only)
+  std::atomic<uint32_t> overruns;  // bytes dropped because the ring was full (written by the producer only)
+  uint32_t              highwater; // largest fill seen by the consumer
+};
+
+
+// Initialize `ring` on `buf` of `size` bytes (a power of two).
+void     ring_init(Ring * ring, char * buf, uint32_t size);
+
+
+// Producer: copies the `len` bytes of `data` into the ring; returns the number copied (the rest is counted as overrun).
+int      ring_put(Ring * ring, const char * data, int len);
+
+
+// Consumer: copies at most `size` bytes from the ring to `buf`; returns the number copied (0 if empty).
+int      ring_get(Ring * ring, char * buf, int size);
+
+
+// Returns the number of bytes in the ring.
+uint32_t ring_fill(const Ring * ring);
+
+
+#endif
@@ -0,0 +1,235 @@
+// sink.cpp - Non-blocking HTTP sink (keep-alive connection, cached DNS)
+
+
+#include <Arduino.h>
+#include "sink.h"
+
+
+// === CONNECTION ===============================================================================
+
+
+// Makes sure the sink is connected, returns false if that fails
+static bool sink_connect(Sink * sink) {
+  if( sink->client.connected() ) return true;
+  sink->client.stop(); // release the previous connection (if any)
+  // Resolve the host name, unless a recent result is cached
+  if( !sink->ip_valid || millis()-sink->ip_time > SINK_DNS_TTL ) {
+    if( !WiFi.hostByName(sink->host, sink->ip, SINK_DNS_MS) ) {
+      Serial.printf("sink: %s: cannot resolve %s\n", sink->name, sink->host);
+      sink->ip_valid = false;
+      return false;
+    }
+    sink->ip_time = millis();
+    sink->ip_valid = true;
+  }
+  sink->client.setTimeout(SINK_CONNECT_MS);
+  if( !sink->client.connect(sink->ip, sink->port) ) {
+    Serial.printf("sink: %s: cannot connect to %s\n", sink->name, sink->host);
+    sink->ip_valid = false; // maybe the address changed
+    return false;
+  }
+  sink->client.setNoDelay(true);
+  sink->connects++;
+  return true;
+}
+
+
+// Ends the pending request; drops the connection if it can not be reused
+static void sink_done(Sink * sink, bool ok) {
+  if( ok ) sink->requests++; else sink->failures++;
+  if( !ok || sink->close ) sink->client.stop();
+  sink->state = SINK_STATE_IDLE;
+  if( sink->done ) sink->done(sink, ok, sink->ctx);
+}
+
+
+// === RESPONSE =================================================================================
+// The response is parsed just enough to know where it ends (so that the connection can be reused):
+// the status line, the headers Content-Length, Transfer-Encoding and Connection, and the body is skipped.
+// A chunked body ends with its 0 size chunk (and trailer); 1xx, 204 and 304 responses have no body,
+// and a 1xx (e.g. 100 Continue) is followed by the final response. Only without any of these, the end is the close.
+
+
+static void sink_resp_begin(Sink * sink) {
+  sink->linelen = 0;
+  sink->status = 0;
+  sink->inbody = false;
+  sink->bodylen = -1;
+  sink->chunked = false;
+  sink->close = false;
+  sink->complete = false;
+}
+
+
+// Processes one complete header line, or line of a chunked body (without CR LF)
+static void sink_resp_line(Sink * sink) {
+  char * line = sink->line;
+  if( sink->inbody ) {
+    // Chunked body: chunk size (hex, maybe followed by extensions), the CR LF after the data, or trailer
+    if( sink->chunk==SINK_CHUNK_SIZE ) {
+      sink->bodylen = strtol(line, NULL, 16);
+      sink->chunk = sink->bodylen>0 ? SINK_CHUNK_DATA : SINK_CHUNK_TRAILER;
+    } else if( sink->chunk==SINK_CHUNK_END ) {
+      sink->chunk = SINK_CHUNK_SIZE;
+    } else if( sink->chunk==SINK_CHUNK_TRAILER && sink->linelen==0 ) {
+      sink->complete = true;
+    }
+  } else if( sink->status==0 ) {
+    // Status line, e.g. "HTTP/1.1 200 OK"
+    const char * sp = strchr(line,' ');
+    sink->status = sp ? atoi(sp+1) : -1;
+    if( sink->status==0 ) sink->status = -1;
+  } else if( sink->linelen==0 ) {
+    // Empty line ends the header
+    if( sink->status>=100 && sink->status<200 ) { sink_resp_begin(sink); return; } // interim, the final response follows
+    sink->inbody = true;
+    if( sink->status==204 || sink->status==304 ) {
+      sink->complete = true;
+    } else if( sink->chunked ) {
+      sink->chunk = SINK_CHUNK_SIZE;
+    } else if( sink->bodylen<0 ) {
+      sink->close = true; // no length: read until the server closes
+    } else if( sink->bodylen==0 ) {
+      sink->complete = true;
+    }
+  } else if( strncasecmp(line,"Content-Length:",15)==0 ) {
+    sink->bodylen = atoi(line+15);
+  } else if( strncasecmp(line,"Transfer-Encoding:",18)==0 ) {
+    if( strstr(line+18,"chunked") ) sink->chunked = true;
+  } else if( strncasecmp(line,"Connection:",11)==0 ) {
+    if( strstr(line+11,"close") || strstr(line+11,"Close") ) sink->close = true;
+  }
+}
+
+
+// Feeds the received `len` bytes in `buf` to the response parser, returns true when the response is complete
+static bool sink_resp_add(Sink * sink, const char * buf, int len) {
+  for( int i=0; i<len && !sink->complete; i++ ) {
+    if( sink->inbody && (!sink->chunked || sink->chunk==SINK_CHUNK_DATA) ) {
+      // Body data (or chunk data) is skipped
+      if( sink->bodylen<0 ) continue; // until the server closes
+      int n = len-i < sink->bodylen ? len-i : sink->bodylen;
+      sink->bodylen -= n;
+      i += n-1;
+      if( sink->bodylen==0 ) { if( sink->chunked ) sink->chunk = SINK_CHUNK_END; else sink->complete = true; }
+      continue;
+    }
+    char ch = buf[i];
+    if( ch=='\r' ) continue;
+    if( ch=='\n' ) {
+      sink->line[sink->linelen] = '\0';
+      sink_resp_line(sink);
+      sink->linelen = 0;
+    } else if( sink->linelen<SINK_LINE_SIZE-1 ) {
+      sink->line[sink->linelen++] = ch;
+    }
+  }
+  return sink->complete;
+}
+
+
+// === API ======================================================================================
+
+
+void sink_init(Sink * sink, const char * name, const char * host, char * buf, int size, uint16_t port) {
+  sink->name = name;
+  sink->host = host;
+  sink->buf = buf;
+  sink->size = size;
+  sink->port = port;
+  sink->ip_valid = false;
+  sink->state = SINK_STATE_IDLE;
+  sink->requests = 0;
+  sink->connects = 0;
+  sink->failures = 0;
+  sink->latency = NULL;
+  sink->done = NULL;
+  sink->ctx = NULL;
+}
+
+
+char * sink_request(Sink * sink, int * size) {
+  if( sink->state!=SINK_STATE_IDLE ) return NULL;
+  *size = sink->size;
+  return sink->buf;
+}
+
+
+void sink_submit(Sink * sink, int len, uint32_t origin) {
+  if( len>=sink->size ) {
+    Serial.printf("sink: %s: request truncated\n", sink->name);
+    len = sink->size-1;
+  }
+  sink->len = len;
+  sink->sent = 0;
+  sink->time = millis();
+  sink->origin = origin ? origin : sink->time;
+  sink->state = SINK_STATE_SEND;
+}
+
+
+bool sink_busy(const Sink * sink) {
+  return sink->state!=SINK_STATE_IDLE;
+}
+
+
+void sink_poll(Sink * sink) {
+  switch( sink->state ) {
+
+  case SINK_STATE_IDLE:
+    // Discard anything the server sends unasked, and release a connection closed by the server
+    while( sink->client.available() ) sink->client.read();
+    if( sink->ip_valid && !sink->client.connected() ) sink->client.stop();
+    break;
+
+  case SINK_STATE_SEND: {
+    if( sink->sent==0 && !sink_connect(sink) ) { sink_done(sink,false); break; }
+    if( !sink->client.connected() ) {
+      Serial.printf("sink: %s: connection lost\n", sink->name);
+      sink_done(sink,false);
+      break;
+    }
+    // Write as much as the TCP stack accepts now; the request goes out as one buffer
+    int n = sink->len - sink->sent;
+    int room = sink->client.availableForWrite();
+    if( n>room ) n = room;
+    if( n>0 ) sink->sent += sink->client.write((const uint8_t *)sink->buf+sink->sent, n);
+    if( sink->sent==sink->len ) {
+      if( sink->latency ) metrics_hist_add(sink->latency, millis()-sink->origin);
+      sink_resp_begin(sink);
+      sink->state = SINK_STATE_RECV;
+    } else if( millis()-sink->time > SINK_RESPONSE_MS ) {
+      Serial.printf("sink: %s: send timeout\n", sink->name);
+      sink_done(sink,false);
+    }
+    break;
+  }
+
+  case SINK_STATE_RECV: {
+    char buf[64];
+    bool complete = false;
+    int avail;
+    while( !complete && (avail=sink->client.available())>0 ) {
+      int n = sink->client.read((uint8_t *)buf, avail<(int)sizeof buf ? avail : sizeof buf);
+      if( n<=0 ) break;
+      complete = sink_resp_add(sink, buf, n);
+    }
+    // A response without length ends when the server closes the connection
+    if( !complete && sink->inbody && !sink->chunked && sink->bodylen<0 && !sink->client.connected() ) complete = true;
+    if( complete ) {
+      bool ok = sink->status>=200 && sink->status<300;
+      Serial.printf("sink: %s: %s %d (%ums)\n", sink->name, sink->host, sink->status, (unsigned)(millis()-sink->time));
+      sink_done(sink,ok);
+    } else if( !sink->client.connected() && !sink->client.available() ) {
+      Serial.printf("sink: %s: connection closed by %s\n", sink->name, sink->host);
+      sink->close = true;
+      sink_done(sink,false);
+    } else if( millis()-sink->time > SINK_RESPONSE_MS ) {
+      Serial.printf("sink: %s: response timeout\n", sink->name);
+      sink_done(sink,false);
+    }
+    break;
+  }
+
+  }
+}
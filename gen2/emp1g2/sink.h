@@ -0,0 +1,106 @@
+// sink.h - Interface to a non-blocking HTTP sink (keep-alive connection, cached DNS)
+#ifndef _SINK_H_
+#define _SINK_H_
+
+
+#include <ESP8266WiFi.h>
+#include "metrics.h"
+
+
+// A sink sends requests to one server, over a connection that is kept open between requests.
+// Use sink_request() to get the (single, caller supplied) request buffer, fill it, and hand it over with sink_submit().
+// Call sink_poll() from loop(); it connects, writes and reads the response in small steps, without waiting.
+// Two steps do block: resolving the host name (at most SINK_DNS_MS, only when the cached address expired or failed)
+// and the TCP connect (at most SINK_CONNECT_MS). With keep-alive both are rare, but when the server is unreachable
+// every request stalls loop() for up to SINK_DNS_MS+SINK_CONNECT_MS.
+
+
+#define SINK_LINE_SIZE      64   // response header lines are truncated to this size
+#define SINK_DNS_TTL    600000   // ms that a resolved address is cached
+#define SINK_DNS_MS       1000   // ms timeout for resolving the host name (the core's default is 10 s)
+#define SINK_CONNECT_MS   2000   // ms timeout for connect
+#define SINK_RESPONSE_MS  5000   // ms timeout for the (complete) response
+
+
+enum Sink_State {
+  SINK_STATE_IDLE, // no request pending (the connection may be open)
+  SINK_STATE_SEND, // request submitted, (connecting and) writing
+  SINK_STATE_RECV, // request written, reading response
+};
+
+
+// Where the parser is in a chunked response body
+enum Sink_Chunk {
+  SINK_CHUNK_SIZE,    // chunk size line
+  SINK_CHUNK_DATA,    // chunk data (bodylen bytes to come)
+  SINK_CHUNK_END,     // CR LF after the chunk data
+  SINK_CHUNK_TRAILER, // after the last (0 size) chunk: trailer lines up to an empty line
+};
+
+
+struct Sink;
+
+
+// Called when a request completed (`ok` for a 2xx response) or failed, see Sink.done
+typedef void (*Sink_Done)(Sink * sink, bool ok, void * ctx);
+
+
+struct Sink {
+  const char * name;          // for logging
+  const char * host;          // server name (empty string disables the sink)
+  uint16_t     port;
+  WiFiClient   client;
+  // DNS cache
+  IPAddress    ip;
+  uint32_t     ip_time;       // millis() when `ip` was resolved
+  bool         ip_valid;
+  // Request
+  Sink_State   state;
+  char *       buf;           // request buffer
+  int          size;          // size of buf
+  int          len;           // bytes in buf
+  int          sent;          // bytes of buf written
+  uint32_t     time;          // millis() of submit
+  uint32_t     origin;        // millis() of the data in the request (e.g. when the telegram completed)
+  // Response
+  char         line[SINK_LINE_SIZE];
+  int          linelen;
+  int          status;        // HTTP status code (0 if status line not yet received)
+  bool         inbody;        // header done
+  int          bodylen;       // bytes of body (or of the chunk) still to come (-1 if unknown)
+  bool         chunked;       // Transfer-Encoding: chunked
+  Sink_Chunk   chunk;         // chunked body: what comes next
+  bool         close;         // server closes connection after response
+  bool         complete;      // response complete
+  // Statistics
+  uint32_t     requests;      // number of requests completed
+  uint32_t     connects;      // number of connects (with keep-alive this stays low)
+  uint32_t     failures;      // number of failed requests
+  Metrics_Hist * latency;     // if not NULL, gets the ms from `origin` till the request is written
+  Sink_Done    done;          // if not NULL, called (with `ctx`) when a request ends
+  void *       ctx;
+};
+
+
+// Initialize `sink` for server `host` on `port`, with request buffer `buf` of `size` bytes; `name` is used for logging.
+void   sink_init(Sink * sink, const char * name, const char * host, char * buf, int size, uint16_t port=80);
+
+
+// Returns the request buffer (and its `*size`), or NULL when the sink is busy with the previous request.
+char * sink_request(Sink * sink, int * size);
+
+
+// Hands over the `len` bytes written in the request buffer; they are sent by sink_poll().
+// `origin` is the millis() of the data in the request, for the latency histogram (0 means now).
+void   sink_submit(Sink * sink, int len, uint32_t origin=0);
+
+
+// Progresses the pending request (if any); call this from loop().
+void   sink_poll(Sink * sink);
+
+
+// Returns true when a request is pending.
+bool   sink_busy(const Sink * sink);
+
+
+#endif
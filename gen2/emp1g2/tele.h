@@ -3,8 +3,16 @@
 #define _TELE_H_
 
 
+#include <stdint.h>
+#include <stddef.h>
+
+
 // The number of fields registered (in tele.cpp) for extraction by the parser
-#define TELE_NUMFIELDS 16
+#define TELE_NUMFIELDS 17
+
+
+// A set of fields is a mask, bit i is the field with index i (so TELE_NUMFIELDS may not exceed 32)
+#define TELE_FIELDS_ALL ( (uint32_t)((1ULL<<TELE_NUMFIELDS)-1) )
 
 
 // The add() function will return the abstract state of the parser
@@ -15,20 +23,107 @@ enum Tele_Result {
 };
 
 
-// Initialize this module
-void         tele_init();
+// The type of a field value. Numeric values are decoded by the parser (once, while copying the value).
+enum Tele_Type {
+  TELE_TYPE_STRING, // value is only available as string (not decoded), e.g. an equipment id; no field in tele_fields[] uses it now
+  TELE_TYPE_MILLI,  // value has (up to) three decimals, available as integer in milli units, e.g. "019235.878" kWh is 19235878 Wh
+  TELE_TYPE_INT,    // value is an integer, e.g. a counter "00020" is 20
+  TELE_TYPE_TIME,   // value is a time stamp, available as integer in seconds since 2000-01-01 00:00:00 UTC, e.g. "220605191342S" is 707764422
+};
+
+
+// Initialize this module; the default parser only extracts (and has storage for) the fields in mask `fields`
+void         tele_init(uint32_t fields=TELE_FIELDS_ALL);
 
 
 // Feed the parser characters (from Serial), type is int because it needs feeding -1 for no-char received. This function tracks time.
 Tele_Result  tele_parser_add(int ch);
 
 
+// Feed the parser all `len` characters in `buf` (e.g. everything Serial has available), feed 0 chars when none received.
+// Returns the number of telegrams that became available; the number of errors is added to `*errors` (if not NULL).
+int          tele_parser_add_buf(const char * buf, size_t len, int * errors=NULL);
+
+
+// The functions above use one default parser. For more meters (e.g. sub-meters on other UARTs) create a parser per meter.
+// Each has its own state and snapshots; parsers share no mutable state, so they may run on different threads.
+// A parser only extracts (and requires) the fields in its mask, e.g. tele_fields_mask("PpG"); other values stay empty.
+class Tele_Parser;
+struct Tele_Snapshot;
+uint32_t     tele_fields_mask(const char * keys); // mask of the fields with the given keys (see tele_field_key())
+Tele_Parser *tele_parser_new(uint32_t fields=TELE_FIELDS_ALL);
+void         tele_parser_delete(Tele_Parser * parser);
+Tele_Result  tele_parser_add(Tele_Parser * parser, int ch);
+int          tele_parser_add_buf(Tele_Parser * parser, const char * buf, size_t len, int * errors=NULL);
+const Tele_Snapshot * tele_parser_snapshot(const Tele_Parser * parser); // the last published telegram of `parser`
+
+
 // Once the parser's add() returns TELE_RESULT_AVAILABLE, the fields are available.
-// Note 0 <= ix < TELE_NUMFIELDS
-const char   tele_field_key(int ix);
+// They stay available (from the last good telegram) while the parser collects the next one.
+// The values are those of the default parser; for other parsers use tele_parser_snapshot().
+// Note 0 <= ix < TELE_NUMFIELDS; fields that are not selected (see tele_init()) have an empty value.
+bool         tele_field_selected(int ix);
+char         tele_field_key(int ix);
 const char * tele_field_name(int ix);
 const char * tele_field_description(int ix);
+const char * tele_field_obis(int ix);
 const char * tele_field_value(int ix);
+Tele_Type    tele_field_type(int ix);
+int32_t      tele_field_milli(int ix); // value of a TELE_TYPE_MILLI field in milli units (0 for other types)
+int32_t      tele_field_int(int ix);   // value of a TELE_TYPE_INT or TELE_TYPE_TIME field (0 for other types)
+
+
+// The tokenizer passes every obis object of every telegram, group by group, to a callback (besides extracting the fields).
+// E.g. "0-1:24.2.1(220605190000S)(16051.816*m3)" gives group 0 value "220605190000S" and group 1 value "16051.816" unit "m3".
+// The spans are not zero terminated. They point into the buffer passed to tele_parser_add_buf() when the group is 
+// completely in there, otherwise into a scratch buffer (then a value may be truncated, see `truncated`).
+// Tokens are passed as they arrive; only when the parser returns TELE_RESULT_AVAILABLE the telegram's CRC is known to match.
+struct Tele_Token {
+  const char * obis;  // obis code of the object, e.g. "0-1:24.2.1" (zero terminated)
+  int          group; // index of the group in the object (0, 1, ...)
+  const char * value; // the value (up to '*' or ')')
+  int          vlen;
+  const char * unit;  // the unit (after '*', empty if none)
+  int          ulen;
+  bool         truncated; // the group was too long for the scratch buffer
+};
+typedef void (*Tele_Token_Fn)(const Tele_Token * token, void * ctx);
+void         tele_tokenize(Tele_Token_Fn fn, void * ctx); // for the default parser, pass NULL to stop
+void         tele_parser_tokenize(Tele_Parser * parser, Tele_Token_Fn fn, void * ctx);
+
+
+// Each parser counts what it has seen (since tele_init() or tele_parser_new()), e.g. for monitoring
+struct Tele_Stats {
+  uint32_t bytes;     // bytes received
+  uint32_t telegrams; // telegrams available (published)
+  uint32_t crc;       // telegrams with a CRC mismatch
+  uint32_t missing;   // telegrams with a missing field
+  uint32_t syntax;    // telegrams with a syntax error (header, body line, csum line)
+  uint32_t timeouts;  // timeouts (no data for TELE_MAXWAIT_MS)
+  uint32_t noise;     // bursts of bytes received outside a telegram
+  uint32_t discarded; // bytes received outside a telegram
+  uint32_t unchanged; // body lines of registered fields skipped, because their value was equal to the previous telegram's
+};
+const Tele_Stats * tele_stats(); // of the default parser
+const Tele_Stats * tele_parser_stats(const Tele_Parser * parser);
+
+
+// Identifies the field table (a hash of the key, obis code and type of all fields), e.g. for binary encodings
+uint16_t     tele_schema();
+
+
+// A snapshot holds the field values of one complete telegram (with matching CRC).
+// The parser fills a second (back) snapshot, and swaps them when that telegram is complete and correct.
+// A snapshot stays intact until the parser starts on the telegram after the next one.
+// A reader that holds it longer can check that tele_snapshot_seq() did not change (it is 0 while being overwritten).
+const Tele_Snapshot * tele_snapshot(); // the last published telegram (of the default parser)
+uint32_t     tele_snapshot_seq  (const Tele_Snapshot * snap); // sequence number of the telegram (1, 2, ...), 0 if none (yet)
+uint32_t     tele_snapshot_time (const Tele_Snapshot * snap); // millis() when the telegram was published
+uint32_t     tele_snapshot_changed(const Tele_Snapshot * snap); // mask of the fields that changed since the previous telegram (all for the first)
+const char * tele_snapshot_value(const Tele_Snapshot * snap, int ix);
+int32_t      tele_snapshot_milli(const Tele_Snapshot * snap, int ix);
+int32_t      tele_snapshot_int  (const Tele_Snapshot * snap, int ix);
+int32_t      tele_snapshot_num  (const Tele_Snapshot * snap, int ix); // decoded value of any numeric type (0 for TELE_TYPE_STRING)
 
 
 
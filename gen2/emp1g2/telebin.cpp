@@ -0,0 +1,133 @@
+// telebin.cpp - Compact binary encoding of telegrams, for uplink and storage
+
+
+#include <string.h>
+#include "telebin.h"
+#include "crc16.h"
+
+
+// === VARINT ====================================================================================
+
+
+static uint32_t telebin_zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+
+static int32_t telebin_unzigzag(uint32_t u) {
+  return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+
+// Appends `u` as varint to `buf` at `*pos` (if it fits in `size`, otherwise sets `*pos` beyond `size`)
+static void telebin_put(uint8_t * buf, size_t size, size_t * pos, uint32_t u) {
+  do {
+    uint8_t b = u & 0x7F;
+    u >>= 7;
+    if( u ) b |= 0x80;
+    if( *pos<size ) buf[*pos] = b;
+    (*pos)++;
+  } while( u );
+}
+
+
+// Reads a varint from `buf` at `*pos` (`len` bytes available) into `*u`. Returns false if truncated or too long.
+static bool telebin_get(const uint8_t * buf, size_t len, size_t * pos, uint32_t * u) {
+  *u = 0;
+  for( int shift=0; shift<35; shift+=7 ) {
+    if( *pos>=len ) return false;
+    uint8_t b = buf[(*pos)++];
+    *u |= (uint32_t)(b & 0x7F) << shift;
+    if( !(b & 0x80) ) return true;
+  }
+  return false;
+}
+
+
+// === FRAME =====================================================================================
+// Deltas are computed modulo 2^32, so that they can never overflow.
+
+
+void telebin_reset(Telebin_State * st) {
+  memset(st, 0, sizeof *st);
+}
+
+
+size_t telebin_encode(Telebin_State * st, uint16_t schema, int32_t time, const int32_t * values, int num, uint8_t * buf, size_t size) {
+  if( num>TELEBIN_MAXFIELDS || size<6 ) return 0;
+  bool key = !st->valid;
+  int32_t prevtime = key ? 0 : st->time;
+  // Header
+  buf[0] = TELEBIN_VERSION;
+  buf[1] = key ? TELEBIN_FLAG_KEY : 0;
+  buf[2] = schema & 0xFF;
+  buf[3] = schema >> 8;
+  size_t pos = 4;
+  telebin_put(buf, size, &pos, telebin_zigzag( (int32_t)((uint32_t)time - (uint32_t)prevtime) ));
+  // Mask of changed fields
+  uint32_t mask = 0;
+  for( int i=0; i<num; i++ ) {
+    int32_t prev = key ? 0 : st->values[i];
+    if( values[i]!=prev ) mask |= 1UL << i;
+  }
+  telebin_put(buf, size, &pos, mask);
+  // Deltas
+  for( int i=0; i<num; i++ ) {
+    if( !(mask & (1UL<<i)) ) continue;
+    int32_t prev = key ? 0 : st->values[i];
+    telebin_put(buf, size, &pos, telebin_zigzag( (int32_t)((uint32_t)values[i] - (uint32_t)prev) ));
+  }
+  // CRC
+  if( pos+2>size ) return 0;
+  uint16_t crc = crc16_update(CRC16_INIT, buf, pos);
+  buf[pos++] = crc & 0xFF;
+  buf[pos++] = crc >> 8;
+  // Update state
+  st->valid = true;
+  st->time = time;
+  memset(st->values, 0, sizeof st->values);
+  memcpy(st->values, values, num*sizeof(int32_t));
+  return pos;
+}
+
+
+size_t telebin_decode(Telebin_State * st, const uint8_t * buf, size_t len, uint16_t * schema, int32_t * time, int32_t * values, int num) {
+  if( num>TELEBIN_MAXFIELDS || len<6 ) return 0;
+  if( buf[0]!=TELEBIN_VERSION ) return 0;
+  bool key = buf[1] & TELEBIN_FLAG_KEY;
+  if( !key && !st->valid ) return 0;
+  size_t pos = 4;
+  uint32_t u;
+  // Time
+  if( !telebin_get(buf, len, &pos, &u) ) return 0;
+  int32_t t = (int32_t)((uint32_t)(key ? 0 : st->time) + (uint32_t)telebin_unzigzag(u));
+  // Mask
+  uint32_t mask;
+  if( !telebin_get(buf, len, &pos, &mask) ) return 0;
+  if( num<TELEBIN_MAXFIELDS && (mask >> num)!=0 ) return 0; // frame has more fields than expected
+  // Deltas
+  int32_t vals[TELEBIN_MAXFIELDS];
+  for( int i=0; i<num; i++ ) {
+    int32_t prev = key ? 0 : st->values[i];
+    if( mask & (1UL<<i) ) {
+      if( !telebin_get(buf, len, &pos, &u) ) return 0;
+      vals[i] = (int32_t)((uint32_t)prev + (uint32_t)telebin_unzigzag(u));
+    } else {
+      vals[i] = prev;
+    }
+  }
+  // CRC
+  if( pos+2>len ) return 0;
+  uint16_t crc = crc16_update(CRC16_INIT, buf, pos);
+  if( buf[pos]!=(crc & 0xFF) || buf[pos+1]!=(crc >> 8) ) return 0;
+  pos += 2;
+  // Commit
+  *schema = buf[2] | (buf[3]<<8);
+  *time = t;
+  memcpy(values, vals, num*sizeof(int32_t));
+  st->valid = true;
+  st->time = t;
+  memset(st->values, 0, sizeof st->values);
+  memcpy(st->values, vals, num*sizeof(int32_t));
+  return pos;
+}
@@ -0,0 +1,54 @@
+// telebin.h - Interface to a compact binary encoding of telegrams, for uplink and storage
+#ifndef _TELEBIN_H_
+#define _TELEBIN_H_
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// A frame encodes the (numeric) field values of one telegram, as deltas against the previous frame.
+// Successive telegrams mostly differ in a few watts, so a frame is typically some 20 bytes (instead of 250 for a text post).
+//   u8      version, TELEBIN_VERSION
+//   u8      flags, TELEBIN_FLAG_KEY when there is no previous frame (deltas are against 0)
+//   u16     schema id (little endian), identifies the field table, see tele_schema()
+//   varint  zigzag(time - previous time), time in seconds since 2000-01-01 UTC
+//   varint  bit mask of the fields that changed (bit i for field i)
+//   varint  zigzag(value - previous value), for each changed field, in field order
+//   u16     CRC16 (little endian) over all previous bytes of the frame
+// A varint stores 7 bits per byte, least significant first, bit 7 set on all but the last byte.
+// Zigzag maps signed to unsigned (0,-1,1,-2,.. to 0,1,2,3,..) so that small negative deltas are small too.
+// Frames can be concatenated; the decoder returns the length of each frame.
+// telebin.cpp has no Arduino dependencies, so the decoder can be compiled as is on a host.
+
+
+#define TELEBIN_VERSION     1
+#define TELEBIN_FLAG_KEY    0x01
+#define TELEBIN_MAXFIELDS   32
+#define TELEBIN_FRAME_SIZE  (4 + 5 + 5 + 5*TELEBIN_MAXFIELDS + 2) // worst case frame size
+
+
+// The state of an encoder or decoder: the previous frame.
+// Encoder and decoder must see the same frames; start both (e.g. after a reconnect) with telebin_reset(), the next frame is a key frame.
+struct Telebin_State {
+  bool    valid;                      // false if there is no previous frame
+  int32_t time;                       // time of the previous frame
+  int32_t values[TELEBIN_MAXFIELDS];  // field values of the previous frame
+};
+
+
+// Forgets the previous frame, so that the next encoded frame is a key frame (and the decoder expects one).
+void telebin_reset(Telebin_State * st);
+
+
+// Encodes `num` field `values` and `time` into `buf` (of `size` bytes), and updates `st`.
+// Returns the frame length, or 0 if it does not fit in `size` (`st` is then not updated).
+size_t telebin_encode(Telebin_State * st, uint16_t schema, int32_t time, const int32_t * values, int num, uint8_t * buf, size_t size);
+
+
+// Decodes the frame at the start of `buf` (with `len` bytes available) into `schema`, `time` and `num` field `values`, and updates `st`.
+// Returns the frame length, or 0 on error (truncated, CRC mismatch, unknown version, delta frame without previous frame).
+size_t telebin_decode(Telebin_State * st, const uint8_t * buf, size_t len, uint16_t * schema, int32_t * time, int32_t * values, int num);
+
+
+#endif
@@ -0,0 +1,189 @@
+// tmpl.cpp - Precompiled substitution templates
+
+
+#include <Arduino.h>
+#include "tele.h"
+#include "tmpl.h"
+#include "agg.h"
+
+
+// === VALUES ===================================================================================
+// A value is printed as the text of the field in the telegram, without leading zeros (a zero before a dot is kept,
+// unless the dot is dropped too), byte for byte as the templates were always substituted: "%.x" on "00.000" is "000".
+// Aggregates are printed as if they were a value of the field: with as many decimals as the field has in the telegram.
+// The count is printed as integer. Aggregates are empty while there is no closed interval.
+
+
+// No printed value is longer than this (field values are short, see TELE_VALUE_SIZE, an int32 has at most 11 chars)
+#define TMPL_VALMAX 16
+
+
+// Returns the start of `s` without leading zeros (a zero before a dot or at the end is kept, unless `skipdot`)
+static const char * tmpl_strip(const char * s, bool skipdot) {
+  while( *s=='0' && ( isdigit(*(s+1)) || (skipdot && *(s+1)=='.') ) ) s++;
+  return s;
+}
+
+
+// Returns the text of value `op` (`raw` is scratch of TMPL_VALMAX chars), or NULL if there is none (no closed interval)
+static const char * tmpl_text(const Tmpl_Op * op, char * raw) {
+  if( !op->fn ) return tele_field_value(op->ix);
+  int32_t val;
+  if( !agg_value(op->fn, op->fn==AGG_FN_COUNT ? '\0' : tele_field_key(op->ix), &val) ) return NULL;
+  if( op->fn==AGG_FN_COUNT || tele_field_type(op->ix)!=TELE_TYPE_MILLI ) { snprintf(raw, TMPL_VALMAX, "%d", (int)val); return raw; }
+  // Milli units, with the decimals of the field (e.g. 3 for "00.586" kW)
+  const char * dot = strchr(tele_field_value(op->ix), '.');
+  int decimals = dot==NULL ? 0 : strlen(dot+1);
+  if( decimals>3 ) decimals = 3;
+  uint32_t u = val<0 ? -(uint32_t)val : val;
+  uint32_t scale = decimals==0 ? 1000 : decimals==1 ? 100 : decimals==2 ? 10 : 1;
+  if( decimals==0 ) snprintf(raw, TMPL_VALMAX, "%s%u", val<0?"-":"", (unsigned)(u/1000));
+  else snprintf(raw, TMPL_VALMAX, "%s%u.%0*u", val<0?"-":"", (unsigned)(u/1000), decimals, (unsigned)(u%1000/scale));
+  return raw;
+}
+
+
+// Returns the printed length of value `op`
+static int tmpl_vallen(const Tmpl_Op * op) {
+  char raw[TMPL_VALMAX];
+  const char * r = tmpl_text(op, raw);
+  if( r==NULL ) return 0;
+  int len = 0;
+  for( r=tmpl_strip(r,op->skipdot); *r!='\0'; r++ ) len += *r!='.' || !op->skipdot;
+  return len;
+}
+
+
+// Prints value `op` to `buf`, which must have room for tmpl_vallen() chars; returns the number of chars
+static int tmpl_valcpy(char * buf, const Tmpl_Op * op) {
+  char raw[TMPL_VALMAX];
+  const char * r = tmpl_text(op, raw);
+  if( r==NULL ) return 0;
+  char * w = buf;
+  for( r=tmpl_strip(r,op->skipdot); *r!='\0'; r++ ) if( *r!='.' || !op->skipdot ) *w++ = *r;
+  return w-buf;
+}
+
+
+// === COMPILE ==================================================================================
+
+
+// Appends literal `lit` of `len` chars, merging it with the previous op when they are adjacent
+static bool tmpl_lit(Tmpl * tmpl, const char * lit, int len) {
+  if( len==0 ) return true;
+  Tmpl_Op * prev = tmpl->num>0 ? &tmpl->ops[tmpl->num-1] : NULL;
+  if( prev!=NULL && prev->lit!=NULL && prev->lit+prev->len==lit ) { prev->len += len; return true; }
+  if( tmpl->num==TMPL_MAXOPS ) return false;
+  Tmpl_Op * op = &tmpl->ops[tmpl->num++];
+  op->ix = -1;
+  op->len = len;
+  op->lit = lit;
+  op->skipdot = false;
+  op->fn = 0;
+  return true;
+}
+
+
+bool tmpl_compile(Tmpl * tmpl, const char * fmt) {
+  tmpl->num = 0;
+  const char * r = fmt;
+  while( *r!='\0' ) {
+    // Plain characters up to next %
+    const char * lit = r;
+    while( *r!='\0' && *r!='%' ) r++;
+    if( !tmpl_lit(tmpl, lit, r-lit) ) return false;
+    if( *r=='\0' ) break;
+    // Escape character (%), optional modifier (.), optional aggregate function and key (none for the count)
+    const char * esc = r++;
+    bool skipdot = *r=='.';
+    if( skipdot ) r++;
+    char fn = agg_isfn(*r) ? *r : 0;
+    if( fn ) r++;
+    char key = fn==AGG_FN_COUNT ? '\0' : *r;
+    if( key!='\0' ) r++;
+    int ix = -1;
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+      if( tele_field_key(i) == key ) { ix=i; break; }
+    }
+    if( fn && fn!=AGG_FN_COUNT && !agg_haskey(key) ) ix = -1; // not aggregated
+    if( ix<0 && fn!=AGG_FN_COUNT ) {
+      // Key not found, it is copied: "%x" stays "%x", "%%" becomes "%", "%.x" becomes "%."
+      // With an aggregate function, the key is copied too: "%<x" stays "%<x"
+      int len = fn ? 2+skipdot : skipdot ? 2 : key=='%' || key=='\0' ? 1 : 2;
+      if( !tmpl_lit(tmpl, esc, len) ) return false;
+      if( fn && key!='\0' ) r--; // the key is copied as literal
+    } else {
+      if( tmpl->num==TMPL_MAXOPS ) return false;
+      Tmpl_Op * op = &tmpl->ops[tmpl->num++];
+      op->ix = ix;
+      op->len = 0;
+      op->lit = NULL;
+      op->skipdot = skipdot;
+      op->fn = fn;
+    }
+  }
+  return true;
+}
+
+
+uint32_t tmpl_fields(const Tmpl * tmpl) {
+  uint32_t fields = 0;
+  for( int i=0; i<tmpl->num; i++ ) if( tmpl->ops[i].ix>=0 ) fields |= 1UL<<tmpl->ops[i].ix;
+  return fields;
+}
+
+
+bool tmpl_aggregates(const Tmpl * tmpl) {
+  for( int i=0; i<tmpl->num; i++ ) if( tmpl->ops[i].fn ) return true;
+  return false;
+}
+
+
+// === RENDER ===================================================================================
+
+
+int tmpl_length(const Tmpl * tmpl) {
+  int len = 0;
+  for( int i=0; i<tmpl->num; i++ ) {
+    const Tmpl_Op * op = &tmpl->ops[i];
+    len += op->lit!=NULL ? op->len : tmpl_vallen(op);
+  }
+  return len;
+}
+
+
+int tmpl_render(const Tmpl * tmpl, char * buf, int size) {
+  char * w = buf;
+  char * end = buf+size-1; // room for terminating zero
+  for( int i=0; i<tmpl->num; i++ ) {
+    const Tmpl_Op * op = &tmpl->ops[i];
+    if( op->lit!=NULL ) {
+      int n = op->len < end-w ? op->len : end-w;
+      memcpy(w, op->lit, n);
+      w += n;
+    } else if( end-w >= TMPL_VALMAX ) {
+      w += tmpl_valcpy(w, op);
+    } else {
+      // Near the end of buf: print to scratch, and copy what fits
+      char val[TMPL_VALMAX];
+      int n = tmpl_valcpy(val, op);
+      if( n>end-w ) n = end-w;
+      memcpy(w, val, n);
+      w += n;
+    }
+  }
+  *w = '\0';
+  return w-buf;
+}
+
+
+
+int tmpl_field(char * buf, int size, int ix, bool skipdot) {
+  Tmpl_Op op = { (int16_t)ix, 0, NULL, skipdot, 0 };
+  char val[TMPL_VALMAX];
+  int n = tmpl_valcpy(val, &op);
+  if( n>size-1 ) n = size-1;
+  memcpy(buf, val, n);
+  buf[n] = '\0';
+  return n;
+}
@@ -0,0 +1,62 @@
+// tmpl.h - Interface to precompiled substitution templates (e.g. "field1=%L&field2=%.P")
+#ifndef _TMPL_H_
+#define _TMPL_H_
+
+
+#include <stdint.h>
+
+
+// A template is a string with "%x" thingies, where x is a key registered in tele_fields[]; "%.x" drops the decimal point.
+// An aggregate function between % and the key gives the value over the last closed interval (see agg.h):
+// "%<x" min, "%>x" max, "%~x" mean, "%+x" increase (e.g. kWh), and "%#" the number of telegrams, e.g. "%.~P".
+// tmpl_compile() parses the template once, into a list of literal spans and field references.
+// tmpl_render() then makes one pass, substituting the values of the last telegram.
+// Since tmpl_length() gives the exact length up front, a Content-Length can be written before the body.
+
+
+#define TMPL_MAXOPS 48
+
+
+struct Tmpl_Op {
+  int16_t      ix;      // index of the field in tele_fields[], or -1 for a literal (or the count)
+  uint16_t     len;     // length of the literal
+  const char * lit;     // start of the literal (points into the template string), NULL for a value
+  bool         skipdot; // field is printed without decimal point
+  char         fn;      // aggregate function (see Agg_Fn), 0 for the value of the last telegram
+};
+
+
+struct Tmpl {
+  Tmpl_Op      ops[TMPL_MAXOPS];
+  int          num;     // number of ops in use
+};
+
+
+// Compiles `fmt` into `tmpl`. The `fmt` string must remain valid (literals are not copied).
+// Returns false if the template has too many ops (the remainder is dropped).
+bool tmpl_compile(Tmpl * tmpl, const char * fmt);
+
+
+// Returns the mask of the fields `tmpl` refers to (see tele_fields_mask()), also those it aggregates.
+uint32_t tmpl_fields(const Tmpl * tmpl);
+
+
+// Returns true if `tmpl` uses an aggregate function.
+bool tmpl_aggregates(const Tmpl * tmpl);
+
+
+// Returns the exact length of tmpl_render() for the last telegram (excluding terminating zero).
+int  tmpl_length(const Tmpl * tmpl);
+
+
+// Renders `tmpl` with the values of the last telegram into `buf` (of `size`, zero terminated, truncated if needed).
+// Returns the number of chars written (excluding terminating zero).
+int  tmpl_render(const Tmpl * tmpl, char * buf, int size);
+
+
+// Prints the value of field `ix` of the last telegram into `buf` (of `size`, zero terminated), as "%x" would.
+// Returns the number of chars written (excluding terminating zero).
+int  tmpl_field(char * buf, int size, int ix, bool skipdot=false);
+
+
+#endif
@@ -0,0 +1,98 @@
+// Arduino.h - Host stand-in for the parts of the ESP8266 Arduino core that the sketches and modules use
+#ifndef _ARDUINO_H_
+#define _ARDUINO_H_
+
+
+// This header replaces <Arduino.h> when the sketches and modules are compiled for the host (see CMakeLists.txt).
+// It only covers what the gen2 code uses. The clock is the real (monotonic) clock, but delay() does not sleep:
+// it moves millis() forward, so that tests with timeouts run fast and still see the time pass.
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <string>
+
+
+// === CORE =====================================================================================
+
+
+#define PROGMEM
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define ARDUINO                  10819
+#define ARDUINO_ESP8266_RELEASE  "host"
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+
+// Time in ms since start; advances with the real clock and with every delay()
+uint32_t millis();
+// Time in us since start (real clock only, for benchmarks)
+uint32_t micros();
+// Does not sleep, but advances millis() by `ms`
+void delay(uint32_t ms);
+void yield();
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+
+
+// === UART =====================================================================================
+// The sketches poke the UART0 registers to invert RX; on the host that goes to a dummy.
+
+
+extern uint32_t host_uart_reg;
+#define UART0       0
+#define USC0(u)     host_uart_reg
+#define BIT(n)      (1UL<<(n))
+#define UCRXI       19
+#define SERIAL_8N1  0x1c
+#define SERIAL_FULL 0
+
+
+// Serial writes to stdout, and reads what the test fed with host_feed()
+struct HardwareSerial {
+  void   begin(unsigned long baud, int config=SERIAL_8N1, int mode=SERIAL_FULL);
+  size_t setRxBufferSize(size_t size) { return size; }
+  bool   hasOverrun() { return false; }
+  bool   hasRxError() { return false; }
+  int    available();
+  int    read();
+  size_t read(char * buf, size_t size);
+  size_t readBytes(char * buf, size_t size) { return read(buf,size); }
+  void   flush() { fflush(stdout); }
+  int    printf(const char * format, ...) __attribute__((format(printf,2,3)));
+  explicit operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+
+// Makes `len` bytes of `data` available to Serial.read(); the bytes are copied
+void host_feed(const char * data, size_t len);
+// When set, Serial.printf() prints nothing (for benchmarks and stress tests)
+extern bool host_quiet;
+
+
+// === STRING ===================================================================================
+
+
+struct String {
+  std::string s;
+  String() {}
+  String(const char * c) : s(c) {}
+  String(int v) : s(std::to_string(v)) {}
+  const char * c_str() const { return s.c_str(); }
+  size_t length() const { return s.size(); }
+  long toInt() const { return atol(s.c_str()); }
+  String operator+(const String & o) const { String r; r.s = s+o.s; return r; }
+  bool operator==(const char * c) const { return s==c; }
+};
+
+
+#endif
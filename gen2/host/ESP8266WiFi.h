@@ -0,0 +1,80 @@
+// ESP8266WiFi.h - Host stand-in for the ESP8266 WiFi library: the station is always connected, clients are real sockets
+#ifndef _ESP8266WIFI_H_
+#define _ESP8266WIFI_H_
+
+
+#include <Arduino.h>
+
+
+// === IPADDRESS ================================================================================
+
+
+struct IPAddress {
+  uint8_t b[4];
+  IPAddress() : b{0,0,0,0} {}
+  IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) : b{b0,b1,b2,b3} {}
+  uint8_t operator[](int i) const { return b[i]; }
+  bool isSet() const { return b[0]|b[1]|b[2]|b[3]; }
+  String toString() const;
+};
+
+
+// === WIFI =====================================================================================
+
+
+#define WIFI_STA      1
+#define WL_CONNECTED  3
+
+
+struct ESP8266WiFiClass {
+  void      hostname(const char *) {}
+  void      mode(int) {}
+  void      begin(const char *, const char *) {}
+  int       status() { return WL_CONNECTED; }
+  IPAddress localIP() { return IPAddress(127,0,0,1); }
+  // Resolves with the host resolver (which does not time out); `timeout_ms` is recorded for the tests
+  int       hostByName(const char * host, IPAddress & ip, uint32_t timeout_ms=10000);
+};
+extern ESP8266WiFiClass WiFi;
+
+// Number of hostByName() calls, and the timeout passed in the last one
+extern int      host_dns_lookups;
+extern uint32_t host_dns_timeout;
+
+
+struct EspClass {
+  uint32_t getChipId() { return 0x00ABCDEF; }
+};
+extern EspClass ESP;
+
+
+// === CLIENT ===================================================================================
+// A TCP client on a non-blocking socket. Like on the ESP8266, only connect() waits (at most the timeout),
+// write() takes what fits in the socket buffer, and connected() stays true while received data is unread.
+
+
+class WiFiClient {
+public:
+  WiFiClient() : _fd(-1), _timeout(5000) {}
+  ~WiFiClient() { stop(); }
+  WiFiClient(const WiFiClient &) = delete;
+  WiFiClient & operator=(const WiFiClient &) = delete;
+  int    connect(IPAddress ip, uint16_t port);
+  int    connect(const char * host, uint16_t port);
+  uint8_t connected();
+  int    available();
+  int    availableForWrite();
+  int    read();
+  int    read(uint8_t * buf, size_t size);
+  size_t write(const uint8_t * buf, size_t size);
+  void   stop();
+  void   setTimeout(uint32_t ms) { _timeout = ms; }
+  void   setNoDelay(bool nodelay);
+  explicit operator bool() { return connected(); }
+private:
+  int      _fd;
+  uint32_t _timeout;
+};
+
+
+#endif
@@ -0,0 +1,62 @@
+// LittleFS.h - Host stand-in for LittleFS: the files live in a directory of the host
+#ifndef _LITTLEFS_H_
+#define _LITTLEFS_H_
+
+
+#include <Arduino.h>
+#include <vector>
+
+
+// Paths are taken relative to host_fs_root, which the test sets (to a fresh directory) before begin().
+// Only what the gen2 modules use is covered. The writes are counted, so a test can see the flash traffic.
+
+
+extern std::string host_fs_root;
+extern uint32_t    host_fs_writes; // number of write() calls
+extern uint32_t    host_fs_bytes;  // bytes written
+
+
+class File {
+public:
+  File() : _f(NULL) {}
+  explicit File(FILE * f) : _f(f) {}
+  File(File && o) : _f(o._f) { o._f = NULL; }
+  File & operator=(File && o) { close(); _f = o._f; o._f = NULL; return *this; }
+  ~File() { close(); }
+  size_t write(const uint8_t * buf, size_t size);
+  int    read(uint8_t * buf, size_t size) { return fread(buf, 1, size, _f); }
+  bool   seek(uint32_t pos) { return fseek(_f, pos, SEEK_SET)==0; }
+  size_t size();
+  void   close() { if( _f ) fclose(_f); _f = NULL; }
+  explicit operator bool() const { return _f!=NULL; }
+private:
+  FILE * _f;
+};
+
+
+class Dir {
+public:
+  bool   next() { return ++_ix < (int)_names.size(); }
+  String fileName() { return String(_names[_ix].c_str()); }
+  size_t fileSize() { return _sizes[_ix]; }
+private:
+  friend class FS;
+  std::vector<std::string> _names;
+  std::vector<size_t>      _sizes;
+  int                      _ix = -1;
+};
+
+
+class FS {
+public:
+  bool begin();
+  bool exists(const char * path);
+  bool mkdir(const char * path);
+  bool remove(const char * path);
+  File open(const char * path, const char * mode);
+  Dir  openDir(const char * path);
+};
+extern FS LittleFS;
+
+
+#endif
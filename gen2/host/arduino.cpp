@@ -0,0 +1,88 @@
+// arduino.cpp - Host stand-in for the parts of the ESP8266 Arduino core that the sketches and modules use
+
+
+#include <chrono>
+#include <string>
+#include "Arduino.h"
+
+
+// === CORE =====================================================================================
+
+
+static const std::chrono::steady_clock::time_point host_start = std::chrono::steady_clock::now();
+static uint32_t host_delayed; // ms that delay() added to the clock
+
+
+static uint64_t host_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-host_start).count();
+}
+
+
+uint32_t millis() {
+  return (uint32_t)(host_us()/1000) + host_delayed;
+}
+
+
+uint32_t micros() {
+  return (uint32_t)host_us();
+}
+
+
+void delay(uint32_t ms) {
+  host_delayed += ms;
+}
+
+
+void yield() {
+}
+
+
+// === UART =====================================================================================
+
+
+uint32_t       host_uart_reg;
+HardwareSerial Serial;
+bool           host_quiet;
+static std::string host_rx;     // bytes fed, not yet read
+static size_t      host_rxpos;
+
+
+void HardwareSerial::begin(unsigned long, int, int) {
+}
+
+
+int HardwareSerial::available() {
+  return host_rx.size()-host_rxpos;
+}
+
+
+int HardwareSerial::read() {
+  if( host_rxpos==host_rx.size() ) return -1;
+  return (uint8_t)host_rx[host_rxpos++];
+}
+
+
+size_t HardwareSerial::read(char * buf, size_t size) {
+  size_t n = host_rx.size()-host_rxpos;
+  if( n>size ) n = size;
+  memcpy(buf, host_rx.data()+host_rxpos, n);
+  host_rxpos += n;
+  return n;
+}
+
+
+int HardwareSerial::printf(const char * format, ...) {
+  if( host_quiet ) return 0;
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+
+void host_feed(const char * data, size_t len) {
+  host_rx.erase(0, host_rxpos);
+  host_rxpos = 0;
+  host_rx.append(data, len);
+}
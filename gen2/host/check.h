@@ -0,0 +1,40 @@
+// check.h - Interface to the checks of the host tests (one test program per module, see CMakeLists.txt)
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+
+#include <stdio.h>
+
+
+// Each check prints a line "test: <name> pass|FAIL <info>"; the program ends with check_done(), which prints the
+// number of failed checks and returns the exit code for ctest. Printing goes to stdout directly (not via Serial),
+// so the checks are also printed when host_quiet is set, and programs without the Arduino stand-in can use them.
+
+
+static int check_fails; // number of failed checks
+
+
+// Checks `pass` for test `name`; `fmt` (with up to two ints `a` and `b`) adds info, e.g. "(%d of %d)"
+static inline void check(const char * name, bool pass, const char * fmt="", int a=0, int b=0) {
+  char info[80];
+  snprintf(info, sizeof info, fmt, a, b);
+  printf("test: %-15s %s %s\n", name, pass?"pass":"FAIL", info);
+  if( !pass ) check_fails++;
+}
+
+
+// Checks `pass` for test `name`, and prints `got` (e.g. the output that was compared) when it failed
+static inline void check_got(const char * name, bool pass, const char * got) {
+  check(name, pass);
+  if( !pass ) printf("%s\n", got);
+}
+
+
+// Prints the number of failed checks, returns the exit code (0 when all passed)
+static inline int check_done() {
+  printf("test: %d failed\n", check_fails);
+  return check_fails==0 ? 0 : 1;
+}
+
+
+#endif
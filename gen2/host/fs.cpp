@@ -0,0 +1,75 @@
+// fs.cpp - Host stand-in for LittleFS: the files live in a directory of the host
+
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include "LittleFS.h"
+
+
+FS          LittleFS;
+std::string host_fs_root = "/tmp/emp1fs";
+uint32_t    host_fs_writes;
+uint32_t    host_fs_bytes;
+
+
+size_t File::write(const uint8_t * buf, size_t size) {
+  host_fs_writes++;
+  size_t n = fwrite(buf, 1, size, _f);
+  host_fs_bytes += n;
+  return n;
+}
+
+
+size_t File::size() {
+  long pos = ftell(_f);
+  fseek(_f, 0, SEEK_END);
+  long size = ftell(_f);
+  fseek(_f, pos, SEEK_SET);
+  return size;
+}
+
+
+bool FS::begin() {
+  return ::mkdir(host_fs_root.c_str(), 0755)==0 || errno==EEXIST;
+}
+
+
+bool FS::exists(const char * path) {
+  struct stat st;
+  return stat((host_fs_root+path).c_str(), &st)==0;
+}
+
+
+bool FS::mkdir(const char * path) {
+  return ::mkdir((host_fs_root+path).c_str(), 0755)==0;
+}
+
+
+bool FS::remove(const char * path) {
+  return ::remove((host_fs_root+path).c_str())==0;
+}
+
+
+File FS::open(const char * path, const char * mode) {
+  const char * m = strcmp(mode,"a")==0 ? "ab" : strcmp(mode,"w")==0 ? "wb" : "rb";
+  return File(fopen((host_fs_root+path).c_str(), m));
+}
+
+
+Dir FS::openDir(const char * path) {
+  Dir dir;
+  std::string base = host_fs_root+path;
+  DIR * d = opendir(base.c_str());
+  if( d==NULL ) return dir;
+  struct dirent * e;
+  while( (e=readdir(d))!=NULL ) {
+    struct stat st;
+    if( e->d_name[0]=='.' || stat((base+"/"+e->d_name).c_str(), &st)!=0 || !S_ISREG(st.st_mode) ) continue;
+    dir._names.push_back(e->d_name);
+    dir._sizes.push_back(st.st_size);
+  }
+  closedir(d);
+  return dir;
+}
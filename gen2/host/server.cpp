@@ -0,0 +1,88 @@
+// server.cpp - Stand-in servers on localhost, for testing the clients (sink, mqtt) against real sockets
+
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include "server.h"
+
+
+static void server_accept(Server * server) {
+  while( !server->stopping ) {
+    struct pollfd p = { server->fd, POLLIN, 0 };
+    if( poll(&p,1,50)!=1 ) continue;
+    int fd = accept(server->fd, NULL, NULL);
+    if( fd<0 ) continue;
+    server->connections++;
+    std::lock_guard<std::mutex> guard(server->lock);
+    server->fds.push_back(fd);
+    server->conns.emplace_back( [server,fd]() { server->fn(server,fd); shutdown(fd,SHUT_RDWR); } );
+  }
+}
+
+
+uint16_t server_start(Server * server, Server_Fn fn, void * ctx) {
+  server->fn = fn;
+  server->ctx = ctx;
+  server->stopping = false;
+  server->connections = 0;
+  server->fd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0; // any free port
+  socklen_t len = sizeof addr;
+  if( bind(server->fd,(struct sockaddr *)&addr,sizeof addr)<0 || listen(server->fd,64)<0 || getsockname(server->fd,(struct sockaddr *)&addr,&len)<0 ) {
+    close(server->fd);
+    return 0;
+  }
+  server->port = ntohs(addr.sin_port);
+  server->acceptor = std::thread(server_accept, server);
+  return server->port;
+}
+
+
+void server_stop(Server * server) {
+  server->stopping = true;
+  server->acceptor.join();
+  close(server->fd);
+  std::vector<std::thread> conns;
+  {
+    std::lock_guard<std::mutex> guard(server->lock);
+    for( int fd : server->fds ) shutdown(fd, SHUT_RDWR);
+    conns.swap(server->conns);
+  }
+  for( std::thread & t : conns ) t.join();
+  for( int fd : server->fds ) close(fd);
+  server->fds.clear();
+}
+
+
+int server_read(Server * server, int fd, void * buf, int size, int ms) {
+  // Poll in small steps, so that a stop is noticed
+  for( int waited=0; waited<ms; waited+=10 ) {
+    if( server->stopping ) return -1;
+    struct pollfd p = { fd, POLLIN, 0 };
+    if( poll(&p,1,10)!=1 ) continue;
+    int n = recv(fd, buf, size, 0);
+    return n>0 ? n : -1;
+  }
+  return 0;
+}
+
+
+bool server_write(int fd, const void * buf, int len) {
+  const char * p = (const char *)buf;
+  while( len>0 ) {
+    int n = send(fd, p, len, MSG_NOSIGNAL);
+    if( n<=0 ) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
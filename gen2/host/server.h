@@ -0,0 +1,52 @@
+// server.h - Interface to stand-in servers on localhost, for testing the clients (sink, mqtt) against real sockets
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A server listens on a free port of 127.0.0.1, and serves each connection in its own thread, with `fn`.
+// `fn` does blocking reads and writes with server_read() and server_write(); it returns when the connection is done.
+// server_stop() shuts down all connections (so that their reads fail), and waits for the threads.
+
+
+struct Server;
+typedef void (*Server_Fn)(Server * server, int fd);
+
+
+struct Server {
+  int                      fd;           // listening socket
+  uint16_t                 port;
+  Server_Fn                fn;
+  void *                   ctx;          // for `fn`
+  std::atomic<bool>        stopping;
+  std::atomic<int>         connections;  // number accepted
+  std::thread              acceptor;
+  std::mutex               lock;         // for conns, and for `fn` to guard `ctx`
+  std::vector<int>         fds;
+  std::vector<std::thread> conns;
+};
+
+
+// Starts `server`, serving connections with `fn`; returns the port (0 if that failed)
+uint16_t server_start(Server * server, Server_Fn fn, void * ctx);
+
+
+// Stops `server`: closes the listening socket and all connections
+void     server_stop(Server * server);
+
+
+// Reads at most `size` bytes from `fd`, waiting at most `ms`; returns the number read, 0 on time-out, -1 on close or stop
+int      server_read(Server * server, int fd, void * buf, int size, int ms=5000);
+
+
+// Writes all `len` bytes of `buf` to `fd`; returns false on error
+bool     server_write(int fd, const void * buf, int len);
+
+
+#endif
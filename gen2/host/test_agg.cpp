@@ -0,0 +1,107 @@
+// test_agg.cpp - Tests the rolling aggregation (agg) and its template values on a stream of generated telegrams
+
+
+#include <Arduino.h>
+#include "tele.h"
+#include "agg.h"
+#include "tmpl.h"
+#include "telegen.h"
+#include "check.h"
+
+
+// An interval as the aggregation should have it
+struct Ref {
+  int32_t start;
+  int     count;
+  int32_t min, max;  // of P
+  int64_t sum;       // of P
+  int32_t base[2];   // last L and H of the previous interval (or the first ones)
+  int32_t last[2];   // last L and H
+};
+
+
+// Returns the index of the field with `key`
+static int field(char key) {
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_key(i)==key ) return i;
+  return -1;
+}
+
+
+// Returns true when the closed interval of agg equals `ref`
+static bool same(const Ref * ref) {
+  int32_t min, max, mean, incl, inch, count;
+  if( !agg_value(AGG_FN_MIN,'P',&min) || !agg_value(AGG_FN_MAX,'P',&max) || !agg_value(AGG_FN_MEAN,'P',&mean) 
+   || !agg_value(AGG_FN_INC,'L',&incl) || !agg_value(AGG_FN_INC,'H',&inch) || !agg_value(AGG_FN_COUNT,'\0',&count) ) return false;
+  return agg_start()==ref->start && count==ref->count && min==ref->min && max==ref->max 
+      && mean==(int32_t)((ref->sum+ref->count/2)/ref->count) && incl==ref->last[0]-ref->base[0] && inch==ref->last[1]-ref->base[1];
+}
+
+
+int main() {
+  tele_init();
+  agg_init(60);
+  Telegen gen;
+  telegen_init(&gen, TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS, 2022);
+  int T = field('T');
+  int P = field('P');
+  int E[2] = { field('L'), field('H') };
+  static char buf[4000];
+
+  // Feeds 10 minutes of DSMR 5 telegrams, and keeps the intervals aside
+  Ref cur = { -1, 0, 0, 0, 0, {0,0}, {0,0} };
+  Ref done = cur;
+  int closed = 0;
+  int32_t energy = 0; // sum of the increases
+  int checked = 0;
+  int matched = 0;
+  bool before = true; // no values before the first interval closes
+  for( int i=0; i<600; i++ ) {
+    int len = telegen_next(&gen, buf, sizeof buf);
+    if( tele_parser_add_buf(buf, len)!=1 ) { check("parse", false); break; }
+    const Tele_Snapshot * snap = tele_snapshot();
+    int32_t time = tele_snapshot_num(snap, T);
+    int32_t p = tele_snapshot_milli(snap, P);
+    int32_t start = time - time%60;
+    if( cur.count>0 && start!=cur.start ) { done = cur; cur.count = 0; closed++; energy += done.last[0]-done.base[0] + done.last[1]-done.base[1]; }
+    if( cur.count==0 ) {
+      cur = { start, 0, p, p, 0, {0,0}, {0,0} };
+      for( int e=0; e<2; e++ ) cur.base[e] = done.count>0 ? done.last[e] : tele_snapshot_milli(snap, E[e]);
+    }
+    cur.count++;
+    if( p<cur.min ) cur.min = p;
+    if( p>cur.max ) cur.max = p;
+    cur.sum += p;
+    for( int e=0; e<2; e++ ) cur.last[e] = tele_snapshot_milli(snap, E[e]);
+    agg_add(snap);
+    int32_t val;
+    if( closed==0 && (agg_value(AGG_FN_COUNT,'\0',&val) || agg_start()!=-1) ) before = false;
+    if( closed>0 ) { checked++; matched += same(&done); }
+  }
+  check("no interval", before);
+  check("rollups", checked>0 && matched==checked, "(%d of %d telegrams)", matched, checked);
+  check("energy", energy>0, "(%d Wh in the closed intervals)", energy);
+  check("rollover", closed==9 || closed==10, "(%d intervals closed)", closed);
+  check("full interval", done.count==60 && done.start%60==0, "(%d telegrams)", done.count);
+
+  // The template values are those of the last closed interval, printed like the field (the count as integer)
+  Tmpl tmpl;
+  tmpl_compile(&tmpl, "min=%<P&max=%>P&mean=%~P&inc=%+L%+H&n=%#&mean2=%.~P&P=%P");
+  char got[200];
+  char want[200];
+  int len = tmpl_render(&tmpl, got, sizeof got);
+  int32_t mean = (int32_t)((done.sum+done.count/2)/done.count);
+  int32_t inc = done.last[0]-done.base[0];
+  int32_t inch = done.last[1]-done.base[1];
+  int32_t p = tele_snapshot_milli(tele_snapshot(), P);
+  snprintf(want, sizeof want, "min=%d.%03d&max=%d.%03d&mean=%d.%03d&inc=%d.%03d%d.%03d&n=%d&mean2=%d&P=%d.%03d", 
+    done.min/1000, done.min%1000, done.max/1000, done.max%1000, mean/1000, mean%1000, inc/1000, inc%1000, inch/1000, inch%1000, done.count, mean, p/1000, p%1000);
+  check("template", strcmp(got,want)==0 && len==tmpl_length(&tmpl), "(%d chars)", len);
+  if( strcmp(got,want)!=0 ) Serial.printf("test: got  %s\ntest: want %s\n", got, want);
+
+  // Unknown or not aggregated keys are copied
+  tmpl_compile(&tmpl, "%<T%~x%+");
+  tmpl_render(&tmpl, got, sizeof got);
+  check("not aggregated", strcmp(got,"%<T%~x%+")==0);
+
+  return check_done();
+}
@@ -0,0 +1,128 @@
+// test_arch.cpp - Tests the flash archive (arch) on a directory of the host, with generated telegrams
+
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <vector>
+#include <filesystem>
+#include "tele.h"
+#include "arch.h"
+#include "telegen.h"
+#include "check.h"
+
+
+// A frame as the archive should have it
+struct Ref {
+  int32_t time;
+  int32_t values[TELE_NUMFIELDS];
+};
+
+
+static std::vector<Ref> refs; // all frames that were archived (also the ones deleted since)
+
+
+// Feeds `num` DSMR 5 telegrams, one per minute (so each one is archived), to the default parser and the archive
+static void feed(Telegen * gen, int num) {
+  static char buf[4000];
+  uint32_t mask = tele_fields_mask(ARCH_KEYS);
+  for( int i=0; i<num; i++ ) {
+    gen->time += ARCH_PERIOD-1; // telegen adds the other second
+    int len = telegen_next(gen, buf, sizeof buf);
+    if( tele_parser_add_buf(buf, len)!=1 ) { check("parse", false); return; }
+    const Tele_Snapshot * snap = tele_snapshot();
+    Ref ref;
+    for( int ix=0; ix<TELE_NUMFIELDS; ix++ ) {
+      if( tele_field_type(ix)==TELE_TYPE_TIME ) ref.time = tele_snapshot_num(snap,ix);
+      ref.values[ix] = (mask>>ix)&1 ? tele_snapshot_num(snap,ix) : 0;
+    }
+    refs.push_back(ref);
+    arch_add(snap);
+  }
+}
+
+
+// Reads at most `max` frames at `cur`, and compares them with the refs from `*next` on (when 0, it finds the first);
+// returns the number read, and sets `*pass` false on a mismatch
+static int verify(Arch_Cursor * cur, size_t * next, int max, bool * pass) {
+  int32_t time;
+  int32_t values[TELE_NUMFIELDS];
+  int n = 0;
+  while( n<max && arch_read(cur, &time, values) ) {
+    if( *next==0 ) while( *next<refs.size() && refs[*next].time<time ) (*next)++;
+    if( *next>=refs.size() || refs[*next].time!=time || memcmp(refs[*next].values, values, sizeof values)!=0 ) *pass = false;
+    (*next)++;
+    n++;
+  }
+  return n;
+}
+
+
+int main() {
+  char root[] = "/tmp/emp1archXXXXXX";
+  if( mkdtemp(root)==NULL ) { Serial.printf("test: no temporary directory\n"); return 1; }
+  host_fs_root = root;
+  host_quiet = true;
+  tele_init(arch_fields());
+  bool pass = arch_init();
+  host_quiet = false;
+  check("init", pass && arch_segments()==1 && arch_size()==0, "(%d segments)", arch_segments());
+  Telegen gen;
+  telegen_init(&gen, TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS, 5);
+  Arch_Cursor cur;
+
+  // Everything reads back, oldest first
+  feed(&gen, 1000);
+  arch_flush();
+  arch_cursor_begin(&cur);
+  size_t next = 0;
+  pass = true;
+  int n = verify(&cur, &next, INT32_MAX, &pass);
+  check("read back", pass && n==1000 && arch_stats()->frames==1000, "(%d/1000 frames)", n);
+
+  // Flash is written in (nearly) full pages, and every byte once
+  const Arch_Stats * st = arch_stats();
+  check("write amp", host_fs_bytes==st->bytes && host_fs_writes==st->writes && st->writes<=st->bytes/(ARCH_PAGE_SIZE*3/4)+st->segments,
+    "(%d frames per write, %d bytes per frame)", st->frames/st->writes, st->bytes/st->frames);
+
+  // Retention: the oldest segments are deleted, the rest is contiguous up to the newest frame
+  feed(&gen, 60000);
+  arch_flush();
+  int files = 0;
+  Dir dir = LittleFS.openDir(ARCH_DIR);
+  while( dir.next() ) files++;
+  check("retention", arch_segments()==ARCH_MAXSEGMENTS && files==ARCH_MAXSEGMENTS && arch_size()<=(uint32_t)ARCH_MAXSEGMENTS*ARCH_SEGMENT_SIZE
+    && st->deleted==st->segments-ARCH_MAXSEGMENTS, "(%d files, %d bytes)", files, arch_size());
+  arch_cursor_begin(&cur);
+  next = 0;
+  pass = true;
+  n = verify(&cur, &next, INT32_MAX, &pass);
+  check("read oldest", pass && next==refs.size() && n>20000, "(%d frames, %d days)", n, (refs.back().time-refs[next-n].time)/86400);
+
+  // A cursor whose segment is deleted while reading continues with the oldest remaining one
+  arch_cursor_begin(&cur);
+  next = 0;
+  pass = true;
+  verify(&cur, &next, 100, &pass);
+  feed(&gen, 2000);
+  arch_flush();
+  next = 0;
+  n = verify(&cur, &next, INT32_MAX, &pass);
+  check("read deleted", pass && next==refs.size(), "(%d frames)", n);
+
+  // After a reboot the segments are found again, and the archive continues in a new one
+  int segments = arch_segments();
+  host_quiet = true;
+  arch_init();
+  host_quiet = false;
+  arch_cursor_begin(&cur);
+  next = 0;
+  pass = true;
+  verify(&cur, &next, INT32_MAX, &pass);
+  feed(&gen, 10);
+  arch_flush();
+  verify(&cur, &next, INT32_MAX, &pass);
+  check("reboot", pass && next==refs.size() && arch_segments()==ARCH_MAXSEGMENTS, "(%d segments before)", segments);
+
+  std::filesystem::remove_all(root);
+  return check_done();
+}
@@ -0,0 +1,87 @@
+// test_band.cpp - Tests the dead-bands and heartbeat (band) that decide when a GET is due
+
+
+#include <Arduino.h>
+#include <string>
+#include "tele.h"
+#include "crc16.h"
+#include "agg.h"
+#include "tmpl.h"
+#include "band.h"
+#include "check.h"
+
+
+// Feeds example 1 with time stamp `time` (hhmmss on 2022-06-05) and power `power` (e.g. "00.586") to the parser and agg
+static const Tele_Snapshot * feed(const char * time, const char * power) {
+  std::string t = TELE_EXAMPLE_1;
+  t.replace(t.find("191342"), 6, time);
+  t.replace(t.find("00.586"), 6, power);
+  size_t excl = t.find('!');
+  char hex[5];
+  snprintf(hex, sizeof hex, "%04X", crc16_update(CRC16_INIT, t.c_str(), excl+1));
+  t.replace(excl+1, 4, hex);
+  if( tele_parser_add_buf(t.c_str(), t.size())!=1 ) check("parse", false);
+  agg_add(tele_snapshot());
+  return tele_snapshot();
+}
+
+
+int main() {
+  tele_init();
+  agg_init(60);
+  Tmpl tmpl;
+  Band band;
+
+  // The power, with a dead-band of 20 W, and a heartbeat of a minute
+  tmpl_compile(&tmpl, "/update?field1=%P&field2=%.P");
+  band_init(&band, &tmpl, "P20", 60000);
+  check("values", band.num==1 && band.width[0]==20, "(%d values)", band.num);
+  const Tele_Snapshot * snap = feed("191342", "00.586");
+  check("first", band_due(&band,snap));
+  band_submit(&band, snap); // the request fails: nothing is published
+  snap = feed("191343", "00.586");
+  check("retry", band_due(&band,snap));
+  band_submit(&band, snap);
+  band_publish(&band); // the request succeeds
+  snap = feed("191344", "00.586");
+  bool due = band_due(&band,snap);
+  check("unchanged", !due && band.suppressed==1, "(%d suppressed)", band.suppressed);
+  snap = feed("191345", "00.606");
+  check("within band", !band_due(&band,snap));
+  snap = feed("191346", "00.566");
+  check("within band -", !band_due(&band,snap));
+  snap = feed("191347", "00.607");
+  check("beyond band", band_due(&band,snap));
+  band_submit(&band, snap);
+  band_publish(&band);
+  snap = feed("191348", "00.587");
+  check("new base", !band_due(&band,snap));
+
+  // The heartbeat makes a request due when nothing was published for a while, also without a change
+  delay(59000);
+  snap = feed("191349", "00.607");
+  check("no heartbeat", !band_due(&band,snap));
+  delay(1000);
+  check("heartbeat", band_due(&band,snap));
+  band_submit(&band, snap);
+  band_publish(&band);
+  check("after beat", !band_due(&band,snap));
+
+  // With the mean power in the template, the dead-band compares the mean: it changes when an interval closes
+  tmpl_compile(&tmpl, "/update?field1=%~P&field2=%#");
+  band_init(&band, &tmpl, "P20", 0);
+  snap = feed("191350", "01.586");
+  check("agg first", band_due(&band,snap));
+  band_submit(&band, snap);
+  band_publish(&band);
+  snap = feed("191351", "02.586");
+  check("agg raw moves", !band_due(&band,snap));
+  snap = feed("191400", "02.586");
+  check("agg closes", band_due(&band,snap));
+  band_submit(&band, snap);
+  band_publish(&band);
+  snap = feed("191410", "00.100");
+  check("agg same", !band_due(&band,snap));
+
+  return check_done();
+}
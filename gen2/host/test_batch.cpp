@@ -0,0 +1,134 @@
+// test_batch.cpp - Tests batching of telegrams (batch) and its flushes, posted by a sink to a stand-in HTTP server
+
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "tele.h"
+#include "tmpl.h"
+#include "batch.h"
+#include "sink.h"
+#include "telegen.h"
+#include "server.h"
+#include "check.h"
+
+
+// Serves HTTP requests (with a Content-Length) on `fd`, keeps the bodies in the std::vector<std::string> ctx
+static void http_serve(Server * server, int fd) {
+  std::vector<std::string> * bodies = (std::vector<std::string> *)server->ctx;
+  std::string in;
+  char buf[1024];
+  for(;;) {
+    size_t end = in.find("\r\n\r\n");
+    size_t len = 0;
+    if( end!=std::string::npos ) {
+      size_t cl = in.find("Content-Length: ");
+      if( cl!=std::string::npos && cl<end ) len = atoi(in.c_str()+cl+16);
+    }
+    if( end==std::string::npos || in.size()<end+4+len ) {
+      int n = server_read(server, fd, buf, sizeof buf);
+      if( n<=0 ) return;
+      in.append(buf, n);
+      continue;
+    }
+    std::lock_guard<std::mutex> guard(server->lock);
+    bodies->push_back(in.substr(end+4, len));
+    in.erase(0, end+4+len);
+    server_write(fd, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok", 40);
+  }
+}
+
+
+static Server                   server;
+static std::vector<std::string> bodies;
+static Sink                     sink;
+static char                     sink_buf[BATCH_BUF_SIZE+256];
+static Telegen                  gen;
+
+
+// Flushes `batch` with a POST via the sink, and polls the sink until it is done (see Batch_Flush)
+static bool flush(Batch * batch, void * ctx) {
+  (void)ctx;
+  int size;
+  char * req = sink_request(&sink, &size);
+  if( req==NULL ) return false;
+  int len = batch_request(batch, req, size, "/bulk_update.json", "localhost", "KEY");
+  if( len==0 ) return false;
+  sink_submit(&sink, len);
+  for( int i=0; i<5000 && sink_busy(&sink); i++ ) {
+    sink_poll(&sink);
+    usleep(1000);
+  }
+  return true;
+}
+
+
+// Feeds `num` telegrams, one per second, to the parser and collects each in `batch`; returns the number added
+static int collect(Batch * batch, const Tmpl * line, int num, int count, uint32_t age) {
+  static char buf[4000];
+  int added = 0;
+  for( int i=0; i<num; i++ ) {
+    delay(1000);
+    int len = telegen_next(&gen, buf, sizeof buf);
+    if( tele_parser_add_buf(buf, len)!=1 ) { check("parse", false); return added; }
+    added += batch_collect(batch, line, millis(), count, age, flush, NULL);
+  }
+  return added;
+}
+
+
+// Returns the number of entries in the posted `body`, -1 if it is not a bulk-update
+static int entries(const std::string & body) {
+  const char * head = "{\"write_api_key\":\"KEY\",\"updates\":[{\"delta_t\":";
+  if( body.compare(0,strlen(head),head)!=0 || body.compare(body.size()-3,3,"}]}")!=0 ) return -1;
+  int n = 0;
+  for( size_t pos=0; (pos=body.find("{\"delta_t\":",pos))!=std::string::npos; pos++ ) n++;
+  return n;
+}
+
+
+int main() {
+  uint16_t port = server_start(&server, http_serve, &bodies);
+  sink_init(&sink, "batch", "localhost", sink_buf, sizeof sink_buf, port);
+  telegen_init(&gen, TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS, 2022);
+  tele_init();
+  Tmpl line;
+  tmpl_compile(&line, "\"field1\":%L,\"field5\":%P");
+  Batch batch;
+  batch_init(&batch);
+
+  // Flush by size: every 5 telegrams, the rest stays
+  int added = collect(&batch, &line, 12, 5, 60000);
+  check("size", added==12 && bodies.size()==2 && entries(bodies[0])==5 && entries(bodies[1])==5 && batch.count==2, "(%d posts, %d kept)", (int)bodies.size(), batch.count);
+  check("delta_t", bodies.size()==2 && bodies[1].find("[{\"delta_t\":1,\"field1\":")!=std::string::npos);
+
+  // Flush by age: the batch is posted when its first telegram is 15 s old (the 2 kept ones count too)
+  bodies.clear();
+  added = collect(&batch, &line, 20, 1000, 15000);
+  check("age", added==20 && bodies.size()==1 && entries(bodies[0])==16 && batch.count==6, "(%d posts, %d kept)", (int)bodies.size(), batch.count);
+
+  // Flush on a full buffer: long lines, posted before the next one would not fit
+  bodies.clear();
+  batch_clear(&batch);
+  std::string wide = "\"field1\":%L,\"status\":\"" + std::string(600,'x') + "\"";
+  Tmpl wideline;
+  tmpl_compile(&wideline, wide.c_str());
+  added = collect(&batch, &wideline, 7, 1000, 60000);
+  check("full", added==7 && bodies.size()==2 && entries(bodies[0])==3 && entries(bodies[1])==3 && batch.count==1, "(%d posts, %d kept)", (int)bodies.size(), batch.count);
+
+  // A line that does not fit an empty batch is dropped (and counted), no empty batch is posted
+  bodies.clear();
+  flush(&batch, NULL);
+  batch_clear(&batch);
+  bodies.clear();
+  std::string huge = "\"status\":\"" + std::string(BATCH_BUF_SIZE,'x') + "\"";
+  Tmpl hugeline;
+  tmpl_compile(&hugeline, huge.c_str());
+  uint32_t dropped = batch.dropped;
+  added = collect(&batch, &hugeline, 3, 1, 0);
+  check("too long", added==0 && batch.dropped-dropped==3 && bodies.empty() && batch.count==0, "(%d dropped, %d posts)", (int)(batch.dropped-dropped), (int)bodies.size());
+
+  server_stop(&server);
+  return check_done();
+}
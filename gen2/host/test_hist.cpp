@@ -0,0 +1,91 @@
+// test_hist.cpp - Tests the in-RAM history (hist) and its queries on a stream of generated telegrams
+
+
+#include <Arduino.h>
+#include <vector>
+#include "tele.h"
+#include "hist.h"
+#include "telegen.h"
+#include "check.h"
+
+
+// A sample as the history should have it
+struct Ref {
+  int32_t time;
+  int32_t value;
+};
+
+
+static std::vector<Ref> refs; // all samples that were stored (also the ones dropped since)
+
+
+// Feeds `num` DSMR 5 telegrams (one per second) to the default parser and the history
+static void feed(Telegen * gen, int num, int P, int time) {
+  static char buf[4000];
+  for( int i=0; i<num; i++ ) {
+    int len = telegen_next(gen, buf, sizeof buf);
+    if( tele_parser_add_buf(buf, len)!=1 ) { check("parse", false); return; }
+    const Tele_Snapshot * snap = tele_snapshot();
+    int32_t t = tele_snapshot_num(snap, time);
+    if( refs.empty() || t-refs.back().time>=HIST_PERIOD ) refs.push_back( { t, tele_snapshot_num(snap,P) } );
+    hist_add(snap);
+  }
+}
+
+
+int main() {
+  int P = -1, time = -1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) { if( tele_field_key(i)=='P' ) P = i; if( tele_field_type(i)==TELE_TYPE_TIME ) time = i; }
+  tele_init(hist_fields());
+  hist_init();
+  Telegen gen;
+  telegen_init(&gen, TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS, 3);
+  int32_t oldest, newest;
+
+  // Not full yet: everything is kept
+  feed(&gen, 1000, P, time);
+  int count = hist_count(&oldest, &newest);
+  check("count", count==(int)refs.size() && oldest==refs.front().time && newest==refs.back().time, "(%d/%d samples)", count, (int)refs.size());
+
+  // Full: the oldest blocks are dropped; the generated power changes more than a real one, still 45 minutes stay
+  feed(&gen, 20000, P, time);
+  count = hist_count(&oldest, &newest);
+  size_t first = 0;
+  while( first<refs.size() && refs[first].time<oldest ) first++;
+  check("ring", count==(int)(refs.size()-first) && newest==refs.back().time && newest-oldest>=2700, "(%d samples, %d s)", count, newest-oldest);
+
+  // The last n
+  int32_t times[64], values[64];
+  int n = hist_last('P', 64, times, values);
+  bool pass = n==64;
+  for( int i=0; i<n && pass; i++ ) pass = times[i]==refs[refs.size()-64+i].time && values[i]==refs[refs.size()-64+i].value;
+  check("last", pass, "(%d/64)", n);
+
+  // A range
+  int32_t from = refs[first+100].time;
+  int32_t to = refs[first+150].time;
+  n = hist_range('P', from, to, times, values, 64);
+  pass = n==51;
+  for( int i=0; i<n && pass; i++ ) pass = times[i]==refs[first+100+i].time && values[i]==refs[first+100+i].value;
+  check("range", pass, "(%d/51)", n);
+  n = hist_range('P', from, to, times, values, 10);
+  check("range max", n==10 && times[9]==refs[first+109].time, "(%d/10)", n);
+
+  // Statistics over everything kept
+  Hist_Stats st;
+  int64_t sum = 0;
+  int32_t min = refs[first].value, max = min;
+  for( size_t i=first; i<refs.size(); i++ ) {
+    sum += refs[i].value;
+    if( refs[i].value<min ) min = refs[i].value;
+    if( refs[i].value>max ) max = refs[i].value;
+  }
+  pass = hist_stats('P', INT32_MIN, INT32_MAX, &st) && st.count==count && st.min==min && st.max==max
+      && st.avg==(int32_t)(sum/count) && st.first==oldest && st.last==newest && min<max;
+  check("stats", pass, "(min %d, max %d)", st.min, st.max);
+
+  // Fields that are not kept
+  check("unknown key", !hist_stats('T', 0, INT32_MAX, &st) && hist_range('T', 0, INT32_MAX, times, values, 64)==-1 && hist_last('T', 1, times, values)==-1);
+
+  return check_done();
+}
@@ -0,0 +1,102 @@
+// test_metrics.cpp - Tests the counters and histograms (metrics) and their Prometheus text output
+
+
+#include <Arduino.h>
+#include "metrics.h"
+#include "check.h"
+
+
+static std::string flushed; // what the flush function got
+static bool lines = true;   // every flush ended with a complete line
+
+
+static void flush(const char * buf, int len, void * ctx) {
+  (void)ctx;
+  flushed.append(buf, len);
+  if( len==0 || buf[len-1]!='\n' ) lines = false;
+}
+
+
+// Writes some values and a histogram
+static void write_all(Metrics_Out * out, const Metrics_Hist * hist) {
+  for( int i=0; i<20; i++ ) {
+    metrics_write_head (out, "emp1_x_total", "counter", "Some counter");
+    metrics_write_value(out, "emp1_x_total", "sink=\"post\"", 1000*i, 1000);
+  }
+  metrics_write_hist(out, "emp1_gap_seconds", "Gap", hist, 1000);
+}
+
+
+int main() {
+  char buf[1024];
+  Metrics_Out out;
+
+  // Values, with and without labels and scale
+  metrics_begin(&out, buf, sizeof buf);
+  metrics_write_head (&out, "emp1_x_total", "counter", "Some counter");
+  metrics_write_value(&out, "emp1_x_total", NULL, 42);
+  metrics_write_value(&out, "emp1_x_total", "sink=\"post\"", 4000000000ULL);
+  metrics_write_value(&out, "emp1_ms", NULL, 1234, 1000);
+  metrics_write_value(&out, "emp1_ms", NULL, 5, 1000);
+  metrics_write_value(&out, "emp1_us", NULL, 7000001, 1000000);
+  check_got("values", !out.full && strcmp(buf,
+    "# HELP emp1_x_total Some counter\n"
+    "# TYPE emp1_x_total counter\n"
+    "emp1_x_total 42\n"
+    "emp1_x_total{sink=\"post\"} 4000000000\n"
+    "emp1_ms 1.234\n"
+    "emp1_ms 0.005\n"
+    "emp1_us 7.000001\n")==0, buf);
+
+  // Histogram: buckets are cumulative in the output, an observation equal to a bound goes in that bucket
+  static const uint32_t bounds[] = { 1, 5, 10 };
+  Metrics_Hist hist;
+  metrics_hist_init(&hist, bounds, 3);
+  const uint32_t values[] = { 0, 1, 2, 5, 6, 10, 11, 1000 };
+  for( uint32_t v : values ) metrics_hist_add(&hist, v);
+  metrics_begin(&out, buf, sizeof buf);
+  metrics_write_hist(&out, "emp1_gap_seconds", "Gap", &hist, 1000);
+  check_got("histogram", !out.full && hist.max==1000 && strcmp(buf,
+    "# HELP emp1_gap_seconds Gap\n"
+    "# TYPE emp1_gap_seconds histogram\n"
+    "emp1_gap_seconds_bucket{le=\"0.001\"} 2\n"
+    "emp1_gap_seconds_bucket{le=\"0.005\"} 4\n"
+    "emp1_gap_seconds_bucket{le=\"0.010\"} 6\n"
+    "emp1_gap_seconds_bucket{le=\"+Inf\"} 8\n"
+    "emp1_gap_seconds_sum 1.035\n"
+    "emp1_gap_seconds_count 8\n")==0, buf);
+
+  // Too many bounds are cut
+  static const uint32_t many[METRICS_MAXBOUNDS+5] = { 0 };
+  metrics_hist_init(&hist, many, METRICS_MAXBOUNDS+5);
+  check("max bounds", hist.num==METRICS_MAXBOUNDS);
+
+  // Full: the output ends with the last complete line
+  char small[100];
+  metrics_begin(&out, small, sizeof small);
+  for( int i=0; i<10; i++ ) metrics_write_value(&out, "emp1_some_long_metric_name", NULL, i);
+  int len = strlen(small);
+  check_got("full", out.full && len==out.len && len>0 && small[len-1]=='\n' && strncmp(small,"emp1_some_long_metric_name 0\n",29)==0, small);
+
+  // Flushed: a small buffer gives the same output, in complete lines
+  static char big[4096];
+  metrics_hist_init(&hist, bounds, 3);
+  for( uint32_t v : values ) metrics_hist_add(&hist, v);
+  metrics_begin(&out, big, sizeof big);
+  write_all(&out, &hist);
+  bool pass = !out.full && out.flushed==0;
+  metrics_begin(&out, small, sizeof small, flush, NULL);
+  write_all(&out, &hist);
+  metrics_end(&out);
+  check_got("flushed", pass && !out.full && lines && out.len==0 && out.flushed==(int)strlen(big) && flushed==big, flushed.c_str());
+
+  // A line longer than the buffer can not be flushed
+  flushed.clear();
+  metrics_begin(&out, small, sizeof small, flush, NULL);
+  metrics_write_value(&out, "emp1_x_total", NULL, 1);
+  metrics_write_head (&out, "emp1_x_total", "counter", "A help text that is longer than the buffer, which can hold 100 bytes only");
+  metrics_end(&out);
+  check_got("flush long", out.full && flushed=="emp1_x_total 1\n", flushed.c_str());
+
+  return check_done();
+}
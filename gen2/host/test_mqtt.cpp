@@ -0,0 +1,235 @@
+// test_mqtt.cpp - Tests the MQTT publisher against a stand-in broker on localhost, and measures its publishes/s
+
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "mqtt.h"
+#include "server.h"
+#include "check.h"
+
+
+// How the stand-in broker responds
+enum Broker_Mode {
+  BROKER_OK,     // accepts the session, answers PINGREQ
+  BROKER_REFUSE, // CONNACK with return code 5 (not authorized)
+  BROKER_SILENT, // accepts the session, but does not answer PINGREQ
+};
+
+
+struct Broker {
+  Broker_Mode              mode;
+  bool                     drop;      // close the connection (set by the test)
+  int                      sessions;  // number of CONNECTs
+  std::string              clientid;  // of the last CONNECT
+  std::string              user;
+  std::string              password;
+  int                      keepalive;
+  int                      pings;     // number of PINGREQs
+  std::vector<std::string> topics;    // of all PUBLISHes (not in bench mode)
+  std::vector<std::string> payloads;
+  bool                     bench;     // only count the PUBLISHes, and check that their payloads count up
+  int                      publishes; // number of PUBLISHes
+  int                      retained;  // number of PUBLISHes with the retain flag
+  int                      disorder;  // number of PUBLISHes out of order (bench mode)
+};
+
+
+// Returns the string with length prefix at `p` (and moves `p` past it)
+static std::string broker_str(const char ** p) {
+  int len = (uint8_t)(*p)[0]<<8 | (uint8_t)(*p)[1];
+  std::string s(*p+2, len);
+  *p += 2+len;
+  return s;
+}
+
+
+// Handles one packet of `type` with body `p` of `len` bytes; returns false to close the connection
+static bool broker_packet(Server * server, int fd, uint8_t type, const char * p, int len) {
+  Broker * broker = (Broker *)server->ctx;
+  std::lock_guard<std::mutex> guard(server->lock);
+  switch( type&0xF0 ) {
+  case 0x10: { // CONNECT
+    const char * q = p;
+    std::string protocol = broker_str(&q);
+    uint8_t level = q[0], flags = q[1];
+    broker->keepalive = (uint8_t)q[2]<<8 | (uint8_t)q[3];
+    q += 4;
+    broker->clientid = broker_str(&q);
+    broker->user = flags&0x80 ? broker_str(&q) : "";
+    broker->password = flags&0x40 ? broker_str(&q) : "";
+    broker->sessions++;
+    bool ok = protocol=="MQTT" && level==4 && q==p+len && broker->mode!=BROKER_REFUSE;
+    char connack[4] = { 0x20, 2, 0, (char)(ok ? 0 : 5) };
+    server_write(fd, connack, 4);
+    return ok;
+  }
+  case 0x30: { // PUBLISH (QoS 0, so no packet id)
+    const char * q = p;
+    std::string topic = broker_str(&q);
+    std::string payload(q, p+len-q);
+    broker->publishes++;
+    if( type&0x01 ) broker->retained++;
+    if( broker->bench ) {
+      if( atoi(payload.c_str())!=broker->publishes ) broker->disorder++;
+    } else {
+      broker->topics.push_back(topic);
+      broker->payloads.push_back(payload);
+    }
+    return true;
+  }
+  case 0xC0: // PINGREQ
+    broker->pings++;
+    if( broker->mode!=BROKER_SILENT ) server_write(fd, "\xD0\x00", 2);
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+// Serves one broker connection on `fd`
+static void broker_serve(Server * server, int fd) {
+  Broker * broker = (Broker *)server->ctx;
+  std::string in;
+  char buf[4096];
+  for(;;) {
+    // A complete packet in `in`?
+    size_t pos = 1;
+    uint32_t len = 0;
+    int shift = 0;
+    while( pos<in.size() && pos<5 ) {
+      len |= (uint32_t)(in[pos]&0x7F) << shift;
+      shift += 7;
+      if( !(in[pos++]&0x80) ) break;
+    }
+    bool complete = pos>1 && !(in[pos-1]&0x80) && in.size()>=pos+len;
+    if( complete ) {
+      if( !broker_packet(server, fd, in[0], in.data()+pos, len) ) return;
+      in.erase(0, pos+len);
+      continue;
+    }
+    int n = server_read(server, fd, buf, sizeof buf, 20);
+    if( n<0 || broker->drop ) return;
+    in.append(buf, n);
+  }
+}
+
+
+static Server  server;
+static Broker  broker;
+static Mqtt    mqtt;
+
+
+// Polls the publisher until `done` (or 5 s passed)
+template<typename Done> static void poll_until(Done done) {
+  for( int i=0; i<5000 && !done(); i++ ) {
+    mqtt_poll(&mqtt);
+    usleep(1000);
+  }
+}
+
+
+// Number of PUBLISHes the broker received
+static int received() {
+  std::lock_guard<std::mutex> guard(server.lock);
+  return broker.publishes;
+}
+
+
+int main() {
+  uint16_t port = server_start(&server, broker_serve, &broker);
+  mqtt_init(&mqtt, "localhost", port, "emp1-test", "user", "secret");
+
+  // Session: one DNS lookup (with the short time-out), CONNECT with credentials and keep-alive
+  poll_until( []() { return mqtt_up(&mqtt); } );
+  check("connect", mqtt_up(&mqtt) && mqtt.connects==1 && broker.clientid=="emp1-test" && broker.user=="user"
+    && broker.password=="secret" && broker.keepalive==MQTT_KEEPALIVE, "(%d connects)", mqtt.connects);
+  check("dns", host_dns_lookups==1 && host_dns_timeout==MQTT_DNS_MS, "(%d lookups, %d ms)", host_dns_lookups, host_dns_timeout);
+
+  // Publishes are queued and pipelined, and arrive in order
+  char topic[32], payload[16];
+  for( int i=0; i<100; i++ ) {
+    snprintf(topic, sizeof topic, "emp1/f%d", i%5);
+    int len = snprintf(payload, sizeof payload, "%d.%03d", i, i);
+    mqtt_publish(&mqtt, topic, payload, len);
+    if( i%10==0 ) mqtt_poll(&mqtt);
+  }
+  poll_until( []() { return received()>=100; } );
+  bool pass = broker.payloads.size()==100;
+  for( int i=0; i<100 && pass; i++ ) {
+    snprintf(topic, sizeof topic, "emp1/f%d", i%5);
+    snprintf(payload, sizeof payload, "%d.%03d", i, i);
+    pass = broker.topics[i]==topic && broker.payloads[i]==payload;
+  }
+  check("publish", pass && mqtt.publishes==100 && mqtt.dropped==0 && broker.retained==0, "(%d received)", received());
+
+  // Retained publishes carry the flag
+  mqtt_publish(&mqtt, "emp1/Cons-kW", "0.586", 5, true);
+  poll_until( []() { return received()>=101; } );
+  check("retain", broker.retained==1 && broker.payloads.back()=="0.586", "(%d retained)", broker.retained);
+
+  // More than fits in the output buffer: the rest is dropped and counted, not blocked on
+  int queued = 0;
+  for( int i=0; i<1000; i++ ) queued += mqtt_publish(&mqtt, "emp1/burst", "0123456789", 10);
+  poll_until( [&]() { return received()>=101+queued; } );
+  check("full buffer", queued<1000 && mqtt.dropped==(uint32_t)(1000-queued) && received()==101+queued, "(%d of 1000 queued)", queued);
+
+  // Keep-alive: a PINGREQ after half the keep-alive interval of silence
+  delay(MQTT_KEEPALIVE*1000/2 + 1);
+  poll_until( []() { return !mqtt.ping && broker.pings==1; } );
+  check("ping", broker.pings==1 && !mqtt.ping && mqtt_up(&mqtt), "(%d pings)", broker.pings);
+
+  // No PINGRESP: the connection is dropped after MQTT_RESPONSE_MS
+  broker.mode = BROKER_SILENT;
+  delay(MQTT_KEEPALIVE*1000/2 + 1);
+  poll_until( []() { return broker.pings==2; } );
+  delay(MQTT_RESPONSE_MS + 1);
+  mqtt_poll(&mqtt);
+  check("no pingresp", !mqtt_up(&mqtt) && mqtt.failures==1, "(%d failures)", mqtt.failures);
+
+  // Publishes while down are dropped
+  uint32_t dropped = mqtt.dropped;
+  check("down", !mqtt_publish(&mqtt, "emp1/x", "1", 1) && mqtt.dropped==dropped+1);
+
+  // Reconnect after the retry delay
+  broker.mode = BROKER_OK;
+  delay(mqtt.retry);
+  poll_until( []() { return mqtt_up(&mqtt); } );
+  check("reconnect", mqtt_up(&mqtt) && mqtt.connects==2 && broker.sessions==2, "(%d connects)", mqtt.connects);
+
+  // Connection lost: noticed, and reconnected
+  broker.drop = true;
+  poll_until( []() { return !mqtt_up(&mqtt); } );
+  broker.drop = false;
+  check("lost", !mqtt_up(&mqtt) && mqtt.failures==2, "(%d failures)", mqtt.failures);
+
+  // Refused: the next try is after MQTT_RETRY_MAX
+  broker.mode = BROKER_REFUSE;
+  delay(mqtt.retry);
+  poll_until( []() { return mqtt.failures==3; } );
+  check("refused", !mqtt_up(&mqtt) && mqtt.failures==3 && mqtt.retry==MQTT_RETRY_MAX, "(retry %d ms)", mqtt.retry);
+
+  // Benchmark: publishes per second, end to end (queued, written and received by the broker)
+  broker.mode = BROKER_OK;
+  delay(MQTT_RETRY_MAX);
+  poll_until( []() { return mqtt_up(&mqtt); } );
+  {
+    std::lock_guard<std::mutex> guard(server.lock);
+    broker.bench = true;
+    broker.publishes = 0;
+  }
+  const int num = 200000;
+  uint32_t start = micros();
+  for( int i=1; i<=num; ) {
+    int len = snprintf(payload, sizeof payload, "%d", i);
+    if( mqtt_publish(&mqtt, "emp1/Cons-kW", payload, len) ) i++; else mqtt_poll(&mqtt);
+  }
+  while( received()<num && micros()-start<10000000 ) mqtt_poll(&mqtt);
+  uint32_t us = micros()-start;
+  check("bench", received()==num && broker.disorder==0, "(%d publishes/s)", (int)(num*1000000ULL/us));
+
+  server_stop(&server);
+  return check_done();
+}
@@ -0,0 +1,11 @@
+// test_p1parse.cpp - Runs the p1parse sketch on the host: its regression test and benchmark of the parser
+
+
+extern int test_fails;
+void setup();
+
+
+int main() {
+  setup(); // runs test_all() and bench_all()
+  return test_fails==0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+// test_ring.cpp - Stress tests the lock-free SPSC ring (ring) with a producer and a consumer thread
+
+
+#include <Arduino.h>
+#include <thread>
+#include <atomic>
+#include "ring.h"
+#include "check.h"
+
+
+#define TEST_BYTES   4000000 // bytes produced per phase
+#define TEST_SIZE       2048 // ring size, like UART_RXBUF_SIZE
+
+
+// The byte at position `pos` of the stream (not a multiple of the ring size, so a misplaced byte shows)
+static char byte_at(uint32_t pos) {
+  return (char)(pos*7 + pos/251);
+}
+
+
+// Producer: puts the stream in chunks of 1..128 bytes (a FIFO full, like the RX interrupt);
+// when `wait`, it waits for room, otherwise what does not fit is dropped (and counted as overrun by the ring)
+static void produce(Ring * ring, bool wait, uint32_t * dropped) {
+  char buf[128];
+  uint32_t pos = 0, seed = 1;
+  *dropped = 0;
+  while( pos<TEST_BYTES ) {
+    seed = seed*1103515245 + 12345;
+    int len = 1 + (seed>>16)%sizeof buf;
+    if( pos+len>TEST_BYTES ) len = TEST_BYTES-pos;
+    for( int i=0; i<len; i++ ) buf[i] = byte_at(pos+i);
+    while( wait && ring->size-ring_fill(ring)<(uint32_t)len ) std::this_thread::yield();
+    *dropped += len-ring_put(ring, buf, len);
+    pos += len;
+  }
+}
+
+
+// Runs a producer and a consumer thread on a fresh ring; when `lossless` the consumer checks every byte
+static void phase(const char * name, bool lossless) {
+  static char mem[TEST_SIZE];
+  Ring ring;
+  ring_init(&ring, mem, sizeof mem);
+  std::atomic<bool> done(false);
+  uint32_t dropped;
+  std::thread producer( [&]() { produce(&ring, lossless, &dropped); done = true; } );
+  uint32_t got = 0, wrong = 0;
+  char buf[300]; // smaller than the ring, so reads wrap too
+  for( ;; ) {
+    bool last = done; // read before the ring, so nothing put after it is missed
+    int n = ring_get(&ring, buf, sizeof buf);
+    if( lossless ) for( int i=0; i<n; i++ ) if( buf[i]!=byte_at(got+i) ) wrong++;
+    got += n;
+    if( n==0 && last ) break;
+    if( n==0 ) std::this_thread::yield();
+  }
+  producer.join();
+  char id[40];
+  snprintf(id, sizeof id, "%s.count", name);
+  check(id, got+ring.overruns==TEST_BYTES && ring.overruns==dropped, "(%d got, %d overruns)", got, ring.overruns);
+  snprintf(id, sizeof id, "%s.bytes", name);
+  if( lossless ) check(id, wrong==0 && ring.overruns==0, "(%d wrong)", wrong);
+  snprintf(id, sizeof id, "%s.highwater", name);
+  check(id, ring.highwater<=ring.size && ring_fill(&ring)==0, "(%d of %d)", ring.highwater, ring.size);
+}
+
+
+int main() {
+  phase("lossless", true);
+  phase("lossy", false);
+
+  // Wrap of the free running counters: start both near 2^32
+  static char mem[16];
+  Ring ring;
+  ring_init(&ring, mem, sizeof mem);
+  ring.head = ring.tail = 0xFFFFFFF8u;
+  char buf[16];
+  int put = ring_put(&ring, "0123456789abcdefXYZ", 19);
+  int got = ring_get(&ring, buf, sizeof buf);
+  check("wrap", put==16 && got==16 && memcmp(buf,"0123456789abcdef",16)==0 && ring.overruns==3, "(%d put, %d got)", put, got);
+
+  return check_done();
+}
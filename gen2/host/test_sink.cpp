@@ -0,0 +1,155 @@
+// test_sink.cpp - Tests the HTTP sink against a stand-in HTTP server on localhost
+
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <string>
+#include "sink.h"
+#include "server.h"
+#include "check.h"
+
+
+// How the stand-in server responds
+enum Http_Mode {
+  HTTP_KEEP,     // 200 with Content-Length, connection stays open
+  HTTP_CLOSE,    // 200 with Content-Length and "Connection: close"
+  HTTP_NOLENGTH, // 200 without length, the end of the body is the close
+  HTTP_CHUNKED,  // 200 with a chunked body (and a trailer), connection stays open
+  HTTP_NOBODY,   // 100 Continue, then 204 without length, connection stays open
+  HTTP_SILENT,   // no response at all
+};
+
+
+struct Http {
+  Http_Mode   mode;
+  int         requests; // number of requests received
+  std::string body;     // body of the last request
+};
+
+
+// Serves HTTP requests (with a Content-Length) on `fd`
+static void http_serve(Server * server, int fd) {
+  Http * http = (Http *)server->ctx;
+  std::string in;
+  char buf[1024];
+  for(;;) {
+    size_t end = in.find("\r\n\r\n");
+    size_t len = 0;
+    if( end!=std::string::npos ) {
+      size_t cl = in.find("Content-Length: ");
+      if( cl!=std::string::npos && cl<end ) len = atoi(in.c_str()+cl+16);
+    }
+    if( end==std::string::npos || in.size()<end+4+len ) {
+      int n = server_read(server, fd, buf, sizeof buf);
+      if( n<=0 ) return;
+      in.append(buf, n);
+      continue;
+    }
+    std::lock_guard<std::mutex> guard(server->lock);
+    http->requests++;
+    http->body = in.substr(end+4, len);
+    in.erase(0, end+4+len);
+    if( http->mode==HTTP_KEEP ) server_write(fd, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok", 40);
+    if( http->mode==HTTP_CLOSE ) { server_write(fd, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok", 59); return; }
+    if( http->mode==HTTP_NOLENGTH ) { server_write(fd, "HTTP/1.1 200 OK\r\n\r\nsome body", 28); return; }
+    if( http->mode==HTTP_CHUNKED ) {
+      const char * resp = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "4;ext=1\r\nok\r\n\r\n" "4b\r\n" "a chunk of 75 bytes, with a CR LF in it\r\nthat does not end the chunk.......\r\n"
+        "0\r\nX-Trailer: 1\r\n\r\n";
+      server_write(fd, resp, strlen(resp));
+    }
+    if( http->mode==HTTP_NOBODY ) {
+      const char * resp = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 204 No Content\r\n\r\n";
+      server_write(fd, resp, strlen(resp));
+    }
+  }
+}
+
+
+static Server  server;
+static Http    http;
+static Sink    sink;
+static char    sink_buf[20000];
+static int     done_ok;     // requests reported done with ok
+static int     done_failed; // requests reported done without ok
+
+
+// Counts the requests that ended (see Sink_Done)
+static void done(Sink * s, bool ok, void * ctx) {
+  if( s==&sink && ctx==&sink ) { if( ok ) done_ok++; else done_failed++; }
+}
+
+
+// Submits a POST with `body`, and polls the sink until it is done; `skip` ms are added to the clock per poll
+static void post(const std::string & body, uint32_t skip=0) {
+  int size;
+  char * buf = sink_request(&sink, &size);
+  if( buf==NULL ) { check("request", false, "(busy)"); return; }
+  int len = snprintf(buf, size, "POST /p HTTP/1.1\r\nHost: localhost\r\nContent-Length: %d\r\n\r\n%s", (int)body.size(), body.c_str());
+  sink_submit(&sink, len);
+  for( int i=0; i<5000 && sink_busy(&sink); i++ ) {
+    sink_poll(&sink);
+    delay(skip);
+    usleep(1000);
+  }
+}
+
+
+int main() {
+  uint16_t port = server_start(&server, http_serve, &http);
+  sink_init(&sink, "test", "localhost", sink_buf, sizeof sink_buf, port);
+  sink.done = done;
+  sink.ctx = &sink;
+
+  // Keep-alive: one DNS lookup (with the short time-out) and one connect for all requests
+  http.mode = HTTP_KEEP;
+  post("field1=1");
+  post("field1=2");
+  post("field1=3");
+  check("keep-alive", sink.requests==3 && sink.connects==1 && server.connections==1 && http.body=="field1=3", "(%d requests, %d connects)", sink.requests, sink.connects);
+  check("dns", host_dns_lookups==1 && host_dns_timeout==SINK_DNS_MS, "(%d lookups, %d ms)", host_dns_lookups, host_dns_timeout);
+
+  // A large request goes out in pieces, as the socket accepts
+  std::string large(16000, 'x');
+  post(large);
+  check("large", sink.requests==4 && http.body==large, "(%d bytes)", (int)http.body.size());
+
+  // Chunked response: it ends with the 0 size chunk, and the connection is reused
+  http.mode = HTTP_CHUNKED;
+  post("field1=c1");
+  post("field1=c2", 100);
+  check("chunked", sink.requests==6 && sink.failures==0 && sink.connects==1 && http.body=="field1=c2", "(%d failures, %d connects)", sink.failures, sink.connects);
+
+  // 100 Continue and 204: no body, and the connection is reused
+  http.mode = HTTP_NOBODY;
+  post("field1=n1");
+  post("field1=n2", 100);
+  check("no content", sink.requests==8 && sink.failures==0 && sink.connects==1 && server.connections==1, "(%d failures, %d connects)", sink.failures, sink.connects);
+
+  // Server closes: the next request reconnects (the address stays cached)
+  http.mode = HTTP_CLOSE;
+  post("field1=4");
+  post("field1=5");
+  check("close", sink.requests==10 && sink.connects==2 && host_dns_lookups==1, "(%d connects)", sink.connects);
+
+  // Response without length: it ends when the server closes
+  http.mode = HTTP_NOLENGTH;
+  post("field1=6");
+  check("no length", sink.requests==11 && sink.failures==0, "(%d requests)", sink.requests);
+
+  // No response: the sink gives up after SINK_RESPONSE_MS
+  http.mode = HTTP_SILENT;
+  post("field1=7", 100);
+  check("timeout", sink.requests==11 && sink.failures==1 && !sink_busy(&sink), "(%d failures)", sink.failures);
+
+  // Server gone: the connect fails, and the address is resolved again next time
+  server_stop(&server);
+  post("field1=8");
+  post("field1=9");
+  check("refused", sink.failures==3 && host_dns_lookups==2, "(%d failures, %d lookups)", sink.failures, host_dns_lookups);
+
+  // Every request was reported done, with its outcome
+  check("done", done_ok==(int)sink.requests && done_failed==(int)sink.failures, "(%d ok, %d failed)", done_ok, done_failed);
+
+  return check_done();
+}
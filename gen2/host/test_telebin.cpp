@@ -0,0 +1,110 @@
+// test_telebin.cpp - Tests the telebin encoder and decoder, built without the Arduino stand-in (as host tools use it)
+
+
+#include <stdio.h>
+#include <string.h>
+#include "telebin.h"
+#include "check.h"
+
+
+#define NUM 8 // fields per frame in these tests
+
+
+// Encodes `frames` frames of `values` (NUM per frame) with `times` after each other into `buf`, returns the total length
+static size_t encode(const int32_t * times, const int32_t (*values)[NUM], int frames, uint8_t * buf, size_t size, size_t * lens) {
+  Telebin_State st;
+  telebin_reset(&st);
+  size_t pos = 0;
+  for( int f=0; f<frames; f++ ) {
+    lens[f] = telebin_encode(&st, 0x1234, times[f], values[f], NUM, buf+pos, size-pos);
+    pos += lens[f];
+  }
+  return pos;
+}
+
+
+// Decodes the concatenated frames in `buf` and compares them with `times` and `values`; returns the number of matching frames
+static int decode(const uint8_t * buf, size_t len, const int32_t * times, const int32_t (*values)[NUM], int frames) {
+  Telebin_State st;
+  telebin_reset(&st);
+  size_t pos = 0;
+  int ok = 0;
+  for( int f=0; f<frames; f++ ) {
+    uint16_t schema;
+    int32_t time;
+    int32_t vals[NUM];
+    size_t n = telebin_decode(&st, buf+pos, len-pos, &schema, &time, vals, NUM);
+    if( n==0 ) break;
+    pos += n;
+    if( schema==0x1234 && time==times[f] && memcmp(vals,values[f],sizeof vals)==0 ) ok++;
+  }
+  return pos==len ? ok : -1;
+}
+
+
+int main() {
+  static uint8_t buf[10*TELEBIN_FRAME_SIZE];
+  size_t lens[10];
+
+  // A key frame and delta frames (a few watts and a tick of the energy counter apart) round-trip
+  const int32_t times[] = { 707764422, 707764423, 707764424, 707764434 };
+  const int32_t values[][NUM] = {
+    { 586, 0, 19235878, 6712001, 20, 3, 0, 16051816 },
+    { 590, 0, 19235879, 6712001, 20, 3, 0, 16051816 },
+    { 590, 0, 19235879, 6712001, 20, 3, 0, 16051816 },
+    { 0, 1200, 19235879, 6712004, 20, 3, 0, 16051822 },
+  };
+  size_t len = encode(times, values, 4, buf, sizeof buf, lens);
+  check("round-trip", decode(buf, len, times, values, 4)==4, "(%d bytes for %d frames)", (int)len, 4);
+  check("key frame", buf[1]==TELEBIN_FLAG_KEY && buf[lens[0]+1]==0, "(flags %d then %d)", buf[1], buf[lens[0]+1]);
+  check("unchanged", lens[2]==4+1+1+2, "(%d bytes)", (int)lens[2]);
+
+  // Deltas that wrap around INT32 (in value and time) still round-trip
+  const int32_t wtimes[] = { INT32_MAX, INT32_MIN, 0 };
+  const int32_t wvalues[][NUM] = {
+    { INT32_MAX, INT32_MIN, INT32_MIN, 0, -1, 1, INT32_MAX, 0 },
+    { INT32_MIN, INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, -1, -INT32_MAX, 0 },
+    { 0, 0, INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, 1, -1 },
+  };
+  len = encode(wtimes, wvalues, 3, buf, sizeof buf, lens);
+  check("wrap-around", decode(buf, len, wtimes, wvalues, 3)==3, "(%d bytes)", (int)len);
+
+  // A frame cut short anywhere is rejected, and leaves the state as it was
+  len = encode(times, values, 2, buf, sizeof buf, lens);
+  Telebin_State st, before;
+  uint16_t schema;
+  int32_t time;
+  int32_t vals[NUM];
+  int accepted = 0;
+  for( size_t cut=0; cut<lens[1]; cut++ ) {
+    telebin_reset(&st);
+    telebin_decode(&st, buf, lens[0], &schema, &time, vals, NUM);
+    before = st;
+    if( telebin_decode(&st, buf+lens[0], cut, &schema, &time, vals, NUM)!=0 || memcmp(&st,&before,sizeof st)!=0 ) accepted++;
+  }
+  check("truncated", accepted==0, "(%d of %d cuts accepted)", accepted, (int)lens[1]);
+
+  // A flipped bit anywhere in a frame is rejected (by the CRC, or earlier)
+  accepted = 0;
+  for( size_t bit=0; bit<8*lens[0]; bit++ ) {
+    buf[bit/8] ^= 1<<(bit%8);
+    telebin_reset(&st);
+    if( telebin_decode(&st, buf, lens[0], &schema, &time, vals, NUM)!=0 ) accepted++;
+    buf[bit/8] ^= 1<<(bit%8);
+  }
+  check("crc mismatch", accepted==0, "(%d of %d flips accepted)", accepted, (int)(8*lens[0]));
+
+  // A delta frame needs the previous frame: not after a reset (e.g. when the key frame was lost)
+  telebin_reset(&st);
+  check("no prior state", telebin_decode(&st, buf+lens[0], lens[1], &schema, &time, vals, NUM)==0 && !st.valid);
+
+  // A frame with more fields than the decoder expects (another schema) is rejected
+  telebin_reset(&st);
+  size_t n = telebin_decode(&st, buf, lens[0], &schema, &time, vals, NUM-1);
+  check("too many fields", n==0 && !st.valid, "(mask of %d fields, decoded %d)", NUM, NUM-1);
+  telebin_reset(&st);
+  n = telebin_decode(&st, buf, lens[0], &schema, &time, vals, NUM);
+  check("expected fields", n==lens[0], "(%d bytes)", (int)n);
+
+  return check_done();
+}
@@ -0,0 +1,158 @@
+// test_tmpl.cpp - Tests that the compiled templates (tmpl) render byte for byte as the original substitution did
+
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "tele.h"
+#include "crc16.h"
+#include "tmpl.h"
+#include "agg.h"
+#include "telegen.h"
+#include "meterlog.h"
+#include "check.h"
+
+
+// === REFERENCE ================================================================================
+// The substitution as the firmware did it before templates were compiled (http_strncpy and http_subst, verbatim).
+
+
+int http_strncpy(char *buf, int size, const char * nums, bool skipdot) {
+  const char *r=nums; // read pointer
+  char *w=buf;  // write pointer
+  // r points to a numeric string; strip leading 0s
+  while( *r=='0' && ( isdigit(*(r+1)) || (skipdot && *(r+1)=='.') ) ) r++; // must terminate e.g. on "0\0"
+  while( *r!='\0' && size>1 ) {
+    if( *r!='.' || !skipdot) { *w = *r; w++; size--; }
+    r++;
+  }
+  *w='\0'; w++; size--;
+  return w-buf-1;
+}
+
+
+int http_subst(char *buf, int size, const char * fmt ) {
+  const char *r=fmt; // read pointer
+  char *w=buf; // write pointer
+  while( *r!='\0' && size>1 ) {
+    if( *r=='%' ) {
+      // Skip escape character (%)
+      r++;
+      // Is there a * modifier
+      bool skipdot = *r=='.';
+      if( skipdot ) r++;
+      // Get the key
+      char key = *r++;
+      // Lookup value associatied with the key (if any)
+      const char * value = NULL;
+      for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+        if( tele_field_key(i) == key ) { value=tele_field_value(i); break; }
+      }
+      // Was the key found
+      if( value==NULL ) {
+        // key was not found, insert it
+        if( size>1 ) { *w='%'; w++; size--; }
+        if( size>1 && skipdot ) { *w='.'; w++; size--; }
+        if( size>1 && !skipdot && key!='%' ) { *w=key; w++; size--; }
+      } else {
+        int len=http_strncpy(w,size,value,skipdot); 
+        if( len>size-1) len=size-1;
+        w+=len; size-=len;
+      }
+    } else {
+      // Plain character; copy
+      *w=*r; w++; size--; r++; 
+    }
+  }
+  // Add terminating zero
+  *w='\0'; w++; size--;
+  // Return bytes written
+  return w-buf-1;
+}
+
+
+// === TEST =====================================================================================
+
+
+static std::vector<std::string> fmts;  // per key of the field table a template with it, with and without dot; and unknown keys
+static std::vector<Tmpl>        tmpls;
+static int                      telegrams;
+static int                      same;
+
+
+// Renders the templates both ways for the last telegram, and each field as tmpl_field(); counts in `same` when all are equal
+static void compare() {
+  static char want[200];
+  static char got[200];
+  bool pass = true;
+  for( size_t t=0; t<fmts.size(); t++ ) {
+    http_subst(want, sizeof want, fmts[t].c_str());
+    int len = tmpl_render(&tmpls[t], got, sizeof got);
+    if( strcmp(want,got)!=0 || len!=tmpl_length(&tmpls[t]) ) { pass = false; Serial.printf("test: want '%s' got '%s'\n", want, got); }
+  }
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    tmpl_field(got, sizeof got, i);
+    http_strncpy(want, sizeof want, tele_field_value(i), false);
+    if( strcmp(want,got)!=0 ) { pass = false; Serial.printf("test: want '%s' got '%s'\n", want, got); }
+  }
+  telegrams++;
+  same += pass;
+}
+
+
+// Feeds `stream` to the parser, comparing after every telegram
+static void feed(const char * stream, int len) {
+  for( int i=0; i<len; i++ ) if( tele_parser_add((uint8_t)stream[i])==TELE_RESULT_AVAILABLE ) compare();
+}
+
+
+// Feeds example 1 with its power replaced by `power` (and the CRC fixed)
+static void feed_power(const char * power) {
+  std::string t = TELE_EXAMPLE_1;
+  t.replace(t.find("(00.586*kW)"), 11, std::string("(")+power+"*kW)");
+  size_t excl = t.find('!');
+  char hex[5];
+  snprintf(hex, sizeof hex, "%04X", crc16_update(CRC16_INIT, t.c_str(), excl+1));
+  t.replace(excl+1, 4, hex);
+  feed(t.c_str(), t.size());
+}
+
+
+int main() {
+  tele_init();
+  agg_init(60);
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    char key = tele_field_key(i);
+    fmts.push_back( std::string("field=%")+key+"&nodot=%."+key+"&both=%"+key+"%."+key );
+  }
+  fmts.push_back( "unknown=%z&nodot=%.z&percent=%%&end=100%%" );
+  tmpls.resize(fmts.size());
+  bool ok = true;
+  for( size_t t=0; t<fmts.size(); t++ ) ok = tmpl_compile(&tmpls[t], fmts[t].c_str()) && ok;
+  check("compile", ok, "(%d templates)", (int)fmts.size());
+
+  // The recorded telegrams
+  const char * recorded = TELE_EXAMPLE_1 TELE_EXAMPLE_2 TELE_EXAMPLE_3 METERLOG_1 METERLOG_2 METERLOG_3;
+  feed(recorded, strlen(recorded));
+  check("recorded", telegrams==6 && same==telegrams, "(%d of %d telegrams)", same, telegrams);
+
+  // Values with zeros, e.g. "%.P" on "00.000" is "000", and on "00.050" is "050"
+  static const char * const powers[] = { "00.000", "00.050", "00.500", "10.000", "99.999" };
+  telegrams = same = 0;
+  for( const char * power : powers ) feed_power(power);
+  check("zeros", telegrams==5 && same==telegrams, "(%d of %d telegrams)", same, telegrams);
+
+  // Generated telegrams of several meter shapes (with all fields, the parser requires them)
+  static const int shapes[] = { TELEGEN_3PHASE | TELEGEN_GAS, TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS | TELEGEN_MESSAGE, 
+    TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS | TELEGEN_FAILLOG };
+  telegrams = same = 0;
+  for( int flags : shapes ) {
+    Telegen gen;
+    telegen_init(&gen, flags, 2022);
+    static char buf[4000];
+    for( int i=0; i<100; i++ ) { int len = telegen_next(&gen, buf, sizeof buf); feed(buf, len); }
+  }
+  check("generated", telegrams==300 && same==telegrams, "(%d of %d telegrams)", same, telegrams);
+
+  return check_done();
+}
@@ -0,0 +1,128 @@
+// wifi.cpp - Host stand-in for the ESP8266 WiFi library: the station is always connected, clients are real sockets
+
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "ESP8266WiFi.h"
+
+
+// === WIFI =====================================================================================
+
+
+ESP8266WiFiClass WiFi;
+EspClass         ESP;
+int              host_dns_lookups;
+uint32_t         host_dns_timeout;
+
+
+String IPAddress::toString() const {
+  char s[16];
+  snprintf(s, sizeof s, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+  return String(s);
+}
+
+
+int ESP8266WiFiClass::hostByName(const char * host, IPAddress & ip, uint32_t timeout_ms) {
+  host_dns_lookups++;
+  host_dns_timeout = timeout_ms;
+  struct addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo * res;
+  if( getaddrinfo(host, NULL, &hints, &res)!=0 ) return 0;
+  const uint8_t * a = (const uint8_t *)&((struct sockaddr_in *)res->ai_addr)->sin_addr;
+  ip = IPAddress(a[0], a[1], a[2], a[3]);
+  freeaddrinfo(res);
+  return 1;
+}
+
+
+// === CLIENT ===================================================================================
+
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  stop();
+  _fd = socket(AF_INET, SOCK_STREAM, 0);
+  if( _fd<0 ) return 0;
+  fcntl(_fd, F_SETFL, O_NONBLOCK);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  memcpy(&addr.sin_addr, ip.b, 4);
+  if( ::connect(_fd, (struct sockaddr *)&addr, sizeof addr)<0 ) {
+    // Wait for the connect to complete, at most the timeout
+    struct pollfd p = { _fd, POLLOUT, 0 };
+    int err = 0;
+    socklen_t len = sizeof err;
+    if( errno!=EINPROGRESS || poll(&p,1,_timeout)!=1 || getsockopt(_fd,SOL_SOCKET,SO_ERROR,&err,&len)<0 || err!=0 ) { stop(); return 0; }
+  }
+  return 1;
+}
+
+
+int WiFiClient::connect(const char * host, uint16_t port) {
+  IPAddress ip;
+  if( !WiFi.hostByName(host, ip, _timeout) ) return 0;
+  return connect(ip, port);
+}
+
+
+uint8_t WiFiClient::connected() {
+  if( _fd<0 ) return 0;
+  char ch;
+  int n = recv(_fd, &ch, 1, MSG_PEEK|MSG_DONTWAIT);
+  if( n>0 ) return 1;
+  return n<0 && (errno==EAGAIN || errno==EWOULDBLOCK);
+}
+
+
+int WiFiClient::available() {
+  int n = 0;
+  if( _fd<0 || ioctl(_fd, FIONREAD, &n)<0 ) return 0;
+  return n;
+}
+
+
+int WiFiClient::availableForWrite() {
+  struct pollfd p = { _fd, POLLOUT, 0 };
+  return _fd>=0 && poll(&p,1,0)==1 && (p.revents&POLLOUT) ? 1460 : 0;
+}
+
+
+int WiFiClient::read() {
+  uint8_t ch;
+  return read(&ch,1)==1 ? ch : -1;
+}
+
+
+int WiFiClient::read(uint8_t * buf, size_t size) {
+  if( _fd<0 ) return -1;
+  int n = recv(_fd, buf, size, MSG_DONTWAIT);
+  return n>0 ? n : -1;
+}
+
+
+size_t WiFiClient::write(const uint8_t * buf, size_t size) {
+  if( _fd<0 ) return 0;
+  int n = send(_fd, buf, size, MSG_DONTWAIT|MSG_NOSIGNAL);
+  return n>0 ? n : 0;
+}
+
+
+void WiFiClient::stop() {
+  if( _fd>=0 ) close(_fd);
+  _fd = -1;
+}
+
+
+void WiFiClient::setNoDelay(bool nodelay) {
+  int on = nodelay;
+  if( _fd>=0 ) setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
@@ -0,0 +1,125 @@
+// meterlog.h - Telegrams captured in p1echo/meter.log, for testing the parser
+#ifndef _METERLOG_H_
+#define _METERLOG_H_
+
+
+// The annotations of the first telegram are stripped.
+// The meter ids in meter.log are anonymized but the CRCs were not adapted; that is done here.
+
+
+#define METERLOG_1 \
+  "/KFM5KAIFA-METER\r\n" \
+  "\r\n" \
+  "1-3:0.2.8(42)\r\n" \
+  "0-0:1.0.0(220605132822S)\r\n" \
+  "0-0:96.1.1(456d795f73657269616c5f6e756d626572)\r\n" \
+  "1-0:1.8.1(019232.216*kWh)\r\n" \
+  "1-0:1.8.2(016881.373*kWh)\r\n" \
+  "1-0:2.8.1(000000.000*kWh)\r\n" \
+  "1-0:2.8.2(000000.000*kWh)\r\n" \
+  "0-0:96.14.0(0001)\r\n" \
+  "1-0:1.7.0(00.393*kW)\r\n" \
+  "1-0:2.7.0(00.000*kW)\r\n" \
+  "0-0:96.7.21(00020)\r\n" \
+  "0-0:96.7.9(00008)\r\n" \
+  "1-0:99.97.0(3)(0-0:96.7.19)(211209190618W)(0000003557*s)(210416081947S)(0000004676*s)(000101000011W)(2147483647*s)\r\n" \
+  "1-0:32.32.0(00000)\r\n" \
+  "1-0:52.32.0(00000)\r\n" \
+  "1-0:72.32.0(00000)\r\n" \
+  "1-0:32.36.0(00000)\r\n" \
+  "1-0:52.36.0(00000)\r\n" \
+  "1-0:72.36.0(00000)\r\n" \
+  "0-0:96.13.1()\r\n" \
+  "0-0:96.13.0()\r\n" \
+  "1-0:31.7.0(000*A)\r\n" \
+  "1-0:51.7.0(001*A)\r\n" \
+  "1-0:71.7.0(000*A)\r\n" \
+  "1-0:21.7.0(00.001*kW)\r\n" \
+  "1-0:22.7.0(00.000*kW)\r\n" \
+  "1-0:41.7.0(00.205*kW)\r\n" \
+  "1-0:42.7.0(00.000*kW)\r\n" \
+  "1-0:61.7.0(00.187*kW)\r\n" \
+  "1-0:62.7.0(00.000*kW)\r\n" \
+  "0-1:24.1.0(003)\r\n" \
+  "0-1:96.1.0(476d795f73657269616c5f6e756d626572)\r\n" \
+  "0-1:24.2.1(220605130000S)(16051.302*m3)\r\n" \
+  "!6AAB\r\n"
+
+#define METERLOG_2 \
+  "/KFM5KAIFA-METER\r\n" \
+  "\r\n" \
+  "1-3:0.2.8(42)\r\n" \
+  "0-0:1.0.0(220605132831S)\r\n" \
+  "0-0:96.1.1(456d795f73657269616c5f6e756d626572)\r\n" \
+  "1-0:1.8.1(019232.217*kWh)\r\n" \
+  "1-0:1.8.2(016881.373*kWh)\r\n" \
+  "1-0:2.8.1(000000.000*kWh)\r\n" \
+  "1-0:2.8.2(000000.000*kWh)\r\n" \
+  "0-0:96.14.0(0001)\r\n" \
+  "1-0:1.7.0(00.394*kW)\r\n" \
+  "1-0:2.7.0(00.000*kW)\r\n" \
+  "0-0:96.7.21(00020)\r\n" \
+  "0-0:96.7.9(00008)\r\n" \
+  "1-0:99.97.0(3)(0-0:96.7.19)(211209190618W)(0000003557*s)(210416081947S)(0000004676*s)(000101000011W)(2147483647*s)\r\n" \
+  "1-0:32.32.0(00000)\r\n" \
+  "1-0:52.32.0(00000)\r\n" \
+  "1-0:72.32.0(00000)\r\n" \
+  "1-0:32.36.0(00000)\r\n" \
+  "1-0:52.36.0(00000)\r\n" \
+  "1-0:72.36.0(00000)\r\n" \
+  "0-0:96.13.1()\r\n" \
+  "0-0:96.13.0()\r\n" \
+  "1-0:31.7.0(000*A)\r\n" \
+  "1-0:51.7.0(001*A)\r\n" \
+  "1-0:71.7.0(000*A)\r\n" \
+  "1-0:21.7.0(00.001*kW)\r\n" \
+  "1-0:22.7.0(00.000*kW)\r\n" \
+  "1-0:41.7.0(00.206*kW)\r\n" \
+  "1-0:42.7.0(00.000*kW)\r\n" \
+  "1-0:61.7.0(00.187*kW)\r\n" \
+  "1-0:62.7.0(00.000*kW)\r\n" \
+  "0-1:24.1.0(003)\r\n" \
+  "0-1:96.1.0(476d795f73657269616c5f6e756d626572)\r\n" \
+  "0-1:24.2.1(220605130000S)(16051.302*m3)\r\n" \
+  "!9D23\r\n"
+
+#define METERLOG_3 \
+  "/KFM5KAIFA-METER\r\n" \
+  "\r\n" \
+  "1-3:0.2.8(42)\r\n" \
+  "0-0:1.0.0(220605132841S)\r\n" \
+  "0-0:96.1.1(456d795f73657269616c5f6e756d626572)\r\n" \
+  "1-0:1.8.1(019232.218*kWh)\r\n" \
+  "1-0:1.8.2(016881.373*kWh)\r\n" \
+  "1-0:2.8.1(000000.000*kWh)\r\n" \
+  "1-0:2.8.2(000000.000*kWh)\r\n" \
+  "0-0:96.14.0(0001)\r\n" \
+  "1-0:1.7.0(00.392*kW)\r\n" \
+  "1-0:2.7.0(00.000*kW)\r\n" \
+  "0-0:96.7.21(00020)\r\n" \
+  "0-0:96.7.9(00008)\r\n" \
+  "1-0:99.97.0(3)(0-0:96.7.19)(211209190618W)(0000003557*s)(210416081947S)(0000004676*s)(000101000011W)(2147483647*s)\r\n" \
+  "1-0:32.32.0(00000)\r\n" \
+  "1-0:52.32.0(00000)\r\n" \
+  "1-0:72.32.0(00000)\r\n" \
+  "1-0:32.36.0(00000)\r\n" \
+  "1-0:52.36.0(00000)\r\n" \
+  "1-0:72.36.0(00000)\r\n" \
+  "0-0:96.13.1()\r\n" \
+  "0-0:96.13.0()\r\n" \
+  "1-0:31.7.0(000*A)\r\n" \
+  "1-0:51.7.0(001*A)\r\n" \
+  "1-0:71.7.0(000*A)\r\n" \
+  "1-0:21.7.0(00.001*kW)\r\n" \
+  "1-0:22.7.0(00.000*kW)\r\n" \
+  "1-0:41.7.0(00.205*kW)\r\n" \
+  "1-0:42.7.0(00.000*kW)\r\n" \
+  "1-0:61.7.0(00.187*kW)\r\n" \
+  "1-0:62.7.0(00.000*kW)\r\n" \
+  "0-1:24.1.0(003)\r\n" \
+  "0-1:96.1.0(476d795f73657269616c5f6e756d626572)\r\n" \
+  "0-1:24.2.1(220605130000S)(16051.302*m3)\r\n" \
+  "!9BC0\r\n"
+
+
+#endif
@@ -24,6 +24,9 @@
 
 
 #include "tele.h"
+#include "crc16.h"
+#include "meterlog.h"
+#include "telegen.h"
 
 
 void uart_init() {
@@ -34,11 +37,454 @@ void uart_init() {
   Serial.printf("uart: init\n");
 }
 
+
+// === TEST ============================================================================================
+// Regression test for the parser: replays telegrams (examples and meter.log) and checks the parser results.
+// Each test case feeds a stream to the parser and counts the TELE_RESULT_AVAILABLE and TELE_RESULT_ERROR results.
+// The stream can be mutated first: `find` is replaced by `repl`, and when `fixcrc` is set the CRC is recomputed,
+// so that e.g. a missing field is not detected as a CRC error.
+// An @ in the stream causes a wait of 1000ms (feeding -1), this is the clock control to test timeouts.
+
+
+#define TEST_BUF_SIZE 4000
+
+
+// A test case
+struct Test_Case {
+  const char * name;
+  const char * stream;
+  const char * find;    // NULL for no mutation
+  const char * repl;
+  bool         fixcrc;
+  int          available; // expected number of available telegrams
+  int          errors;    // expected number of errors
+  const char * power;     // expected value of Cons-kW afterwards (NULL for don't care)
+};
+
+
+#define TEST_PARTIAL "/KFM5KAIFA-METER\r\n\r\n1-3:0.2.8(42)\r\n1-0:1.8.1(0192"
+
+
+static const Test_Case test_cases[] = {
+  { "example 1"       , TELE_EXAMPLE_1                                 , NULL                         , NULL                  , false, 1, 0, NULL },
+  { "examples 1-3"    , TELE_EXAMPLE_1 TELE_EXAMPLE_2 TELE_EXAMPLE_3   , NULL                         , NULL                  , false, 3, 0, NULL },
+  { "meter.log"       , METERLOG_1 METERLOG_2 METERLOG_3               , NULL                         , NULL                  , false, 3, 0, NULL },
+  { "noise"           , "noise" TELE_EXAMPLE_1 "much\r\nmore noise" TELE_EXAMPLE_2, NULL           , NULL                  , false, 2, 2, NULL },
+  { "timeout"         , TEST_PARTIAL "@@@@@@@@@@@" TELE_EXAMPLE_2      , NULL                         , NULL                  , false, 1, 1, NULL },
+  { "crc error"       , TELE_EXAMPLE_1                                 , "(00.586*kW)"                , "(00.587*kW)"         , false, 0, 1, NULL },
+  { "keep last good"  , TELE_EXAMPLE_1 TELE_EXAMPLE_2                  , "(00.590*kW)"                , "(00.599*kW)"         , false, 1, 1, "00.586" },
+  { "crc corrupt"     , TELE_EXAMPLE_1                                 , "!78CA"                      , "!78CX"               , false, 0, 1, NULL },
+  { "missing field"   , TELE_EXAMPLE_1                                 , "1-0:1.7.0(00.586*kW)\r\n"   , ""                    , true , 0, 1, NULL },
+  { "no close delim"  , TELE_EXAMPLE_1                                 , "(00.586*kW)"                , "(00.586kW)"          , true , 0, 1, NULL },
+  { "value too wide"  , TELE_EXAMPLE_1                                 , "(00.586*kW)"                , "(00.58600000000000*kW)", true , 0, 1, NULL },
+  { "not numeric"     , TELE_EXAMPLE_1                                 , "(00.586*kW)"                , "(00.5x6*kW)"         , true , 0, 1, NULL },
+  { "empty value"     , TELE_EXAMPLE_1                                 , "(00.586*kW)"                , "(*kW)"               , true , 0, 1, NULL },
+  { "no CR"           , TELE_EXAMPLE_1                                 , "(00.586*kW)\r\n"            , "(00.586*kW)\n"       , true , 0, 1, NULL },
+  { "header corrupt"  , TELE_EXAMPLE_1                                 , "/KFM5"                      , "/KFM4"               , true , 0, 1, NULL },
+  { "long message"    , TELE_EXAMPLE_1                                 , "0-0:96.13.0()"              , "0-0:96.13.0("
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      "303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F303132333435363738393A3B3C3D3E3F"
+      ")"                                                                                                                     , true , 1, 0, NULL },
+};
+#define TEST_NUMCASES ( sizeof(test_cases)/sizeof(test_cases[0]) )
+
+
+static char test_buf[TEST_BUF_SIZE];
+
+
+// Copies `stream` to test_buf, replaces the first `find` by `repl`, and recomputes the CRC of the first telegram when `fixcrc`
+static bool test_mutate(const Test_Case * tc) {
+  if( strlen(tc->stream)+1 > TEST_BUF_SIZE ) return false;
+  strcpy(test_buf, tc->stream);
+  if( tc->find==NULL ) return true;
+  char * pos = strstr(test_buf, tc->find);
+  if( pos==NULL ) return false;
+  size_t flen = strlen(tc->find);
+  size_t rlen = strlen(tc->repl);
+  if( strlen(test_buf)-flen+rlen+1 > TEST_BUF_SIZE ) return false;
+  memmove(pos+rlen, pos+flen, strlen(pos+flen)+1);
+  memcpy(pos, tc->repl, rlen);
+  if( tc->fixcrc ) {
+    char * excl = strchr(test_buf,'!');
+    if( excl==NULL || strlen(excl)<5 ) return false;
+    char hex[5];
+    snprintf(hex, sizeof hex, "%04X", crc16_update(CRC16_INIT, test_buf, excl-test_buf+1) );
+    memcpy(excl+1, hex, 4);
+  }
+  return true;
+}
+
+
+// Runs one test case, returns true iff it passes. Also prints the parse time per telegram (excluding the @ waits).
+// With `chunk` 1 the stream is fed with tele_parser_add(), otherwise in chunks of (up to) `chunk` chars with tele_parser_add_buf().
+static bool test_run(const Test_Case * tc, size_t chunk) {
+  if( !test_mutate(tc) ) { Serial.printf("test: %-15s FAIL (mutation)\n",tc->name); return false; }
+  tele_init(); // restart parser from idle
+  int available = 0;
+  int errors = 0;
+  uint32_t us = 0;
+  const char * s = test_buf;
+  while( *s!='\0' ) {
+    if( *s=='@' ) {
+      delay(1000);
+      if( tele_parser_add(-1)==TELE_RESULT_ERROR ) errors++;
+      s++;
+    } else if( chunk==1 ) {
+      uint32_t start = micros();
+      Tele_Result res = tele_parser_add((uint8_t)*s++);
+      us += micros() - start;
+      if( res==TELE_RESULT_AVAILABLE ) available++;
+      if( res==TELE_RESULT_ERROR ) errors++;
+    } else {
+      size_t len = strcspn(s,"@");
+      if( len>chunk ) len = chunk;
+      uint32_t start = micros();
+      available += tele_parser_add_buf(s, len, &errors);
+      us += micros() - start;
+      s += len;
+    }
+  }
+  bool pass = available==tc->available && errors==tc->errors;
+  if( tc->power!=NULL ) {
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_key(i)=='P' && strcmp(tele_field_value(i),tc->power)!=0 ) pass= false;
+  }
+  int telegrams = available+errors>0 ? available+errors : 1;
+  Serial.printf("test: %-15s %s (chunk %3u, available %d/%d, errors %d/%d, %u us/telegram)\n",tc->name, pass?"pass":"FAIL", (unsigned)chunk, available,tc->available, errors,tc->errors, us/telegrams);
+  return pass;
+}
+
+
+// Tokenizer callback: appends "obis#group=value*unit " to the string in `ctx` for the multi-group objects
+static void test_token(const Tele_Token * token, void * ctx) {
+  if( strcmp(token->obis,"0-1:24.2.1")!=0 && strcmp(token->obis,"1-0:99.97.0")!=0 ) return;
+  char * s = (char *)ctx;
+  size_t len = strlen(s);
+  snprintf(s+len, TEST_BUF_SIZE-len, "%s#%d=%.*s*%.*s ", token->obis, token->group, token->vlen, token->value, token->ulen, token->unit);
+}
+
+
+// Runs the tokenizer on example 1, char by char and in chunks; all must give the same groups
+static bool test_tokens() {
+  static const size_t chunks[] = { 1, 7, 256 };
+  static char tokens[TEST_BUF_SIZE];
+  static const char * expected = 
+    "1-0:99.97.0#0=3* 1-0:99.97.0#1=0-0:96.7.19* 1-0:99.97.0#2=211209190618W* 1-0:99.97.0#3=0000003557*s "
+    "1-0:99.97.0#4=210416081947S* 1-0:99.97.0#5=0000004676*s 1-0:99.97.0#6=000101000011W* 1-0:99.97.0#7=2147483647*s "
+    "0-1:24.2.1#0=220605190000S* 0-1:24.2.1#1=16051.816*m3 ";
+  bool pass = true;
+  Tele_Parser * parser = tele_parser_new();
+  tele_parser_tokenize(parser, test_token, tokens);
+  for( size_t c=0; c<sizeof(chunks)/sizeof(chunks[0]); c++ ) {
+    tokens[0] = '\0';
+    const char * s = TELE_EXAMPLE_1;
+    int available = 0;
+    while( *s!='\0' ) {
+      size_t len = strnlen(s,chunks[c]);
+      if( chunks[c]==1 ) available += tele_parser_add(parser,*s)==TELE_RESULT_AVAILABLE;
+      else available += tele_parser_add_buf(parser, s, len);
+      s += len;
+    }
+    if( available!=1 || strcmp(tokens,expected)!=0 ) { pass = false; Serial.printf("test: tokens (chunk %u) '%s'\n", (unsigned)chunks[c], tokens); }
+  }
+  tele_parser_delete(parser);
+  Serial.printf("test: %-15s %s\n","tokens", pass?"pass":"FAIL");
+  return pass;
+}
+
+
+// Runs two parsers, interleaved: `a` extracts all fields, `b` only P and p.
+// Parser `b` gets a telegram without the L field, which it does not need; the default parser is not touched.
+static bool test_multi() {
+  static const Test_Case tc = { "multi", TELE_EXAMPLE_1, "1-0:1.8.1(019235.878*kWh)\r\n", "", true, 1, 0, NULL };
+  if( !test_mutate(&tc) ) { Serial.printf("test: %-15s FAIL (mutation)\n",tc.name); return false; }
+  tele_init();
+  Tele_Parser * a = tele_parser_new();
+  Tele_Parser * b = tele_parser_new(tele_fields_mask("Pp"));
+  const char * sa = TELE_EXAMPLE_2;
+  const char * sb = test_buf;
+  int available = 0;
+  int errors = 0;
+  while( *sa!='\0' || *sb!='\0' ) {
+    size_t la = strnlen(sa,7);
+    size_t lb = strnlen(sb,5);
+    available += tele_parser_add_buf(a, sa, la, &errors); sa += la;
+    available += tele_parser_add_buf(b, sb, lb, &errors); sb += lb;
+  }
+  int P=-1, L=-1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) { if( tele_field_key(i)=='P' ) P=i; if( tele_field_key(i)=='L' ) L=i; }
+  const Tele_Snapshot * snapa = tele_parser_snapshot(a);
+  const Tele_Snapshot * snapb = tele_parser_snapshot(b);
+  bool pass = available==2 && errors==0 
+           && tele_snapshot_milli(snapa,P)==590 && tele_snapshot_milli(snapb,P)==586
+           && strcmp(tele_snapshot_value(snapa,L),"019235.879")==0 && tele_snapshot_value(snapb,L)[0]=='\0'
+           && tele_snapshot_seq(tele_snapshot())==0;
+  tele_parser_delete(a);
+  tele_parser_delete(b);
+  Serial.printf("test: %-15s %s (available %d/2, errors %d/0)\n",tc.name, pass?"pass":"FAIL", available, errors);
+  return pass;
+}
+
+
+// Checks the statistics of a parser fed with noise, a good telegram, one with a CRC error and another good one
+static bool test_stats() {
+  static const Test_Case tc = { "stats", TELE_EXAMPLE_1, "(00.586*kW)", "(00.587*kW)", false, 0, 1, NULL };
+  if( !test_mutate(&tc) ) { Serial.printf("test: %-15s FAIL (mutation)\n",tc.name); return false; }
+  Tele_Parser * parser = tele_parser_new();
+  const char * parts[] = { "noise" TELE_EXAMPLE_1, test_buf, TELE_EXAMPLE_2 };
+  uint32_t bytes = 0;
+  for( size_t i=0; i<sizeof(parts)/sizeof(parts[0]); i++ ) {
+    tele_parser_add_buf(parser, parts[i], strlen(parts[i]));
+    bytes += strlen(parts[i]);
+  }
+  const Tele_Stats * st = tele_parser_stats(parser);
+  bool pass = st->bytes==bytes && st->telegrams==2 && st->crc==1 && st->missing==0 && st->syntax==0 
+           && st->noise==1 && st->discarded==5 && st->timeouts==0;
+  Serial.printf("test: %-15s %s (bytes %u, telegrams %u, crc %u, noise %u, discarded %u)\n",tc.name, pass?"pass":"FAIL", 
+    st->bytes, st->telegrams, st->crc, st->noise, st->discarded);
+  tele_parser_delete(parser);
+  return pass;
+}
+
+
+// Feeds examples 1, 2, 1 and 3 to two parsers: `a` in one add_buf() each (so unchanged lines are skipped), `b` char by char.
+// Both must give the same values and changed fields (example 2 differs from 1 in L, P, B, C and T), and `a` must skip lines.
+// Lines are skipped by comparing the bytes of their value, so a mutated line must not slip through.
+static bool test_changed() {
+  const char * examples[] = { TELE_EXAMPLE_1, TELE_EXAMPLE_2, TELE_EXAMPLE_1, TELE_EXAMPLE_3 };
+  Tele_Parser * a = tele_parser_new();
+  Tele_Parser * b = tele_parser_new();
+  bool pass = true;
+  uint32_t changed2 = 0;
+  for( size_t e=0; e<sizeof(examples)/sizeof(examples[0]); e++ ) {
+    int available = tele_parser_add_buf(a, examples[e], strlen(examples[e]));
+    for( const char * s=examples[e]; *s!='\0'; s++ ) available += tele_parser_add(b,*s)==TELE_RESULT_AVAILABLE;
+    const Tele_Snapshot * snapa = tele_parser_snapshot(a);
+    const Tele_Snapshot * snapb = tele_parser_snapshot(b);
+    if( available!=2 || tele_snapshot_changed(snapa)!=tele_snapshot_changed(snapb) ) pass = false;
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+      if( strcmp(tele_snapshot_value(snapa,i),tele_snapshot_value(snapb,i))!=0 || tele_snapshot_num(snapa,i)!=tele_snapshot_num(snapb,i) ) pass = false;
+    }
+    if( e==0 && tele_snapshot_changed(snapa)!=TELE_FIELDS_ALL ) pass = false;
+    if( e==1 ) changed2 = tele_snapshot_changed(snapa);
+  }
+  uint32_t unchanged = tele_parser_stats(a)->unchanged;
+  if( changed2!=tele_fields_mask("LPBCT") || unchanged==0 || tele_parser_stats(b)->unchanged!=0 ) pass = false;
+  // Example 3 again, with another gas time stamp: only the value counts, so every registered line is skipped by `a`.
+  // Then with the close delim of an unchanged value missing: both must reject it.
+  static const Test_Case mutations[] = {
+    { "gas time" , TELE_EXAMPLE_3, "(220605190000S)", "(220605190500S)", true, 1, 0, NULL },
+    { "no delim" , TELE_EXAMPLE_3, "(00020)"        , "(00020\r"       , true, 0, 1, NULL },
+  };
+  for( const Test_Case & tc : mutations ) {
+    int errors = 0;
+    if( !test_mutate(&tc) ) { pass = false; continue; }
+    uint32_t before = tele_parser_stats(a)->unchanged;
+    int available = tele_parser_add_buf(a, test_buf, strlen(test_buf), &errors);
+    for( const char * s=test_buf; *s!='\0'; s++ ) { Tele_Result res = tele_parser_add(b,*s); available += res==TELE_RESULT_AVAILABLE; errors += res==TELE_RESULT_ERROR; }
+    if( available!=2*tc.available || errors!=2*tc.errors ) pass = false;
+    if( tc.available==1 && (tele_snapshot_changed(tele_parser_snapshot(a))!=0 || tele_snapshot_changed(tele_parser_snapshot(b))!=0
+      || tele_parser_stats(a)->unchanged-before!=TELE_NUMFIELDS) ) pass = false;
+  }
+  tele_parser_delete(a);
+  tele_parser_delete(b);
+  Serial.printf("test: %-15s %s (changed %05x, unchanged lines %u)\n","changed", pass?"pass":"FAIL", changed2, unchanged);
+  return pass;
+}
+
+
+// Feeds example 1 with the time stamps around the DST changes of 2022 (W to S on 27 March, S to W on 30 October).
+// The decoded time is UTC, so it must advance one second over each change, also when the meter time goes back an hour.
+static bool test_time() {
+  static const struct { const char * stamp; int32_t secs; } stamps[] = {
+    { "(220327015959W)", 701657999 }, // 01:59:59 winter time is 00:59:59 UTC
+    { "(220327030000S)", 701658000 }, // 03:00:00 summer time is 01:00:00 UTC
+    { "(221030025959S)", 720406799 }, // 02:59:59 summer time is 00:59:59 UTC
+    { "(221030020000W)", 720406800 }, // 02:00:00 winter time is 01:00:00 UTC
+  };
+  int T = -1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_key(i)=='T' ) T=i;
+  Tele_Parser * parser = tele_parser_new();
+  bool pass = true;
+  int32_t prev = 0;
+  for( size_t i=0; i<sizeof(stamps)/sizeof(stamps[0]); i++ ) {
+    Test_Case tc = { "time", TELE_EXAMPLE_1, "(220605191342S)", stamps[i].stamp, true, 1, 0, NULL };
+    if( !test_mutate(&tc) ) { pass = false; continue; }
+    int available = tele_parser_add_buf(parser, test_buf, strlen(test_buf));
+    int32_t secs = tele_snapshot_num(tele_parser_snapshot(parser),T);
+    if( available!=1 || secs!=stamps[i].secs ) { pass = false; Serial.printf("test: time %s is %d, not %d\n", stamps[i].stamp, secs, stamps[i].secs); }
+    if( i%2==1 && secs-prev!=1 ) pass = false;
+    prev = secs;
+  }
+  tele_parser_delete(parser);
+  Serial.printf("test: %-15s %s (W to S and S to W)\n","time", pass?"pass":"FAIL");
+  return pass;
+}
+
+
+// === GENERATED =======================================================================================
+// Besides the recorded telegrams, the parser is tested (and benchmarked) with generated ones (see telegen.h),
+// for several meter shapes, with every fourth telegram corrupted (bit flip, truncation, noise in turn).
+
+
+#define GEN_TELEGRAMS 100 // number of telegrams generated per shape
+#define GEN_CHUNK      64 // generated telegrams are fed in chunks of this size (like a UART buffer)
+
+
+struct Gen_Shape {
+  const char * name;
+  int          flags;
+};
+
+
+static const Gen_Shape gen_shapes[] = {
+  { "dsmr42 3ph gas" , TELEGEN_3PHASE | TELEGEN_GAS },
+  { "dsmr50 1ph"     , TELEGEN_DSMR50 },
+  { "dsmr50 3ph gas" , TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS },
+  { "dsmr50 msg+log" , TELEGEN_DSMR50 | TELEGEN_3PHASE | TELEGEN_GAS | TELEGEN_MESSAGE | TELEGEN_FAILLOG },
+};
+#define GEN_NUMSHAPES ( sizeof(gen_shapes)/sizeof(gen_shapes[0]) )
+
+
+// Returns the fields a meter of shape `flags` has (single phase meters lack L2 and L3, not all have gas)
+static uint32_t gen_fields(int flags) {
+  uint32_t fields = TELE_FIELDS_ALL;
+  if( !(flags & TELEGEN_3PHASE) ) fields &= ~tele_fields_mask("BbCc");
+  if( !(flags & TELEGEN_GAS) ) fields &= ~tele_fields_mask("G");
+  return fields;
+}
+
+
+// Returns the corruption for telegram `i`
+static Telegen_Corruption gen_corruption(int i) {
+  static const Telegen_Corruption corruptions[] = { TELEGEN_BITFLIP, TELEGEN_TRUNCATE, TELEGEN_NOISE };
+  return i%4==2 ? corruptions[(i/4)%3] : TELEGEN_NONE;
+}
+
+
+// Feeds `len` bytes of `buf` to `parser` in chunks, returns the number of available telegrams
+static int gen_feed(Tele_Parser * parser, const char * buf, int len, int * errors) {
+  int available = 0;
+  for( int pos=0; pos<len; pos+=GEN_CHUNK ) available += tele_parser_add_buf(parser, buf+pos, len-pos<GEN_CHUNK ? len-pos : GEN_CHUNK, errors);
+  return available;
+}
+
+
+// Runs generated telegrams of `shape` through a parser. Passes iff no corrupted telegram is accepted, every accepted 
+// one has the generated power, and at most one valid telegram is lost per corrupted one (the parser must resync).
+static bool test_gen(const Gen_Shape * shape) {
+  Telegen gen;
+  telegen_init(&gen, shape->flags, 2022);
+  Tele_Parser * parser = tele_parser_new(gen_fields(shape->flags));
+  int P = -1;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_field_key(i)=='P' ) P=i;
+  int available = 0;
+  int errors = 0;
+  int corrupted = 0;
+  int wrong = 0;
+  for( int i=0; i<GEN_TELEGRAMS; i++ ) {
+    int len = telegen_next(&gen, test_buf, TEST_BUF_SIZE);
+    Telegen_Corruption corruption = gen_corruption(i);
+    len = telegen_corrupt(&gen, test_buf, len, TEST_BUF_SIZE, corruption);
+    int n = gen_feed(parser, test_buf, len, &errors);
+    if( corruption!=TELEGEN_NONE ) { corrupted++; wrong += n; }
+    else if( n>0 && tele_snapshot_milli(tele_parser_snapshot(parser),P)!=telegen_power(&gen,false) ) wrong++;
+    available += n;
+  }
+  tele_parser_delete(parser);
+  bool pass = wrong==0 && available+corrupted>=GEN_TELEGRAMS-corrupted && errors>=corrupted;
+  Serial.printf("test: %-15s %s (generated, available %d/%d, errors %d, wrong %d)\n",shape->name, pass?"pass":"FAIL", available, GEN_TELEGRAMS-corrupted, errors, wrong);
+  return pass;
+}
+
+
+// Benchmarks the parser on generated telegrams of `shape`: char by char with add(), in chunks with add_buf(), and the error path
+static void bench_gen(const Gen_Shape * shape) {
+  Telegen gen;
+  Tele_Parser * parser = tele_parser_new(gen_fields(shape->flags));
+  uint32_t us[3] = { 0, 0, 0 };
+  uint32_t bytes[3] = { 0, 0, 0 };
+  int errors = 0;
+  for( int mode=0; mode<3; mode++ ) {
+    telegen_init(&gen, shape->flags, 2022);
+    for( int i=0; i<GEN_TELEGRAMS; i++ ) {
+      int len = telegen_next(&gen, test_buf, TEST_BUF_SIZE);
+      if( mode==2 ) len = telegen_corrupt(&gen, test_buf, len, TEST_BUF_SIZE, gen_corruption(2+4*i));
+      uint32_t start = micros();
+      if( mode==0 ) for( int j=0; j<len; j++ ) tele_parser_add(parser, (uint8_t)test_buf[j]);
+      else gen_feed(parser, test_buf, len, &errors);
+      us[mode] += micros() - start;
+      bytes[mode] += len;
+      yield(); // keep the watchdog happy
+    }
+  }
+  tele_parser_delete(parser);
+  static const char * const modes[] = { "add", "add_buf", "errors" };
+  for( int mode=0; mode<3; mode++ ) {
+    if( us[mode]==0 ) us[mode] = 1;
+    Serial.printf("bench: %-15s %-7s %4u bytes/telegram %6u us/telegram %7u telegrams/s %5u ns/byte\n", shape->name, modes[mode], 
+      bytes[mode]/GEN_TELEGRAMS, us[mode]/GEN_TELEGRAMS, (uint32_t)(GEN_TELEGRAMS*1000000ULL/us[mode]), (uint32_t)(us[mode]*1000ULL/bytes[mode]) );
+  }
+}
+
+
+// Runs all test cases, char by char and in chunks, prints a summary and returns the number of failed runs
+static int test_all() {
+  static const size_t chunks[] = { 1, 7, 256 };
+  int fails = 0;
+  int runs = 0;
+  for( size_t c=0; c<sizeof(chunks)/sizeof(chunks[0]); c++ ) {
+    for( size_t i=0; i<TEST_NUMCASES; i++ ) {
+      if( !test_run(&test_cases[i],chunks[c]) ) fails++;
+      runs++;
+      yield(); // keep the watchdog happy
+    }
+  }
+  if( !test_multi() ) fails++;
+  runs++;
+  if( !test_tokens() ) fails++;
+  runs++;
+  if( !test_stats() ) fails++;
+  runs++;
+  if( !test_changed() ) fails++;
+  runs++;
+  if( !test_time() ) fails++;
+  runs++;
+  for( size_t i=0; i<GEN_NUMSHAPES; i++ ) {
+    if( !test_gen(&gen_shapes[i]) ) fails++;
+    runs++;
+  }
+  Serial.printf("test: %d runs, %d failed\n\n", runs, fails);
+  return fails;
+}
+
+
+// Benchmarks the parser on all generated shapes
+static void bench_all() {
+  Serial.printf("bench: %d telegrams per shape\n", GEN_TELEGRAMS);
+  for( size_t i=0; i<GEN_NUMSHAPES; i++ ) bench_gen(&gen_shapes[i]);
+  Serial.printf("\n");
+}
+
+
 // === APP ============================================================================================
 
 
 // use real serial port or spoof prerecorded data
-#if 0
+#if 1
   #define SERIAL_READ() Serial.read()
 #else 
   // An @ in the string causes a wait of 1000ms
@@ -52,12 +498,17 @@ void uart_init() {
 
 
 int app_fail;
+int test_fails; // failed test runs (the host build, see ../host, exits with this)
 
 void setup() {
   Serial.begin(115200, SERIAL_8N1, SERIAL_FULL);
   do delay(250); while( !Serial );
   Serial.printf("\n\n\nWelcome to p1read\n");
 
+  // Regression test first (this does not need a smart meter)
+  test_fails = test_all();
+  bench_all();
+
   uart_init();
   tele_init();
 
@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include "tele.h"
+#include "crc16.h"
 
 
 // === FIELD ====================================================================================
@@ -10,122 +11,280 @@
 
 
 // Once a field in the telegram is parsed and passes all checks, 
-// its value is made available through Tele_Field.value[].
+// its value is made available through a snapshot (see Tele_Snapshot).
 // That is a string with storage size TELE_VALUE_SIZE.
+// Numeric fields are also decoded (while the value is copied), see Tele_Type.
 #define TELE_VALUE_SIZE   16
 
 
 // The following class represents one field, we make one instance per obis object that we are interested in.
-// All field properties are compile time constants, except `value`,
-// which becomes available after parsing a telegram successfully.
+// All field properties are compile time constants (so that the compiler can build the obis index, see below);
+// the value is stored separately in a Tele_Snapshot.
 //  key         ultra short name (1 character) used in printf-like format strings
 //  name        is the name (5-15 chars)
 //  description is description from standard, see https://www.netbeheernederland.nl/_upload/Files/Slimme_meter_15_a727fce1f1.pdf
 //  obis        is obis code, like "1-0:1.8.1", from the standard
 //  open_delim  is the character just in front of the value (right most)
 //  close_delim is the character just after the value (right most)
-//  value       is filled with the actual parsed value (once parsing is successful) 
+//  type        how the value is decoded
 class Tele_Field {
   public:
-    Tele_Field(char key, const char * name, const char *description, const char *obis, char open_delim, char close_delim): 
-      key(key), name(name), description(description), obis(obis), open_delim(open_delim), close_delim(close_delim) {};
+    constexpr Tele_Field(char key, const char * name, const char *description, const char *obis, char open_delim, char close_delim, Tele_Type type): 
+      key(key), name(name), description(description), obis(obis), open_delim(open_delim), close_delim(close_delim), type(type) {};
     const char         key;
     const char * const name;
     const char * const description;
     const char * const obis;
     const char         open_delim;
     const char         close_delim;
-          char         value[TELE_VALUE_SIZE];
+    const Tele_Type    type;
 };
 
 
 // These are the fields that I'm interested in, feel free to modify
-static Tele_Field tele_fields[TELE_NUMFIELDS] = {
-  Tele_Field( 'L', "Cons-Day-kWh"   , "Meter Reading electricity delivered to client (Tariff 1)", "1-0:1.8.1"  , '(', '*' ),
-  Tele_Field( 'H', "Cons-Night-kWh" , "Meter Reading electricity delivered to client (Tariff 2)", "1-0:1.8.2"  , '(', '*' ),
+static constexpr Tele_Field tele_fields[TELE_NUMFIELDS] = {
+  /* post1 */ Tele_Field( 'L', "Cons-Night1-kWh", "Meter Reading electricity delivered to client (Tariff 1)", "1-0:1.8.1"  , '(', '*', TELE_TYPE_MILLI ),
+  /* post2 */ Tele_Field( 'H', "Cons-Day2-kWh"  , "Meter Reading electricity delivered to client (Tariff 2)", "1-0:1.8.2"  , '(', '*', TELE_TYPE_MILLI ),
                      
-  Tele_Field( 'l', "Prod-Day-kWh"   , "Meter Reading electricity delivered by client (Tariff 1)", "1-0:2.8.1"  , '(', '*' ),
-  Tele_Field( 'h', "Prod-Night-kWh" , "Meter Reading electricity delivered by client (Tariff 2)", "1-0:2.8.2"  , '(', '*' ),
+  /* post3 */ Tele_Field( 'l', "Prod-Night1-kWh", "Meter Reading electricity delivered by client (Tariff 1)", "1-0:2.8.1"  , '(', '*', TELE_TYPE_MILLI ),
+  /* post4 */ Tele_Field( 'h', "Prod-Day2-kWh"  , "Meter Reading electricity delivered by client (Tariff 2)", "1-0:2.8.2"  , '(', '*', TELE_TYPE_MILLI ),
                      
-  Tele_Field( 'I', "Night1-Day2"    , "Tariff indicator electricity"                            , "0-0:96.14.0", '(', ')' ),
+              Tele_Field( 'I', "Night1-Day2"    , "Tariff indicator electricity"                            , "0-0:96.14.0", '(', ')', TELE_TYPE_INT   ),
                      
-  Tele_Field( 'P', "Cons-kW"        , "Actual electricity power delivered (+P)"                 , "1-0:1.7.0"  , '(', '*' ),
-  Tele_Field( 'P', "Prod-kW"        , "Actual electricity power received (-P)"                  , "1-0:2.7.0"  , '(', '*' ),
+  /* post5 */ Tele_Field( 'P', "Cons-kW"        , "Actual electricity power delivered (+P)"                 , "1-0:1.7.0"  , '(', '*', TELE_TYPE_MILLI ),
+  /* post6 */ Tele_Field( 'p', "Prod-kW"        , "Actual electricity power received (-P)"                  , "1-0:2.7.0"  , '(', '*', TELE_TYPE_MILLI ),
                      
-  Tele_Field( 'F', "Fails-short-#"  , "Number of power failures in any phase"                   , "0-0:96.7.21", '(', ')' ),
-  Tele_Field( 'f', "Fails-long-#"   , "Number of long power failures in any phase"              , "0-0:96.7.9" , '(', ')' ),
+  /* post7 */ Tele_Field( 'F', "Fails-short-#"  , "Number of power failures in any phase"                   , "0-0:96.7.21", '(', ')', TELE_TYPE_INT   ),
+              Tele_Field( 'f', "Fails-long-#"   , "Number of long power failures in any phase"              , "0-0:96.7.9" , '(', ')', TELE_TYPE_INT   ),
                      
-  Tele_Field( 'A', "Cons-L1-kW"     , "Instantaneous power L1 (+P)"                             , "1-0:21.7.0" , '(', '*' ),
-  Tele_Field( 'a', "Prod-L1-kW"     , "Instantaneous power L1 (-P)"                             , "1-0:22.7.0" , '(', '*' ),
-  Tele_Field( 'B', "Cons-L2-kW"     , "Instantaneous power L2 (+P)"                             , "1-0:41.7.0" , '(', '*' ),
-  Tele_Field( 'b', "Prod-L2-kW"     , "Instantaneous power L2 (-P)"                             , "1-0:42.7.0" , '(', '*' ),
-  Tele_Field( 'C', "Cons-L3-kW"     , "Instantaneous power L3 (+P)"                             , "1-0:61.7.0" , '(', '*' ),
-  Tele_Field( 'c', "Prod-L3-kW"     , "Instantaneous power L3 (-P)"                             , "1-0:62.7.0" , '(', '*' ),
+              Tele_Field( 'A', "Cons-L1-kW"     , "Instantaneous power L1 (+P)"                             , "1-0:21.7.0" , '(', '*', TELE_TYPE_MILLI ),
+              Tele_Field( 'a', "Prod-L1-kW"     , "Instantaneous power L1 (-P)"                             , "1-0:22.7.0" , '(', '*', TELE_TYPE_MILLI ),
+              Tele_Field( 'B', "Cons-L2-kW"     , "Instantaneous power L2 (+P)"                             , "1-0:41.7.0" , '(', '*', TELE_TYPE_MILLI ),
+              Tele_Field( 'b', "Prod-L2-kW"     , "Instantaneous power L2 (-P)"                             , "1-0:42.7.0" , '(', '*', TELE_TYPE_MILLI ),
+              Tele_Field( 'C', "Cons-L3-kW"     , "Instantaneous power L3 (+P)"                             , "1-0:61.7.0" , '(', '*', TELE_TYPE_MILLI ),
+              Tele_Field( 'c', "Prod-L3-kW"     , "Instantaneous power L3 (-P)"                             , "1-0:62.7.0" , '(', '*', TELE_TYPE_MILLI ),
                      
-  Tele_Field( 'G', "Cons-Gas-m3"    , "Last 5-minute value gas delivered to client"             , "0-1:24.2.1" , '(', '*' ),
+  /* post8 */ Tele_Field( 'G', "Cons-Gas-m3"    , "Last 5-minute value gas delivered to client"             , "0-1:24.2.1" , '(', '*', TELE_TYPE_MILLI ),
+
+              Tele_Field( 'T', "Time"           , "Date-time stamp of the P1 message"                       , "0-0:1.0.0"  , '(', ')', TELE_TYPE_TIME  ),
 };
 // could not convert '<brace-enclosed initializer list>()' from '<brace-enclosed initializer list>' to 'Tele_Field'
 // means you must decrease TELE_NUMFIELDS (or add field definitions)
 
 
+// === SNAPSHOT ====================================================================================================
+// A snapshot holds the values of the selected fields in tele_fields[] of one telegram.
+// Storage is only allocated for the fields a parser selected (see Tele_Parser::begin()), `slot` maps field to value.
+// The parser has two: it fills the back one, and only when the telegram is complete and its CRC matches,
+// it swaps them, publishing the back one as front (the one returned by tele_snapshot()).
+// So readers never see a partially updated or failed telegram, and they do not need to copy it.
+// The back one is cleared (seq set to 0) when the parser starts on the next-but-one telegram;
+// a reader that holds a snapshot that long can check that its seq did not change.
+
+
+// The value of one field
+struct Tele_Value {
+  char     str[TELE_VALUE_SIZE];  // the value as in the telegram
+  int32_t  num;                   // the decoded value (see Tele_Type): milli units for TELE_TYPE_MILLI, plain integer for TELE_TYPE_INT, seconds for TELE_TYPE_TIME
+};
+
+
+struct Tele_Snapshot {
+  uint32_t       seq;    // sequence number of the telegram (1, 2, ...), 0 if none or being filled
+  uint32_t       time;   // millis() when the snapshot was published
+  uint32_t       changed;// mask of the fields whose value differs from the previous telegram (all for the first)
+  const int8_t * slot;   // for each field in tele_fields[] the index in `values`, or -1 if the field is not selected
+  Tele_Value *   values; // the value of each selected field
+};
+
+
+// === INDEX ====================================================================================================
+// The parser needs to map the obis code of each body line to a field in tele_fields[] (if registered).
+// To prevent a string compare with every field, the compiler builds a perfect hash table of all obis codes.
+// The parser computes the hash while the code streams in, and one strcmp() confirms the (only) candidate.
+
+
+#define TELE_INDEX_SIZE    64  // must be a power of 2, and larger than TELE_NUMFIELDS
+
+
+// Returns `hash` updated with `ch` (an FNV-1a step)
+static constexpr uint32_t tele_hash_add(uint32_t hash, char ch) {
+  return (hash ^ (uint8_t)ch) * 16777619UL;
+}
+
+
+// Returns the hash of string `s`, starting with `seed`
+static constexpr uint32_t tele_hash(uint32_t seed, const char * s) {
+  while( *s ) seed= tele_hash_add(seed,*s++);
+  return seed;
+}
+
+
+// Returns true iff the obis codes of all fields map to a different slot using `seed`
+static constexpr bool tele_index_perfect(uint32_t seed) {
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    for( int j=i+1; j<TELE_NUMFIELDS; j++ ) {
+      if( (tele_hash(seed,tele_fields[i].obis) & (TELE_INDEX_SIZE-1)) == (tele_hash(seed,tele_fields[j].obis) & (TELE_INDEX_SIZE-1)) ) return false;
+    }
+  }
+  return true;
+}
+
+
+// Returns the first seed that gives a perfect hash (starting at the FNV offset basis)
+static constexpr uint32_t tele_index_seed() {
+  uint32_t seed = 2166136261UL;
+  for( int tries=0; tries<1000 && !tele_index_perfect(seed); tries++ ) seed++;
+  return seed;
+}
+
+
+static constexpr uint32_t TELE_INDEX_SEED = tele_index_seed();
+static_assert( tele_index_perfect(TELE_INDEX_SEED), "No perfect hash for the obis codes in tele_fields[], increase TELE_INDEX_SIZE" );
+
+
+// The hash table: each slot has the index of the field in tele_fields[] or -1 if none.
+struct Tele_Index {
+  int8_t slot[TELE_INDEX_SIZE];
+  constexpr Tele_Index() : slot() {
+    for( int s=0; s<TELE_INDEX_SIZE; s++ ) slot[s]= -1;
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) slot[ tele_hash(TELE_INDEX_SEED,tele_fields[i].obis) & (TELE_INDEX_SIZE-1) ]= i;
+  }
+};
+
+
+static constexpr Tele_Index tele_index;
+
+
+// Returns the index in tele_fields[] of the field with obis code `code`, or -1 if there is none (in the mask `fields`).
+// The `hash` must be tele_hash(TELE_INDEX_SEED,code), typically computed incrementally with tele_hash_add().
+static int tele_index_find(uint32_t hash, const char * code, uint32_t fields) {
+  int ix = tele_index.slot[ hash & (TELE_INDEX_SIZE-1) ];
+  if( ix>=0 && (fields & (1UL<<ix)) && strcmp(code,tele_fields[ix].obis)==0 ) return ix;
+  return -1;
+}
+
+
 // === PARSER ====================================================================================================
 // The parse is fed one character at a time (or -1 if there is no new character - this is needed to manage time-outs)
-// Once a complete telegram is received and approved (eg CRC), the results are published via tele_fields[].
+// Once a complete telegram is received and approved (eg CRC), the results are published via a snapshot.
+// The parser is streaming: body lines are not buffered, they are tokenized as the characters arrive.
+// Only the obis code (up to the first '(') is kept in the line buffer; it is looked up in the obis index.
+// If the obis object is registered, the value characters are copied directly into the field's value.
+// Other obis objects (like the 1024 char message of 0-0:96.13.0) are only checksummed and skipped.
+// So the line buffer only needs to hold the header, an obis code or the crc line.
 
 
 #define TELE_MAXWAIT_MS 10000  // telegram is repeated this many ms
-#define TELE_LINE_SIZE   2100  // telegram can have 1024 char message, each char encoded as HexHex
+#define TELE_LINE_SIZE    128  // header "/XXX5" has at most 96 char identification (body lines are not buffered)
+#define TELE_GROUP_SIZE    64  // tokenizer: groups that are not in the caller's buffer are truncated to this size
+
+
+// Special values for Tele_Parser._field
+#define TELE_FIELD_CODE    -1  // still collecting the obis code of the body line
+#define TELE_FIELD_NONE    -2  // obis code of the body line is not registered in tele_fields[]
+#define TELE_FIELD_SAME    -3  // body line is registered, but equal to the previous telegram's (value copied, see add_buf())
 
 
 // The internal states of the parser
 enum Tele_State {
   TELE_STATE_IDLE, // waiting for the first character (of the header)
   TELE_STATE_HEAD, // collecting header characters (until the whiteline)
-  TELE_STATE_BODY, // collecting all obis objects, if the match a field definition the value is copied there
+  TELE_STATE_BODY, // tokenizing all obis objects, if they match a field definition the value is copied there
   TELE_STATE_CSUM  // collecting the CRC
 };
 
 
-// The parser
+// The parser. All its state is in the instance (the field table and obis index are constant),
+// so any number of parsers can run independently, e.g. one per meter (see tele_parser_new()).
+// A parser only extracts (and requires) the fields in its field mask, and only has storage for those.
 class Tele_Parser {
   public :
-    void          begin();
+                  Tele_Parser() : _tfn(NULL), _cur(NULL), _values(NULL), _numvalues(-1) {}
+                  ~Tele_Parser() { delete[] _values; }
+    void          begin(uint32_t fields);
+    void          tokenize(Tele_Token_Fn fn, void * ctx) { _tfn= fn; _tctx= ctx; }
+    const Tele_Stats * stats() const { return &_stats; }
+    void          count(size_t bytes) { _stats.bytes+= bytes; }
+    uint32_t      fields() const { return _fields; }
     Tele_Result   add(int ch);
+    int           add_buf(const char * buf, size_t len, int * errors);
+    const Tele_Snapshot * snapshot() const { return _front; }
   private:
     void          set_state_idle();
     void          set_state_head();
     void          set_state_body();
     void          set_state_csum();
   private:
-    void          update_crc(int len);
+    bool          append(int ch);
     bool          header_ok();
+    void          bodyln_add(int ch);
     bool          bodyln_ok();
     bool          csumln_ok();
+    void          token_add(int ch);
+    void          token_keep();
   private:
+    uint32_t      _fields; // mask of the fields in tele_fields[] this parser extracts
+    int8_t        _slot[TELE_NUMFIELDS]; // index in the snapshot values of each field, -1 if not in _fields
     Tele_State    _state;
     uint32_t      _time;
-    char          _data[TELE_LINE_SIZE];
-    int           _len;
-    unsigned int  _crc;
+    char          _data[TELE_LINE_SIZE]; // header, obis code of body line, or csum line
+    int           _len;   // number of chars in _data
+    uint16_t      _crc;
+    int           _pos;   // body: number of chars in current line
+    int           _prev;  // body: previous char in current line
+    uint32_t      _hash;  // body: hash of the obis code (so far)
+    int           _field; // body: index in tele_fields[] of the current line, or TELE_FIELD_CODE or TELE_FIELD_NONE
+    Tele_Value *  _value; // body: value (in the back snapshot) of _field
+    int           _vlen;  // body: number of value chars after the (last) open delim, -1 if no open delim found yet
+    bool          _vend;  // body: close delim found after the (last) open delim
+    int32_t       _vnum;  // body: value decoded so far (digits only)
+    int           _vdec;  // body: number of digits after the decimal point, -1 if no point found yet
+    bool          _vbad;  // body: value has chars that do not fit its Tele_Type
+  private:
+    Tele_Token_Fn _tfn;   // tokenizer: callback (NULL if tokenizer is off)
+    void *        _tctx;  // tokenizer: context for the callback
+    const char *  _cur;   // tokenizer: position of the current char in the add_buf() buffer (NULL in add())
+    int           _gidx;  // tokenizer: index of the current group in the body line
+    int           _glen;  // tokenizer: number of chars in the current group, -1 if no group open
+    int           _gunit; // tokenizer: position of the '*' in the current group, -1 if none
+    const char *  _gptr;  // tokenizer: start of the current group in the add_buf() buffer, NULL if it is in _gbuf
+    char          _gbuf[TELE_GROUP_SIZE]; // tokenizer: current group, when not (completely) in the add_buf() buffer
+  private:
+    Tele_Value *  _values;    // storage for both snapshots
+    int           _numvalues; // number of values per snapshot
+    Tele_Snapshot _snaps[2];
+    Tele_Snapshot * _front; // last published telegram
+    Tele_Snapshot * _back;  // telegram being parsed
+    uint32_t      _seq;     // number of published telegrams
+    Tele_Stats    _stats;
 };
 
 
-// Sets the parse to an initial state
-void Tele_Parser::begin() {
-  set_state_idle();
-}
-
-
-// Updates the `_crc` with the bytes in `_data`, op to `len`.
-void Tele_Parser::update_crc(int len) {
-  for( int pos=0; pos<len; pos++ ) {
-    _crc ^= _data[pos];
-    for(int i=8; i!=0; i--) {
-      int bit = _crc & 0x0001;
-      _crc >>= 1;
-      if( bit ) _crc ^= 0xA001; // If the LSB is set xor with polynome x16+x15+x2+1
-    }
+// Sets the parse to an initial state, extracting the fields in mask `fields`
+void Tele_Parser::begin(uint32_t fields) {
+  _fields= fields & TELE_FIELDS_ALL;
+  // Assign a slot to each selected field, and allocate the values for both snapshots
+  int num= 0;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) _slot[i]= _fields & (1UL<<i) ? num++ : -1;
+  if( num!=_numvalues ) {
+    delete[] _values;
+    _values= new Tele_Value[2*num];
+    _numvalues= num;
+  }
+  memset(_values, 0, 2*num*sizeof(Tele_Value)); // empty values: nothing published yet
+  for( int s=0; s<2; s++ ) {
+    _snaps[s].seq= 0;
+    _snaps[s].time= 0;
+    _snaps[s].changed= 0;
+    _snaps[s].slot= _slot;
+    _snaps[s].values= _values + s*num;
   }
+  _front= &_snaps[0];
+  _back= &_snaps[1];
+  _seq= 0;
+  memset(&_stats, 0, sizeof _stats);
+  set_state_idle();
 }
 
 
@@ -142,15 +301,48 @@ void Tele_Parser::set_state_head() {
   _state= TELE_STATE_HEAD;
   _time= millis(); // time of first char in telegram
   _len= 0; // num of chars in current line
-  _crc= 0x0000; // initial value for checksum
+  _crc= CRC16_INIT; // initial value for checksum
 }
 
 
-// Forces telegram parse to the body state
+// Forces telegram parse to the body state (also used to start the next body line)
 void Tele_Parser::set_state_body() {
   _state = TELE_STATE_BODY;
   // _time= millis(); // do not reset time of first char in telegram
-  _len= 0; // num of chars in current line
+  _len= 0; // num of chars of the obis code
+  _pos= 0; // num of chars in current line
+  _prev= -1;
+  _hash= TELE_INDEX_SEED;
+  _field= TELE_FIELD_CODE;
+  _vlen= -1;
+  _vend= false;
+  _gidx= 0;
+  _glen= -1;
+}
+
+
+// Number of decimals of a TELE_TYPE_MILLI value
+#define TELE_MILLI_DECIMALS 3
+
+
+// Decodes time stamp `s` ("YYMMDDhhmmssX", X is S for summer or W for winter time) into `secs` since 2000-01-01 00:00:00 UTC.
+// The meter runs on Dutch time, so W is UTC+1 and S is UTC+2 (without X winter time is assumed). Converting to UTC
+// keeps the time monotonic: at the autumn change the meter time goes back an hour, but the UTC time does not.
+// Returns false if `s` is not a time stamp.
+static bool tele_time_decode(const char * s, int32_t * secs) {
+  int n[6];
+  for( int i=0; i<6; i++ ) {
+    if( !isdigit(s[2*i]) || !isdigit(s[2*i+1]) ) return false;
+    n[i] = (s[2*i]-'0')*10 + (s[2*i+1]-'0');
+  }
+  if( s[12]!='\0' && s[12]!='S' && s[12]!='W' ) return false;
+  int y=2000+n[0], m=n[1], d=n[2];
+  if( m<1 || m>12 || d<1 || d>31 || n[3]>23 || n[4]>59 || n[5]>59 ) return false;
+  // Days since 2000-01-01 (civil calendar, with years starting in March so that the leap day is the last day of a year)
+  if( m<=2 ) { y--; m+=12; }
+  int32_t days = 365L*y + y/4 - y/100 + y/400 + (153*(m-3)+2)/5 + d-1 - 730425L; // 730425 is that formula for 2000-01-01
+  *secs = ((days*24 + n[3])*60 + n[4])*60 + n[5] - (s[12]=='S' ? 7200 : 3600);
+  return true;
 }
 
 
@@ -158,13 +350,25 @@ void Tele_Parser::set_state_body() {
 void Tele_Parser::set_state_csum() {
   _state = TELE_STATE_CSUM;
   // _time= millis(); // do not reset time of first char in telegram
-  // _len = 0; // do not reset, was already collecting as body line
+  _len = 0; // num of chars in csum line
+}
+
+
+// Appends `ch` to `_data`. Returns false (and prints an error) if it does not fit.
+bool Tele_Parser::append(int ch) {
+  if( _len==TELE_LINE_SIZE-1 ) { // keep room for a terminating zero
+    _data[_len] = '\0';
+    Serial.printf("tele: ERROR line too long '%s'\n",_data);
+    return false;
+  }
+  _data[_len++]= ch;
+  return true;
 }
 
 
 // Returns true iff the `_data[0.._len)` is a valid header.
 // Prints and error if not.
-// Updates CRC with header bytes, clears field values
+// Clears field values in the back snapshot (the CRC is already updated by add())
 bool Tele_Parser::header_ok() {
   // "/KFM5KAIFA-METER<CR><LF><CR><LF>"
   bool ok = _len>8 && _data[0]=='/' && _data[4]=='5' && _data[_len-4]=='\r' && _data[_len-3]=='\n' && _data[_len-2]=='\r' && _data[_len-1]=='\n';
@@ -174,78 +378,198 @@ bool Tele_Parser::header_ok() {
     return false;
   }
 
-  update_crc(_len);
   //_data[_len-4]='\0';
   //Serial.printf("tele: header received '%s'\n",_data);
 
-  // Flag all fields as not found
-  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
-    tele_fields[i].value[0] = '\0'; 
+  // Flag all fields as not found (and unchanged)
+  _back->seq = 0;
+  _back->changed = 0;
+  for( int i=0; i<_numvalues; i++ ) {
+    _back->values[i].str[0] = '\0'; 
   }
   
   return true;
 }
 
 
-// Returns true iff the `_data[0.._len)` is a body line (obis object).
+// Tokenizes one char (not the terminating LF) of a body line.
+// The obis code is collected (and hashed) in `_data`, up to the first '('. Then it is looked up in the obis index.
+// For a registered field, the chars after its (last) open delim up to the next close delim are copied to its value.
+// While copying, numeric values are decoded (as integer, with the position of the decimal point).
+// "1-0:1.8.1(012345.678*kWh)<CR>"
+void Tele_Parser::bodyln_add(int ch) {
+  _pos++;
+  _prev= ch;
+
+  if( _field==TELE_FIELD_CODE ) {
+    if( ch!='(' ) {
+      // Still in the obis code; silently truncate when too long, it will not match anyway
+      if( _len<TELE_LINE_SIZE-1 ) _data[_len++]= ch;
+      _hash= tele_hash_add(_hash,ch);
+      return;
+    }
+    // Obis code complete, find field
+    _data[_len]= '\0';
+    _field= tele_index_find(_hash,_data,_fields);
+    if( _field<0 ) _field= TELE_FIELD_NONE; else _value= &_back->values[_slot[_field]];
+    // The '(' might be the open delim of the field, so continue
+  }
+
+  // Tokenizer gets all chars from the first '('
+  if( _tfn!=NULL ) token_add(ch);
+
+  // Not registered: skip (it is checksummed by add())
+  if( _field==TELE_FIELD_NONE ) return;
+
+  // Registered: track delimiters and copy value
+  const Tele_Field * field = &tele_fields[_field];
+  if( ch==field->open_delim ) {
+    _vlen= 0; // the last open delim counts, so restart the value
+    _vend= false;
+    _vnum= 0;
+    _vdec= -1;
+    _vbad= false;
+  } else if( ch==field->close_delim ) {
+    if( _vlen>=0 ) _vend= true;
+  } else if( _vlen>=0 && !_vend ) {
+    if( _vlen<TELE_VALUE_SIZE-1 ) _value->str[_vlen]= ch; // length is checked in bodyln_ok()
+    _vlen++;
+    if( field->type==TELE_TYPE_STRING || field->type==TELE_TYPE_TIME ) return; // time is decoded in bodyln_ok()
+    if( ch>='0' && ch<='9' ) {
+      if( _vnum>(INT32_MAX-9)/10 ) _vbad= true; else _vnum= _vnum*10 + (ch-'0');
+      if( _vdec>=0 ) _vdec++;
+    } else if( ch=='.' && _vdec<0 && field->type==TELE_TYPE_MILLI ) {
+      _vdec= 0;
+    } else {
+      _vbad= true;
+    }
+  }
+}
+
+
+// Tokenizer: splits the body line (after the obis code) into groups "(value*unit)", and passes each to the callback.
+// When the group is completely in the add_buf() buffer, the spans point into that buffer (no copy).
+// Otherwise (add() or a group spanning two add_buf() calls) the group is collected in `_gbuf`.
+void Tele_Parser::token_add(int ch) {
+  if( ch=='(' && _glen<0 ) {
+    // Open a group
+    _glen= 0;
+    _gunit= -1;
+    _gptr= _cur!=NULL ? _cur+1 : NULL;
+  } else if( ch==')' && _glen>=0 ) {
+    // Close the group, and pass it
+    const char * base= _gptr!=NULL ? _gptr : _gbuf;
+    int len= _gptr!=NULL || _glen<TELE_GROUP_SIZE ? _glen : TELE_GROUP_SIZE;
+    int vlen= _gunit>=0 && _gunit<len ? _gunit : len;
+    Tele_Token token;
+    token.obis= _data;
+    token.group= _gidx++;
+    token.value= base;
+    token.vlen= vlen;
+    token.unit= vlen<len ? base+vlen+1 : base+len;
+    token.ulen= vlen<len ? len-vlen-1 : 0;
+    token.truncated= len<_glen;
+    _tfn(&token,_tctx);
+    _glen= -1;
+  } else if( _glen>=0 ) {
+    // Char in a group
+    if( ch=='*' && _gunit<0 ) _gunit= _glen;
+    if( _gptr==NULL && _glen<TELE_GROUP_SIZE ) _gbuf[_glen]= ch;
+    _glen++;
+  }
+}
+
+
+// Tokenizer: the add_buf() buffer is about to go; if the open group is in there, copy it to `_gbuf`
+void Tele_Parser::token_keep() {
+  if( _glen<0 || _gptr==NULL ) return;
+  memcpy(_gbuf, _gptr, _glen<TELE_GROUP_SIZE ? _glen : TELE_GROUP_SIZE);
+  _gptr= NULL;
+}
+
+
+// Returns true iff the body line tokenized by bodyln_add() is a valid obis object.
 // Prints and error if not.
-// Updates CRC with received bytes, sets field value if it matches one of the fields
+// Terminates the field value if it matches one of the fields (the CRC is already updated by add())
 bool Tele_Parser::bodyln_ok() {
   // "1-0:1.8.1(012345.678*kWh)<CR><LF>"
-  bool ok = _len>2 && _data[_len-2]=='\r' && _data[_len-1]=='\n';
+  bool ok = _pos>1 && _prev=='\r';
+  if( _field==TELE_FIELD_CODE ) { // no '(' found, strip the CR from the code
+    if( _len>0 && _data[_len-1]=='\r' ) _len--;
+    _data[_len]= '\0';
+  }
   if( !ok ) {
-    _data[_len-2] = '\0';
     Serial.printf("tele: ERROR body line corrupt '%s'\n",_data);
     return false;
   }
-
-  update_crc(_len);
-  _data[_len-2]='\0';
   //Serial.printf("tele: body line received '%s'\n",_data);
 
-  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
-    if( strncmp(_data, tele_fields[i].obis, strlen(tele_fields[i].obis))==0 ) {
-      char * pos_open_delim  = strrchr( _data, tele_fields[i].open_delim  );
-      if( pos_open_delim==0 ) {
-        Serial.printf("tele: ERROR body line '%s' could not find open delim '%c'\n",_data,tele_fields[i].open_delim);
-        return false;
-      }
-      char * pos_close_delim = strrchr( _data, tele_fields[i].close_delim );
-      if( pos_open_delim==0 ) {
-        Serial.printf("tele: ERROR body line '%s' could not find close delim '%c'\n",_data,tele_fields[i].close_delim);
-        return false;
-      }
-
-      int len = pos_close_delim - pos_open_delim - 1;
-      if( len<=0 || len>=TELE_VALUE_SIZE ) { 
-        // 0 len not allowed (and empty value means not found)
-        // TELE_VALUE_SIZE no allowed (we need to append the terminating zero)
-        Serial.printf("tele: ERROR body line '%s' data width mismatch (%d)\n",_data,len);
-        return false;
+  if( _field<0 ) return true;
+  
+  const Tele_Field * field = &tele_fields[_field];
+  // Found opening delim?
+  if( _vlen<0 ) {
+    Serial.printf("tele: ERROR body line '%s' could not find open delim '%c'\n",_data,field->open_delim);
+    return false;
+  }
+  // Found closing delim?
+  if( !_vend ) {
+    Serial.printf("tele: ERROR body line '%s' could not find close delim '%c'\n",_data,field->close_delim);
+    return false;
+  }
+  // Check range      
+  if( _vlen<=0 || _vlen>=TELE_VALUE_SIZE ) { 
+    // 0 len not allowed (and empty value means not found)
+    // TELE_VALUE_SIZE no allowed (we need to append the terminating zero)
+    Serial.printf("tele: ERROR body line '%s' data width mismatch (%d)\n",_data,_vlen);
+    return false;
+  }
+  // Value was already copied, terminate it
+  _value->str[_vlen] = '\0';
+  // Decode time stamp
+  if( field->type==TELE_TYPE_TIME ) {
+    if( !tele_time_decode(_value->str,&_value->num) ) {
+      Serial.printf("tele: ERROR body line '%s' value '%s' is not a time stamp\n",_data,_value->str);
+      return false;
+    }
+  }
+  // Value was already decoded, scale it
+  if( field->type==TELE_TYPE_MILLI || field->type==TELE_TYPE_INT ) {
+    if( _vdec<0 ) _vdec= 0;
+    if( _vbad || _vdec>TELE_MILLI_DECIMALS ) {
+      Serial.printf("tele: ERROR body line '%s' value '%s' is not numeric\n",_data,_value->str);
+      return false;
+    }
+    if( field->type==TELE_TYPE_MILLI ) {
+      for( ; _vdec<TELE_MILLI_DECIMALS; _vdec++ ) {
+        if( _vnum>INT32_MAX/10 ) { Serial.printf("tele: ERROR body line '%s' value '%s' too large\n",_data,_value->str); return false; }
+        _vnum*= 10;
       }
-      
-      memcpy( tele_fields[i].value, pos_open_delim+1, len );
-      tele_fields[i].value[len] = '\0';
-
-      //Serial.printf("tele: %s %s\n",tele_fields[i].name, tele_fields[i].value);
     }
+    _value->num= _vnum;
   }
+  // Remember whether the value changed
+  const Tele_Value * prev = &_front->values[_slot[_field]];
+  if( _front->seq==0 || strcmp(prev->str,_value->str)!=0 ) _back->changed|= 1UL<<_field;
+  // Serial.printf("tele: %s %s\n",field->name, _value->str);
   return true;
 }
 
 
 // Returns true iff the `_data[0.._len)` is a valid crc line, the CRC matches that of all collected bytes, and all field are found.
 // Prints and error if not.
+// Publishes the back snapshot if ok.
 bool Tele_Parser::csumln_ok() {
   // "!70CE<CR><LF>"
   bool ok = _len==7 && _data[0]=='!' && isxdigit(_data[1]) && isxdigit(_data[2]) && isxdigit(_data[3]) && isxdigit(_data[4]) && _data[5]=='\r' && _data[6]=='\n';
   if( !ok ) {
     _data[_len-2] = '\0';
     Serial.printf("tele: ERROR csum line corrupt '%s'\n",_data);
+    _stats.syntax++;
     return false;
   }
 
-  update_crc(1); // include '!' in crc
+  // The '!' is already included in crc by add()
   int c1 = toupper(_data[1]);
   int d1 = (c1>='A') ? (c1-'A'+10) : (c1-'0');
   int c2 = toupper(_data[2]);
@@ -258,19 +582,29 @@ bool Tele_Parser::csumln_ok() {
 
   if( csum!=_crc ) {
     Serial.printf("tele: ERROR crc mismatch (actual %04X, telegram says %04X)\n",_crc,csum);
+    _stats.crc++;
     return false;
   }
 
-  // Check if all objects have values
+  // Check if all objects (of this parser) have values
   for( int i=0; i<TELE_NUMFIELDS; i++ ) {
-    if( tele_fields[i].value[0] == '\0' ) {
+    if( _slot[i]>=0 && _back->values[_slot[i]].str[0] == '\0' ) {
       Serial.printf("tele: missing field '%s' with code '%s'\n",tele_fields[i].name,tele_fields[i].obis);
+      _stats.missing++;
       return false;
     }
   }
 
   //_data[_len-2]='\0';
   //Serial.printf("tele: csum line received '%s'\n",_data);
+
+  // Publish
+  _back->seq = ++_seq;
+  _stats.telegrams++;
+  _back->time = millis();
+  Tele_Snapshot * snap = _front;
+  _front = _back;
+  _back = snap;
   
   return true;  
 }
@@ -288,7 +622,9 @@ Tele_Result Tele_Parser::add(int ch) {
   // Too long no data?
   if( ch<0 ) {
     if( millis() - _time > TELE_MAXWAIT_MS ) {
-      if( _len>0 ) Serial.printf("tele: ... timeout (%d bytes discarded)\n",_len); else Serial.printf("tele: ERROR timeout\n");
+      if( _state!=TELE_STATE_IDLE ) Serial.printf("tele: ... timeout (telegram discarded)\n"); else if( _len>0 ) Serial.printf("tele: ... timeout (%d bytes discarded)\n",_len); else Serial.printf("tele: ERROR timeout\n");
+      _stats.timeouts++;
+      if( _state==TELE_STATE_IDLE ) _stats.discarded+= _len;
       set_state_idle();
       res = TELE_RESULT_ERROR;
     }
@@ -299,9 +635,10 @@ Tele_Result Tele_Parser::add(int ch) {
   if( _state==TELE_STATE_IDLE ) {
     if( ch=='/' ) {
       // Start of header. Init data collection, reset time to start of telegram
-      if( _len>0 ) { Serial.printf("tele: ... found header (%d bytes discarded)\n",_len); res=TELE_RESULT_ERROR; }
+      if( _len>0 ) { Serial.printf("tele: ... found header (%d bytes discarded)\n",_len); res=TELE_RESULT_ERROR; _stats.noise++; _stats.discarded+= _len; }
       set_state_head();
       _data[_len++]= ch;
+      _crc= crc16_add(_crc,ch);
     } else {
       // bytes come in without header
       if( _len==0 ) Serial.printf("tele: ERROR data without header ...\n");
@@ -310,25 +647,24 @@ Tele_Result Tele_Parser::add(int ch) {
     return res;
   }
 
-  // Does character fit in line buffer?
-  if( _len==TELE_LINE_SIZE ) {
-    Serial.printf("tele: ERROR line too long (%d)\n",_len);
-    res= TELE_RESULT_ERROR; 
-    set_state_idle();
-    return res;
-  }
-  _data[_len++]= ch;
+  // Fold the char into the CRC as it arrives: all chars of header and body, including the '!' (that is still received in body state)
+  if( _state!=TELE_STATE_CSUM ) _crc= crc16_add(_crc,ch);
 
   // Switch state if a special char comes in
   switch( _state ) {
   case TELE_STATE_HEAD:
     // Get e.g. "/KFM5KAIFA-METER<CR><LF><CR><LF>"
-    if( _len>3 && _data[_len-3]=='\n' && _data[_len-1]=='\n' ) { // include whiteline
+    if( !append(ch) ) {
+      res= TELE_RESULT_ERROR; 
+      _stats.syntax++;
+      set_state_idle();
+    } else if( _len>3 && _data[_len-3]=='\n' && _data[_len-1]=='\n' ) { // include whiteline
       // Header is complete (including whiteline)
       if( header_ok() ) {
         set_state_body();
       } else {
         res= TELE_RESULT_ERROR; 
+        _stats.syntax++;
         set_state_idle();
       }
     }  
@@ -336,50 +672,202 @@ Tele_Result Tele_Parser::add(int ch) {
     
   case TELE_STATE_BODY:
     // Get e.g. "1-0:1.8.1(012345.678*kWh)<CR><LF>"
-    if( ch=='!' ) {
+    if( ch=='!' && _pos==0 ) {
+      // A line starting with '!' is the csum line
       set_state_csum();
+      append(ch);
     } else if( ch=='\n' ) {
       // Body line is complete
       if( bodyln_ok() ) {
-        _len= 0;
+        set_state_body(); // next line
       } else {
        res= TELE_RESULT_ERROR; 
+       _stats.syntax++;
        set_state_idle();
       }
+    } else {
+      bodyln_add(ch);
     }
     break;
     
   case TELE_STATE_CSUM:
     // get e.g. "!70CE<CR><LF>"
-    if( ch=='\n' ) {
+    if( !append(ch) ) {
+      res= TELE_RESULT_ERROR; 
+      _stats.syntax++;
+      set_state_idle();
+    } else if( ch=='\n' ) {
       // CRC is complete
       if( csumln_ok() ) res=TELE_RESULT_AVAILABLE; else res=TELE_RESULT_ERROR; 
       set_state_idle();
     }
     break;
-  
+
+  default:
+    break;
   } // switch
   return res;
 }
 
 
 
+// Feed the next `len` characters from the emeter into the parser. Feed 0 characters if none received (this checks timeouts).
+// This is equivalent to calling add() for each character, but spans that need no tokenizing are handled in bulk:
+// bytes before a header are skipped with memchr(), and the rest of a line that is not registered is checksummed in one go.
+// Most registered lines (meter readings, failure counters) are the same in consecutive telegrams. When the rest of a
+// registered line is in buf and its value has the same bytes as in the previous telegram (and the line ends as a valid
+// one), it is also checksummed in one go, and the previous value (with its decoded number) is copied instead of extracted.
+// It returns the number of telegrams that became available (the last one is in the snapshot).
+// If `errors` is not NULL, the number of TELE_RESULT_ERROR results is added to it.
+int Tele_Parser::add_buf(const char * buf, size_t len, int * errors) {
+  int available = 0;
+  Tele_Result res;
+  _stats.bytes += len;
+
+  if( len==0 ) {
+    res = add(-1);
+    if( res==TELE_RESULT_ERROR && errors!=NULL ) (*errors)++;
+    return 0;
+  }
+
+  const char * end = buf + len;
+  while( buf<end ) {
+    if( _state==TELE_STATE_IDLE && *buf!='/' ) {
+      // Skip to header; only the first discarded byte needs add() (for the message), the others are counted
+      const char * head = (const char *)memchr(buf, '/', end-buf);
+      if( head==NULL ) head = end;
+      if( _len==0 ) add((uint8_t)*buf++);
+      _len += head-buf;
+      buf = head;
+      continue;
+    }
+    if( _state==TELE_STATE_BODY && _field==TELE_FIELD_NONE && *buf!='\n' && _tfn==NULL ) {
+      // Rest of a line that is not registered: only checksum it, up to the LF (which add() handles)
+      const char * lf = (const char *)memchr(buf, '\n', end-buf);
+      if( lf==NULL ) lf = end;
+      _crc = crc16_update(_crc, buf, lf-buf);
+      _pos += lf-buf;
+      _prev = (uint8_t)lf[-1];
+      buf = lf;
+      continue;
+    }
+    if( _state==TELE_STATE_BODY && _field>=0 && _pos==_len+1 && _front->seq!=0 && _tfn==NULL ) {
+      // Just after the '(' of a registered line: if the rest of the line is in buf, the value starts after the last open
+      // delim (or here, when the '(' was the open delim). When its bytes equal the previous value, followed by the close
+      // delim, and the line ends with CR, the value is the same; copy it instead of extracting it again
+      const char * lf = (const char *)memchr(buf, '\n', end-buf);
+      const Tele_Field * field = &tele_fields[_field];
+      const Tele_Value * prev = &_front->values[_slot[_field]];
+      const char * val = lf!=NULL ? (const char *)memrchr(buf, field->open_delim, lf-buf) : NULL;
+      if( val!=NULL ) val++; else if( field->open_delim=='(' ) val = buf;
+      size_t vlen = strlen(prev->str);
+      if( lf!=NULL && val!=NULL && lf>buf && lf[-1]=='\r' && (size_t)(lf-val)>vlen && memcmp(val, prev->str, vlen)==0 && val[vlen]==field->close_delim ) {
+        _crc = crc16_update(_crc, buf, lf-buf);
+        _pos += lf-buf;
+        _prev = (uint8_t)lf[-1];
+        *_value = *prev;
+        _field = TELE_FIELD_SAME; // bodyln_ok() has nothing to check
+        _stats.unchanged++;
+        buf = lf;
+        continue;
+      }
+    }
+    _cur = buf;
+    res = add((uint8_t)*buf++);
+    if( res==TELE_RESULT_AVAILABLE ) available++;
+    if( res==TELE_RESULT_ERROR && errors!=NULL ) (*errors)++;
+  }
+  if( _tfn!=NULL ) token_keep();
+  _cur = NULL;
+  return available;
+}
+
+
+
 // === Public API ================================================================
 
+// The default parser, used by the functions without parser argument
 static Tele_Parser tele_parser;
 
 
-void tele_init() {
-  tele_parser.begin();
-  Serial.printf("tele: init\n");
+void tele_init(uint32_t fields) {
+  tele_parser.begin(fields);
+  Serial.printf("tele: init (%d fields)\n", __builtin_popcount(tele_parser.fields()));
+}
+
+
+uint32_t tele_fields_mask(const char * keys) {
+  uint32_t mask = 0;
+  for( ; *keys!='\0'; keys++ ) {
+    for( int i=0; i<TELE_NUMFIELDS; i++ ) if( tele_fields[i].key==*keys ) mask |= 1UL<<i;
+  }
+  return mask;
+}
+
+
+Tele_Parser * tele_parser_new(uint32_t fields) {
+  Tele_Parser * parser = new Tele_Parser();
+  parser->begin(fields);
+  return parser;
+}
+
+
+void tele_parser_delete(Tele_Parser * parser) {
+  delete parser;
+}
+
+
+Tele_Result tele_parser_add(Tele_Parser * parser, int ch) {
+  if( ch>=0 ) parser->count(1);
+  return parser->add(ch);
+}
+
+
+int tele_parser_add_buf(Tele_Parser * parser, const char * buf, size_t len, int * errors) {
+  return parser->add_buf(buf,len,errors);
+}
+
+
+void tele_parser_tokenize(Tele_Parser * parser, Tele_Token_Fn fn, void * ctx) {
+  parser->tokenize(fn,ctx);
 }
 
+
+void tele_tokenize(Tele_Token_Fn fn, void * ctx) {
+  tele_parser.tokenize(fn,ctx);
+}
+
+
+const Tele_Stats * tele_parser_stats(const Tele_Parser * parser) {
+  return parser->stats();
+}
+
+
+const Tele_Stats * tele_stats() {
+  return tele_parser.stats();
+}
+
+
+const Tele_Snapshot * tele_parser_snapshot(const Tele_Parser * parser) {
+  return parser->snapshot();
+}
+
+
 Tele_Result tele_parser_add(int ch) {
-  return tele_parser.add(ch);
+  return tele_parser_add(&tele_parser,ch);
 }
 
+int tele_parser_add_buf(const char * buf, size_t len, int * errors) {
+  return tele_parser.add_buf(buf,len,errors);
+}
+
+
+bool tele_field_selected(int ix) {
+  return tele_parser.fields() & (1UL<<ix);
+}
 
-const char tele_field_key(int ix) {
+
+char tele_field_key(int ix) {
   return tele_fields[ix].key;
 }
 
@@ -394,6 +882,93 @@ const char * tele_field_description(int ix) {
 }
 
 
+const char * tele_field_obis(int ix) {
+  return tele_fields[ix].obis;
+}
+
+
 const char * tele_field_value(int ix) {
-  return tele_fields[ix].value;
+  return tele_snapshot_value(tele_parser.snapshot(),ix);
+}
+
+
+Tele_Type tele_field_type(int ix) {
+  return tele_fields[ix].type;
+}
+
+
+int32_t tele_field_milli(int ix) {
+  return tele_snapshot_milli(tele_parser.snapshot(),ix);
+}
+
+
+int32_t tele_field_int(int ix) {
+  return tele_snapshot_int(tele_parser.snapshot(),ix);
+}
+
+
+// Returns the CRC16 of all fields' key, obis code and type (computed by the compiler)
+static constexpr uint16_t tele_schema_crc() {
+  uint16_t crc = 0;
+  for( int i=0; i<TELE_NUMFIELDS; i++ ) {
+    const char * s = tele_fields[i].obis;
+    char buf[2] = { tele_fields[i].key, (char)('0'+tele_fields[i].type) };
+    for( int j=0; j<2; j++ ) crc = crc16_step(crc, buf[j]);
+    while( *s ) crc = crc16_step(crc, *s++);
+  }
+  return crc;
+}
+
+
+uint16_t tele_schema() {
+  static constexpr uint16_t schema = tele_schema_crc();
+  return schema;
+}
+
+
+const Tele_Snapshot * tele_snapshot() {
+  return tele_parser.snapshot();
+}
+
+
+uint32_t tele_snapshot_seq(const Tele_Snapshot * snap) {
+  return snap->seq;
+}
+
+
+uint32_t tele_snapshot_time(const Tele_Snapshot * snap) {
+  return snap->time;
+}
+
+
+uint32_t tele_snapshot_changed(const Tele_Snapshot * snap) {
+  return snap->changed;
+}
+
+
+const char * tele_snapshot_value(const Tele_Snapshot * snap, int ix) {
+  int slot = snap->slot[ix];
+  return slot>=0 ? snap->values[slot].str : "";
+}
+
+
+// Returns the decoded value of field `ix` in `snap` (0 if not selected)
+static int32_t tele_snapshot_decoded(const Tele_Snapshot * snap, int ix) {
+  int slot = snap->slot[ix];
+  return slot>=0 ? snap->values[slot].num : 0;
+}
+
+
+int32_t tele_snapshot_milli(const Tele_Snapshot * snap, int ix) {
+  return tele_fields[ix].type==TELE_TYPE_MILLI ? tele_snapshot_decoded(snap,ix) : 0;
+}
+
+
+int32_t tele_snapshot_int(const Tele_Snapshot * snap, int ix) {
+  return tele_fields[ix].type==TELE_TYPE_INT || tele_fields[ix].type==TELE_TYPE_TIME ? tele_snapshot_decoded(snap,ix) : 0;
+}
+
+
+int32_t tele_snapshot_num(const Tele_Snapshot * snap, int ix) {
+  return tele_fields[ix].type!=TELE_TYPE_STRING ? tele_snapshot_decoded(snap,ix) : 0;
 }
@@ -0,0 +1,205 @@
+// telegen.cpp - Generator of synthetic DSMR telegrams (for testing and benchmarking the parser)
+
+
+#include <Arduino.h>
+#include "telegen.h"
+#include "crc16.h"
+
+
+// === HELPERS ==================================================================================
+
+
+// Returns a pseudo random number (xorshift32)
+static uint32_t telegen_rand(Telegen * gen) {
+  uint32_t x = gen->rnd;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return gen->rnd = x;
+}
+
+
+// Returns a pseudo random number in [lo,hi]
+static int32_t telegen_range(Telegen * gen, int32_t lo, int32_t hi) {
+  return lo + (int32_t)(telegen_rand(gen) % (uint32_t)(hi-lo+1));
+}
+
+
+// Writes time stamp `secs` (since 2000-01-01 00:00:00) as "YYMMDDhhmmssX" to `buf` (at least 16 bytes)
+// X is S for summer time (April to October) and W for winter time; that is close enough for testing.
+static void telegen_time(char * buf, int32_t secs) {
+  // Civil date from days since 2000-01-01 (the inverse of tele_time_decode() in tele.cpp)
+  int32_t z = secs/86400 + 730425;  // days since 0000-03-01
+  int32_t era = z / 146097;
+  int32_t doe = z - era*146097;
+  int32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+  int32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+  int32_t mp = (5*doy + 2) / 153;
+  int d = doy - (153*mp + 2)/5 + 1;
+  int m = mp<10 ? mp+3 : mp-9;
+  int y = yoe + era*400 + (m<=2);
+  int s = secs%86400;
+  snprintf(buf, 16, "%02u%02u%02u%02u%02u%02u", (unsigned)y%100, (unsigned)m%100, (unsigned)d%100, (unsigned)s/3600%100, (unsigned)s/60%60, (unsigned)s%60);
+  buf[12] = m>=4 && m<=10 ? 'S' : 'W';
+  buf[13] = '\0';
+}
+
+
+// Writer for a telegram: appends with printf semantics, tracks overflow
+struct Telegen_Writer {
+  char * buf;
+  int    size;
+  int    len;
+  bool   full;
+};
+
+
+static void telegen_printf(Telegen_Writer * w, const char * fmt, ...) __attribute__ ((format (printf, 2, 3)));
+static void telegen_printf(Telegen_Writer * w, const char * fmt, ...) {
+  if( w->full ) return;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(w->buf+w->len, w->size-w->len, fmt, args);
+  va_end(args);
+  if( n<0 || n>=w->size-w->len ) { w->full = true; return; }
+  w->len += n;
+}
+
+
+// Writes a kW value with 3 decimals from `watt`
+#define KW(watt)  (unsigned)((watt)/1000), (unsigned)((watt)%1000)
+
+
+// === API ======================================================================================
+
+
+void telegen_init(Telegen * gen, int flags, uint32_t seed) {
+  gen->flags = flags;
+  gen->rnd = seed ? seed : 1;
+  gen->time = 707771622 + telegen_range(gen,0,86400*365); // somewhere after 2022-06-05
+  gen->cons[0] = telegen_range(gen,1000000,30000000);
+  gen->cons[1] = telegen_range(gen,1000000,30000000);
+  gen->prod[0] = telegen_range(gen,0,5000000);
+  gen->prod[1] = telegen_range(gen,0,5000000);
+  gen->gas = telegen_range(gen,1000000,20000000);
+  gen->power = telegen_range(gen,-2000,4000);
+  gen->fails = telegen_range(gen,0,50);
+  gen->count = 0;
+}
+
+
+int32_t telegen_power(const Telegen * gen, bool prod) {
+  if( prod ) return gen->power<0 ? -gen->power : 0;
+  return gen->power>0 ? gen->power : 0;
+}
+
+
+int telegen_next(Telegen * gen, char * buf, int size) {
+  bool dsmr50 = gen->flags & TELEGEN_DSMR50;
+  bool three = gen->flags & TELEGEN_3PHASE;
+  int interval = dsmr50 ? 1 : 10;
+
+  // Evolve the readings
+  if( gen->count>0 ) {
+    gen->time += interval;
+    gen->power += telegen_range(gen,-150,150);
+    if( gen->power> 9000 ) gen->power= 9000;
+    if( gen->power<-6000 ) gen->power=-6000;
+    int hour = gen->time%86400/3600;
+    int tariff = hour>=7 && hour<23 ? 1 : 0;
+    if( gen->power>0 ) gen->cons[tariff] += (gen->power*interval+1800)/3600; else gen->prod[tariff] += (-gen->power*interval+1800)/3600;
+    if( gen->time%300 < interval ) gen->gas += telegen_range(gen,0,40);
+    if( telegen_range(gen,0,999)==0 ) gen->fails++;
+  }
+  gen->count++;
+  int hour = gen->time%86400/3600;
+  int tariff = hour>=7 && hour<23 ? 2 : 1;
+  int32_t cons = telegen_power(gen,false);
+  int32_t prod = telegen_power(gen,true);
+  // Split the power over the phases
+  int32_t cphase[3] = { cons, 0, 0 };
+  int32_t pphase[3] = { prod, 0, 0 };
+  if( three ) {
+    cphase[1] = cons/3; cphase[2] = cons/4; cphase[0] = cons-cphase[1]-cphase[2];
+    pphase[1] = prod/3; pphase[2] = prod/3; pphase[0] = prod-pphase[1]-pphase[2];
+  }
+  int phases = three ? 3 : 1;
+  static const int lx[3] = { 2, 4, 6 }; // the obis "group" of L1, L2, L3: 1-0:x1.7.0 etc
+  char ts[16];
+  telegen_time(ts, gen->time);
+
+  Telegen_Writer w = { buf, size, 0, false };
+  if( dsmr50 ) telegen_printf(&w, "/ISk5\\2MT382-1000\r\n\r\n1-3:0.2.8(50)\r\n");
+  else         telegen_printf(&w, "/KFM5KAIFA-METER\r\n\r\n1-3:0.2.8(42)\r\n");
+  telegen_printf(&w, "0-0:1.0.0(%s)\r\n", ts);
+  telegen_printf(&w, "0-0:96.1.1(4530303033303030303034343234323134)\r\n");
+  telegen_printf(&w, "1-0:1.8.1(%06u.%03u*kWh)\r\n", KW(gen->cons[0]));
+  telegen_printf(&w, "1-0:1.8.2(%06u.%03u*kWh)\r\n", KW(gen->cons[1]));
+  telegen_printf(&w, "1-0:2.8.1(%06u.%03u*kWh)\r\n", KW(gen->prod[0]));
+  telegen_printf(&w, "1-0:2.8.2(%06u.%03u*kWh)\r\n", KW(gen->prod[1]));
+  telegen_printf(&w, "0-0:96.14.0(%04d)\r\n", tariff);
+  telegen_printf(&w, "1-0:1.7.0(%02u.%03u*kW)\r\n", KW(cons));
+  telegen_printf(&w, "1-0:2.7.0(%02u.%03u*kW)\r\n", KW(prod));
+  telegen_printf(&w, "0-0:96.7.21(%05d)\r\n", gen->fails);
+  telegen_printf(&w, "0-0:96.7.9(%05d)\r\n", gen->fails/3);
+  // Power failure event log: number of entries, then per entry the end time and duration
+  int events = gen->flags & TELEGEN_FAILLOG ? 10 : 1;
+  telegen_printf(&w, "1-0:99.97.0(%d)(0-0:96.7.19)", events);
+  for( int i=0; i<events; i++ ) {
+    telegen_time(ts, gen->time - 86400*(i+1)*7);
+    telegen_printf(&w, "(%s)(%010u*s)", ts, 60u*(i+1)*37);
+  }
+  telegen_printf(&w, "\r\n");
+  for( int ph=0; ph<phases; ph++ ) telegen_printf(&w, "1-0:%d2.32.0(00000)\r\n", lx[ph]+1);
+  for( int ph=0; ph<phases; ph++ ) telegen_printf(&w, "1-0:%d2.36.0(00000)\r\n", lx[ph]+1);
+  telegen_printf(&w, "0-0:96.13.1()\r\n");
+  if( gen->flags & TELEGEN_MESSAGE ) {
+    telegen_printf(&w, "0-0:96.13.0(");
+    for( int i=0; i<512; i++ ) telegen_printf(&w, "%02X", 0x30 + i%64);
+    telegen_printf(&w, ")\r\n");
+  } else {
+    telegen_printf(&w, "0-0:96.13.0()\r\n");
+  }
+  if( dsmr50 ) for( int ph=0; ph<phases; ph++ ) telegen_printf(&w, "1-0:%d2.7.0(%03d.%d*V)\r\n", lx[ph]+1, 229+ph, telegen_range(gen,0,9));
+  for( int ph=0; ph<phases; ph++ ) telegen_printf(&w, "1-0:%d1.7.0(%03d*A)\r\n", lx[ph]+1, (int)((cphase[ph]+pphase[ph])/230));
+  for( int ph=0; ph<phases; ph++ ) telegen_printf(&w, "1-0:%d1.7.0(%02u.%03u*kW)\r\n", lx[ph], KW(cphase[ph]));
+  for( int ph=0; ph<phases; ph++ ) telegen_printf(&w, "1-0:%d2.7.0(%02u.%03u*kW)\r\n", lx[ph], KW(pphase[ph]));
+  if( gen->flags & TELEGEN_GAS ) {
+    telegen_time(ts, gen->time - gen->time%300);
+    telegen_printf(&w, "0-1:24.1.0(003)\r\n");
+    telegen_printf(&w, "0-1:96.1.0(4730303339303031363532303530323136)\r\n");
+    telegen_printf(&w, "0-1:24.2.1(%s)(%05u.%03u*m3)\r\n", ts, KW(gen->gas));
+  }
+  telegen_printf(&w, "!");
+  if( w.full || w.len+7>size ) return 0;
+  uint16_t crc = crc16_update(CRC16_INIT, buf, w.len);
+  telegen_printf(&w, "%04X\r\n", crc);
+  return w.len;
+}
+
+
+int telegen_corrupt(Telegen * gen, char * buf, int len, int size, Telegen_Corruption corruption) {
+  switch( corruption ) {
+  case TELEGEN_BITFLIP: {
+    int pos = telegen_range(gen, 0, len-1);
+    buf[pos] ^= 1 << telegen_range(gen,0,7);
+    break;
+  }
+  case TELEGEN_TRUNCATE:
+    len = telegen_range(gen, 1, len-1);
+    break;
+  case TELEGEN_NOISE: {
+    int n = telegen_range(gen, 1, 16);
+    if( len+n>=size ) n = size-1-len;
+    int pos = telegen_range(gen, 0, len);
+    memmove(buf+pos+n, buf+pos, len-pos);
+    for( int i=0; i<n; i++ ) buf[pos+i] = telegen_rand(gen);
+    len += n;
+    break;
+  }
+  default:
+    break;
+  }
+  buf[len] = '\0';
+  return len;
+}
@@ -0,0 +1,56 @@
+// telegen.h - Interface to a generator of synthetic DSMR telegrams (for testing and benchmarking the parser)
+#ifndef _TELEGEN_H_
+#define _TELEGEN_H_
+
+
+#include <stdint.h>
+
+
+// The shape of the generated telegrams is a combination of these flags
+#define TELEGEN_DSMR50   0x01 // DSMR 5.0: a telegram every second, with voltages; otherwise DSMR 4.2: every 10 seconds
+#define TELEGEN_3PHASE   0x02 // three phase meter (L1, L2, L3); otherwise single phase (L1 only)
+#define TELEGEN_GAS      0x04 // M-Bus gas meter on channel 1
+#define TELEGEN_MESSAGE  0x08 // long text message (1024 chars) in 0-0:96.13.0; otherwise empty
+#define TELEGEN_FAILLOG  0x10 // power failure event log with 10 entries in 1-0:99.97.0; otherwise 1 entry
+
+
+// The ways a telegram can be corrupted
+enum Telegen_Corruption {
+  TELEGEN_NONE,     // telegram stays valid
+  TELEGEN_BITFLIP,  // one random bit is flipped
+  TELEGEN_TRUNCATE, // the telegram is cut off at a random position
+  TELEGEN_NOISE,    // a burst of random bytes is inserted at a random position
+};
+
+
+// The state of a generated meter: its readings evolve from telegram to telegram
+struct Telegen {
+  int      flags;     // shape, see TELEGEN_XXX
+  uint32_t rnd;       // state of the pseudo random generator
+  int32_t  time;      // meter time in seconds since 2000-01-01 00:00:00
+  uint32_t cons[2];   // consumed energy (tariff 1 and 2) in Wh
+  uint32_t prod[2];   // produced energy (tariff 1 and 2) in Wh
+  uint32_t gas;       // gas in dm3 (liters)
+  int32_t  power;     // net power in W (positive is consumption, negative is production)
+  int      fails;     // number of short power failures
+  int      count;     // number of telegrams generated
+};
+
+
+// Initialize `gen` for a meter of shape `flags` (see TELEGEN_XXX); `seed` makes the readings reproducible
+void telegen_init(Telegen * gen, int flags, uint32_t seed);
+
+
+// Writes the next (valid) telegram to `buf` (of `size`, zero terminated). Returns its length, or 0 if it does not fit.
+int  telegen_next(Telegen * gen, char * buf, int size);
+
+
+// Corrupts the telegram of `len` bytes in `buf` (of `size`) with `corruption`. Returns the new length.
+int  telegen_corrupt(Telegen * gen, char * buf, int len, int size, Telegen_Corruption corruption);
+
+
+// Returns the power in milli kW (ie W) of the last generated telegram, consumption (`prod` false) or production
+int32_t telegen_power(const Telegen * gen, bool prod);
+
+
+#endif